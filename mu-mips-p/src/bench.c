@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "mu-mips.h"
+#include "cache.h"
+#include "funcsim.h"
+#include "threaded.h"
+#include "dbt.h"
+#include "ooo.h"
+#include "fu.h"
+#include "loader.h"
+#include "bench.h"
+
+static const char *ENGINE_NAMES[ENGINES] = { "pipeline", "interp", "threaded", "dbt" };
+
+int engine_parse(const char *name)
+{
+    int i;
+
+    for (i = 0; i < ENGINES; i++) {
+        if (strcmp(name, ENGINE_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *engine_name(int engine)
+{
+    return (engine >= 0 && engine < ENGINES) ? ENGINE_NAMES[engine] : "?";
+}
+
+/***************************************************************/
+/* Host instruction counter, -1 where perf events are unavailable              */
+/***************************************************************/
+static int counter_open()
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void counter_start(int fd)
+{
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+static uint64_t counter_stop(int fd)
+{
+    uint64_t value = 0;
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+            value = 0;
+        }
+    }
+#endif
+    return value;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* start the program over without reloading memory, so short programs can be repeated */
+static void restart()
+{
+    memset(&IF_ID, 0, sizeof(IF_ID));
+    memset(&ID_EX, 0, sizeof(ID_EX));
+    memset(&EX_MEM, 0, sizeof(EX_MEM));
+    memset(&MEM_WB, 0, sizeof(MEM_WB));
+    ooo_reset();
+    fu_reset();
+    if (CACHES.enabled) {
+        cache_reset();
+    }
+    CURRENT_STATE.PC = PROGRAM_IMAGE.entry;
+    NEXT_STATE = CURRENT_STATE;
+    RUN_FLAG = TRUE;
+}
+
+/* run count instructions on engine, restarting the program whenever it halts */
+static uint64_t run_engine(int engine, uint64_t count)
+{
+    uint64_t done = 0, before;
+
+    restart();
+    while (done < count) {
+        if (!RUN_FLAG) {
+            restart();
+        }
+        switch (engine) {
+            case ENGINE_PIPELINE:
+                before = INSTRUCTION_COUNT;
+                cycle_skip(UINT32_MAX);
+                done += INSTRUCTION_COUNT - before;
+                break;
+            case ENGINE_INTERP:
+                done += func_run(count - done);
+                break;
+            case ENGINE_THREADED:
+                done += tc_run(count - done);
+                break;
+            default:
+                done += dbt_run(count - done);
+                break;
+        }
+    }
+    return done;
+}
+
+/***************************************************************/
+/* Compare the cost of each engine per simulated instruction                           */
+/***************************************************************/
+/* The program is repeated until count instructions have run on each engine,
+ * then the simulator is reset. */
+void bench_engines(uint64_t count)
+{
+    uint64_t done, host;
+    double start, elapsed;
+    int fd = counter_open();
+    int i;
+
+    if (PROGRAM_IMAGE.words == 0 || count == 0) {
+        return;
+    }
+    if (fd < 0) {
+        printf("Host instruction counter unavailable, reporting time only.\n");
+    }
+    printf("-------------------------------------------------------------\n");
+    printf("[Engine]\t[Instructions]\t[Host inst/inst]\t[ns/inst]\n");
+    printf("-------------------------------------------------------------\n");
+    for (i = 0; i < ENGINES; i++) {
+        start = now();
+        counter_start(fd);
+        done = run_engine(i, count);
+        host = counter_stop(fd);
+        elapsed = now() - start;
+        if (fd >= 0) {
+            printf("%s\t%llu\t\t%.1f\t\t\t%.2f\n", ENGINE_NAMES[i], (unsigned long long)done,
+                   (double)host / done, elapsed * 1e9 / done);
+        } else {
+            printf("%s\t%llu\t\t-\t\t\t%.2f\n", ENGINE_NAMES[i], (unsigned long long)done, elapsed * 1e9 / done);
+        }
+    }
+    printf("-------------------------------------------------------------\n");
+    if (fd >= 0) {
+        close(fd);
+    }
+    reset();
+}
@@ -0,0 +1,24 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+/***************************************************************/
+/* Engine benchmark                                                                                               */
+/***************************************************************/
+typedef enum {
+	ENGINE_PIPELINE = 0,    /* the five stage functions, one cycle at a time */
+	ENGINE_INTERP,          /* func_run() */
+	ENGINE_THREADED,        /* tc_run() */
+	ENGINE_DBT,             /* dbt_run() */
+	ENGINES
+} engine_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void bench_engines(uint64_t count);
+int engine_parse(const char *name);
+const char *engine_name(int engine);
+
+#endif
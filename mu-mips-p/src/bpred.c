@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "bpred.h"
+#include "reverse.h"
+
+SIM_LOCAL bpred_t BPRED;
+
+static const char *KIND_NAMES[BPRED_KINDS] = { "nottaken", "bimodal", "gshare", "btb" };
+
+/***************************************************************/
+/* Select the predictor used by IF and size its tables                                          */
+/***************************************************************/
+int bpred_configure(bpred_kind_t kind, int bits)
+{
+    uint8_t *counters;
+    btb_entry_t *btb;
+
+    if (bits < 1 || bits > BPRED_MAX_BITS) {
+        printf("Error: predictor table bits must be between 1 and %d\n", BPRED_MAX_BITS);
+        return -1;
+    }
+    counters = malloc((size_t)1 << bits);
+    btb = malloc(sizeof(btb_entry_t) << bits);
+    if (counters == NULL || btb == NULL) {
+        printf("Error: out of memory allocating predictor tables\n");
+        free(counters);
+        free(btb);
+        return -1;
+    }
+    free(BPRED.counters);
+    free(BPRED.btb);
+    BPRED.kind = kind;
+    BPRED.bits = bits;
+    BPRED.counters = counters;
+    BPRED.btb = btb;
+    bpred_reset();
+    return 0;
+}
+
+/***************************************************************/
+/* Forget all learned state, the counters are kept                                                  */
+/***************************************************************/
+void bpred_reset()
+{
+    if (BPRED.counters == NULL) {
+        bpred_configure(BPRED.kind, BPRED_DEFAULT_BITS);
+        return;
+    }
+    memset(BPRED.counters, 1, (size_t)1 << BPRED.bits);
+    memset(BPRED.btb, 0, sizeof(btb_entry_t) << BPRED.bits);
+    BPRED.history = 0;
+}
+
+void bpred_release()
+{
+    free(BPRED.counters);
+    free(BPRED.btb);
+    memset(&BPRED, 0, sizeof(BPRED));
+}
+
+void bpred_reset_stats()
+{
+    memset(BPRED.stats, 0, sizeof(BPRED.stats));
+}
+
+static uint32_t counter_index(uint32_t pc)
+{
+    uint32_t index = pc >> 2;
+
+    if (BPRED.kind == BPRED_GSHARE) {
+        index ^= BPRED.history;
+    }
+    return index & ((1u << BPRED.bits) - 1);
+}
+
+static btb_entry_t *btb_entry(uint32_t pc)
+{
+    return &BPRED.btb[(pc >> 2) & ((1u << BPRED.bits) - 1)];
+}
+
+/***************************************************************/
+/* Address to fetch after pc, d is the instruction fetched at pc                             */
+/***************************************************************/
+/* only control instructions consult the tables, the predecoded record stands in for
+ * the predecode bits a real front end keeps next to the instruction cache */
+uint32_t bpred_predict(uint32_t pc, const decoded_inst_t *d)
+{
+    btb_entry_t *e;
+
+    if (!(d->flags & INST_CTRL) || BPRED.kind == BPRED_NOT_TAKEN) {
+        return pc + 4;
+    }
+    e = btb_entry(pc);
+    if (e->pc != pc) {
+        return pc + 4;
+    }
+    if ((d->flags & INST_BRANCH) && BPRED.kind != BPRED_BTB &&
+        BPRED.counters[counter_index(pc)] < 2) {
+        return pc + 4;
+    }
+    return e->target;
+}
+
+/***************************************************************/
+/* Train on a control instruction resolved in EX                                                    */
+/***************************************************************/
+void bpred_update(uint32_t pc, const decoded_inst_t *d, uint32_t target, uint32_t predicted)
+{
+    bpred_counters_t *c = &BPRED.stats[BPRED.kind];
+    int taken = target != pc + 4;
+    btb_entry_t *e = btb_entry(pc);
+    uint8_t *counter;
+
+    c->lookups++;
+    if (target != predicted) {
+        c->mispredicts++;
+        c->penalty += BPRED_PENALTY;
+    }
+    if (d->flags & INST_BRANCH) {
+        counter = &BPRED.counters[counter_index(pc)];
+        if (REVERSE.logging) {
+            reverse_undo_bytes(counter, sizeof(*counter));
+        }
+        if (taken && *counter < 3) {
+            (*counter)++;
+        } else if (!taken && *counter > 0) {
+            (*counter)--;
+        }
+        BPRED.history = (BPRED.history << 1) | taken;
+    }
+    if (REVERSE.logging) {
+        reverse_undo_bytes(e, sizeof(*e));
+    }
+    if (taken) {
+        e->pc = pc;
+        e->target = target;
+    } else if (BPRED.kind == BPRED_BTB && e->pc == pc) {
+        /* a BTB alone predicts the last outcome */
+        e->pc = 0;
+    }
+}
+
+int bpred_parse_kind(const char *name)
+{
+    int i;
+
+    for (i = 0; i < BPRED_KINDS; i++) {
+        if (strcmp(name, KIND_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *bpred_kind_name(int kind)
+{
+    return (kind >= 0 && kind < BPRED_KINDS) ? KIND_NAMES[kind] : "?";
+}
+
+static double accuracy(const bpred_counters_t *c)
+{
+    return c->lookups ? 100.0 * (c->lookups - c->mispredicts) / c->lookups : 0.0;
+}
+
+/***************************************************************/
+/* Print the counters of every predictor that has been used                                  */
+/***************************************************************/
+void bpred_print(FILE *out)
+{
+    const bpred_counters_t *c;
+    int i;
+
+    fprintf(out, "Branch predictor\t: %s (%d bits)\n", bpred_kind_name(BPRED.kind), BPRED.bits);
+    for (i = 0; i < BPRED_KINDS; i++) {
+        c = &BPRED.stats[i];
+        if (c->lookups == 0 && i != BPRED.kind) {
+            continue;
+        }
+        fprintf(out, "  %-10s: %llu branches, %llu mispredicted, %.2f%% accurate, %llu penalty cycles\n",
+                KIND_NAMES[i], (unsigned long long)c->lookups, (unsigned long long)c->mispredicts,
+                accuracy(c), (unsigned long long)c->penalty);
+    }
+}
+
+void bpred_print_json(FILE *out)
+{
+    const bpred_counters_t *c;
+    int i;
+
+    fprintf(out, "{ \"kind\": \"%s\", \"bits\": %d", bpred_kind_name(BPRED.kind), BPRED.bits);
+    for (i = 0; i < BPRED_KINDS; i++) {
+        c = &BPRED.stats[i];
+        if (c->lookups == 0 && i != BPRED.kind) {
+            continue;
+        }
+        fprintf(out, ", \"%s\": { \"branches\": %llu, \"mispredicts\": %llu, \"accuracy\": %.4f, \"penalty\": %llu }",
+                KIND_NAMES[i], (unsigned long long)c->lookups, (unsigned long long)c->mispredicts,
+                accuracy(c) / 100.0, (unsigned long long)c->penalty);
+    }
+    fprintf(out, " }");
+}
@@ -0,0 +1,61 @@
+#ifndef BPRED_H
+#define BPRED_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "decode.h"
+
+/***************************************************************/
+/* Branch prediction in IF                                                                                         */
+/***************************************************************/
+typedef enum {
+	BPRED_NOT_TAKEN = 0,    /* static, always fetch PC+4 */
+	BPRED_BIMODAL,          /* 2-bit counters indexed by PC */
+	BPRED_GSHARE,           /* 2-bit counters indexed by PC xor global history */
+	BPRED_BTB,              /* taken whenever the BTB holds a target */
+	BPRED_KINDS
+} bpred_kind_t;
+
+#define BPRED_DEFAULT_BITS  10
+#define BPRED_MAX_BITS      20
+/* wrong-path instructions squashed per mispredict: the ones in IF/ID and IF */
+#define BPRED_PENALTY       2
+
+typedef struct {
+	uint32_t pc;            /* 0 for an empty entry */
+	uint32_t target;
+} btb_entry_t;
+
+typedef struct {
+	uint64_t lookups;       /* control instructions resolved in EX */
+	uint64_t mispredicts;
+	uint64_t penalty;       /* fetch cycles lost to flushes */
+} bpred_counters_t;
+
+typedef struct {
+	bpred_kind_t kind;
+	int bits;                       /* log2 of the counter and BTB table sizes */
+	uint8_t *counters;              /* 2-bit saturating, weakly not taken after reset */
+	btb_entry_t *btb;
+	uint32_t history;               /* global outcomes, newest in bit 0 */
+	bpred_counters_t stats[BPRED_KINDS];
+} bpred_t;
+
+extern SIM_LOCAL bpred_t BPRED;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int bpred_configure(bpred_kind_t kind, int bits);
+void bpred_reset();
+void bpred_release();
+void bpred_reset_stats();
+uint32_t bpred_predict(uint32_t pc, const decoded_inst_t *d);
+void bpred_update(uint32_t pc, const decoded_inst_t *d, uint32_t target, uint32_t predicted);
+int bpred_parse_kind(const char *name);
+const char *bpred_kind_name(int kind);
+void bpred_print(FILE *out);
+void bpred_print_json(FILE *out);
+
+#endif
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "ooo.h"
+#include "btrace.h"
+
+#define BT_BUFFER_SIZE  (1 << 16)
+#define BT_MAX_RECORD   (2 + 5 + BT_LATCHES * (5 + 4))
+
+int BTRACE_ON;
+
+static struct {
+	FILE *fp;
+	bt_cycle_t prev;
+	int started;
+	uint32_t used;
+	uint8_t buffer[BT_BUFFER_SIZE];
+} BT;
+
+static void bt_flush_buffer()
+{
+    if (BT.used > 0) {
+        fwrite(BT.buffer, 1, BT.used, BT.fp);
+        BT.used = 0;
+    }
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+/***************************************************************/
+/* Start recording to file                                                                                           */
+/***************************************************************/
+int btrace_open(const char *file)
+{
+    uint8_t header[16], *p = header;
+
+    if (PIPE_WIDTH > 1) {
+        printf("Error: the binary trace records a scalar pipeline, set the width to 1 first\n");
+        return -1;
+    }
+    if (OOO.enabled) {
+        printf("Error: the binary trace records the pipeline, turn the out-of-order core off first\n");
+        return -1;
+    }
+    btrace_close();
+    BT.fp = fopen(file, "wb");
+    if (BT.fp == NULL) {
+        printf("Error: Can't open binary trace file %s\n", file);
+        return -1;
+    }
+    memcpy(p, BT_MAGIC, 4);
+    p += 4;
+    *p++ = BT_VERSION;
+    p = put_varint(p, CYCLE_COUNT);
+    fwrite(header, 1, p - header, BT.fp);
+
+    memset(&BT.prev, 0, sizeof(BT.prev));
+    /* the first record is predicted against the cycle before the header cycle */
+    BT.prev.cycle = CYCLE_COUNT - 1;
+    BT.used = 0;
+    BTRACE_ON = TRUE;
+    return 0;
+}
+
+/***************************************************************/
+/* Append the latches at the end of the current cycle                                         */
+/***************************************************************/
+void btrace_record()
+{
+    const CPU_Pipeline_Reg *latch[BT_LATCHES] = { &IF_ID[0], &ID_EX[0], &EX_MEM[0], &MEM_WB[0] };
+    bt_cycle_t cur, pred;
+    uint8_t *p, *ctrl;
+    int i;
+
+    if (BT.used + BT_MAX_RECORD > BT_BUFFER_SIZE) {
+        bt_flush_buffer();
+    }
+    bt_predict(&BT.prev, &pred);
+
+    cur.cycle = CYCLE_COUNT;
+    cur.flags = 0;
+    if (PIPELINE_EVENTS & PIPE_STALL) {
+        cur.flags |= BT_STALL;
+    }
+    if (PIPELINE_EVENTS & PIPE_FLUSH) {
+        cur.flags |= BT_FLUSH;
+    }
+    if (cur.cycle != pred.cycle) {
+        cur.flags |= BT_GAP;
+    }
+
+    p = BT.buffer + BT.used;
+    ctrl = p++;
+    *ctrl = 0;
+    p++;
+    if (cur.flags & BT_GAP) {
+        p = put_varint(p, cur.cycle - pred.cycle);
+    }
+    for (i = 0; i < BT_LATCHES; i++) {
+        if (latch[i]->inst == NULL) {
+            cur.flags |= 1 << i;
+            cur.pc[i] = 0;
+            cur.ir[i] = 0;
+            continue;
+        }
+        /* latches carry the address of the following instruction */
+        cur.pc[i] = latch[i]->PC - 4;
+        cur.ir[i] = latch[i]->IR;
+        if (cur.pc[i] != pred.pc[i]) {
+            *ctrl |= 1 << i;
+            p = put_varint(p, bt_zigzag((int32_t)(cur.pc[i] - pred.pc[i])));
+        }
+    }
+    for (i = 0; i < BT_LATCHES; i++) {
+        if (!(cur.flags & (1 << i)) && cur.ir[i] != pred.ir[i]) {
+            *ctrl |= 1 << (4 + i);
+            p[0] = cur.ir[i] & 0xFF;
+            p[1] = (cur.ir[i] >> 8) & 0xFF;
+            p[2] = (cur.ir[i] >> 16) & 0xFF;
+            p[3] = (cur.ir[i] >> 24) & 0xFF;
+            p += 4;
+        }
+    }
+    ctrl[1] = cur.flags;
+    BT.used = p - BT.buffer;
+    BT.prev = cur;
+}
+
+/***************************************************************/
+/* Stop recording and write out what is buffered                                                */
+/***************************************************************/
+void btrace_close()
+{
+    if (BT.fp != NULL) {
+        bt_flush_buffer();
+        fclose(BT.fp);
+        BT.fp = NULL;
+    }
+    BTRACE_ON = FALSE;
+}
@@ -0,0 +1,75 @@
+#ifndef BTRACE_H
+#define BTRACE_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Binary pipeline trace format                                                                                                            */
+/******************************************************************************/
+/*
+ * header : "MUPT" , version byte , varint first cycle
+ * record : one per simulated cycle
+ *   ctrl   byte   bit i     : PC of latch i stored explicitly
+ *                 bit 4+i   : IR of latch i stored explicitly
+ *   flags  byte   bit i     : latch i holds a bubble
+ *                 BT_STALL, BT_FLUSH : pipeline events during the cycle
+ *                 BT_GAP    : a varint follows with the number of cycles skipped
+ *   per latch with its PC bit : zigzag varint of (PC - predicted PC)
+ *   per latch with its IR bit : IR, 4 bytes little endian
+ *
+ * Latches are numbered IF_ID, ID_EX, EX_MEM, MEM_WB, and only a pipeline of
+ * width 1 is traced. The PC recorded is the address of the instruction in the
+ * latch. Predictions follow the pipeline
+ * shifting by one stage: latch i is predicted to hold what latch i-1 held a
+ * cycle earlier, and IF_ID to hold the next sequential instruction, so a
+ * cycle without hazards costs two bytes plus the newly fetched IR.
+ * Bubble latches store nothing and read back as PC 0, IR 0.
+ */
+#define BT_MAGIC        "MUPT"
+#define BT_VERSION      1
+#define BT_LATCHES      4
+
+#define BT_STALL        0x10
+#define BT_FLUSH        0x20
+#define BT_GAP          0x40
+
+typedef struct {
+	uint32_t pc[BT_LATCHES];
+	uint32_t ir[BT_LATCHES];
+	uint8_t flags;
+	uint32_t cycle;
+} bt_cycle_t;
+
+/* what the next record is predicted to hold, shared by the recorder and the decoder */
+static inline void bt_predict(const bt_cycle_t *prev, bt_cycle_t *pred)
+{
+	int i;
+	pred->pc[0] = prev->pc[0] + 4;
+	pred->ir[0] = prev->ir[0];
+	for (i = 1; i < BT_LATCHES; i++) {
+		pred->pc[i] = prev->pc[i-1];
+		pred->ir[i] = prev->ir[i-1];
+	}
+	pred->cycle = prev->cycle + 1;
+}
+
+static inline uint32_t bt_zigzag(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t bt_unzigzag(uint32_t v)
+{
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/***************************************************************/
+/* Recorder, Function Declerations.                                                                          */
+/***************************************************************/
+extern int BTRACE_ON;
+
+int btrace_open(const char *file);
+void btrace_record();
+void btrace_close();
+
+#endif
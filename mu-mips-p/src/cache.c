@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "cache.h"
+#include "reverse.h"
+
+SIM_LOCAL cache_sys_t CACHES;
+
+static const char *LEVEL_NAMES[CACHE_LEVELS] = { "l1i", "l1d", "l2" };
+
+static int is_pow2(uint32_t v)
+{
+    return v != 0 && (v & (v - 1)) == 0;
+}
+
+static int log2_of(uint32_t v)
+{
+    int bits = 0;
+    while ((1u << bits) < v) {
+        bits++;
+    }
+    return bits;
+}
+
+/***************************************************************/
+/* Set the geometry and policies of one level, size 0 removes it                        */
+/***************************************************************/
+int cache_configure(int level, uint32_t size, uint32_t line, uint32_t ways, cache_replace_t replace, int write_back)
+{
+    cache_t *c = &CACHES.level[level];
+    cache_line_t *lines = NULL;
+
+    if (size != 0) {
+        if (!is_pow2(size) || !is_pow2(line) || line < 4 || ways == 0 || size < line * ways ||
+            (size / line) % ways != 0 || !is_pow2(size / line / ways)) {
+            printf("Error: %s needs power of two size and line, and size >= line * ways\n", LEVEL_NAMES[level]);
+            return -1;
+        }
+        lines = calloc(size / line, sizeof(cache_line_t));
+        if (lines == NULL) {
+            printf("Error: out of memory allocating %s\n", LEVEL_NAMES[level]);
+            return -1;
+        }
+    }
+    free(c->lines);
+    c->lines = lines;
+    c->size = size;
+    c->line = line;
+    c->ways = ways;
+    c->sets = size ? size / line / ways : 0;
+    c->line_bits = log2_of(line);
+    c->replace = replace;
+    c->write_back = write_back;
+    c->stamp = 0;
+    return 0;
+}
+
+void cache_set_latency(uint32_t l2, uint32_t mem)
+{
+    CACHES.level[CACHE_L2].latency = l2;
+    CACHES.mem_latency = mem;
+}
+
+/***************************************************************/
+/* Default hierarchy, built at startup but left disabled                                          */
+/***************************************************************/
+void cache_init()
+{
+    cache_configure(CACHE_L1I, 16 * 1024, 32, 2, CACHE_LRU, TRUE);
+    cache_configure(CACHE_L1D, 16 * 1024, 32, 4, CACHE_LRU, TRUE);
+    cache_configure(CACHE_L2, 256 * 1024, 64, 8, CACHE_LRU, TRUE);
+    cache_set_latency(CACHE_DEFAULT_L2_LATENCY, CACHE_DEFAULT_MEM_LATENCY);
+    CACHES.random = 0x2545F491;
+}
+
+/***************************************************************/
+/* Free the tag arrays                                                                                               */
+/***************************************************************/
+void cache_release()
+{
+    int i;
+
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        free(CACHES.level[i].lines);
+    }
+    memset(&CACHES, 0, sizeof(CACHES));
+}
+
+/***************************************************************/
+/* Invalidate every line and drop misses in flight                                                    */
+/***************************************************************/
+void cache_reset()
+{
+    int i;
+
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        if (CACHES.level[i].lines != NULL) {
+            memset(CACHES.level[i].lines, 0, (CACHES.level[i].size / CACHES.level[i].line) * sizeof(cache_line_t));
+        }
+    }
+    memset(&CACHES.fetch, 0, sizeof(CACHES.fetch));
+    memset(&CACHES.data, 0, sizeof(CACHES.data));
+}
+
+void cache_reset_stats()
+{
+    int i;
+
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        memset(&CACHES.level[i].stats, 0, sizeof(cache_counters_t));
+    }
+    CACHES.mem_reads = 0;
+    CACHES.mem_writes = 0;
+}
+
+static uint32_t next_random()
+{
+    uint32_t x = CACHES.random;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    CACHES.random = x;
+    return x;
+}
+
+/* L1I and L1D both refill from L2 when it exists */
+static cache_t *below(const cache_t *c)
+{
+    cache_t *l2 = &CACHES.level[CACHE_L2];
+    return (c != l2 && l2->size != 0) ? l2 : NULL;
+}
+
+static uint32_t access(cache_t *c, uint32_t addr, int write);
+
+/* cycles for the level under c to supply a line */
+static uint32_t refill(cache_t *c, uint32_t addr)
+{
+    cache_t *next = below(c);
+
+    if (next == NULL) {
+        CACHES.mem_reads++;
+        return CACHES.mem_latency;
+    }
+    return next->latency + access(next, addr, FALSE);
+}
+
+/* writes leaving a level go through a write buffer and never stall the pipeline */
+static void write_below(cache_t *c, uint32_t addr)
+{
+    cache_t *next = below(c);
+
+    c->stats.writebacks++;
+    if (next == NULL) {
+        CACHES.mem_writes++;
+    } else {
+        access(next, addr, TRUE);
+    }
+}
+
+/***************************************************************/
+/* Look up addr in c, returns the extra cycles a miss costs                                   */
+/***************************************************************/
+static uint32_t access(cache_t *c, uint32_t addr, int write)
+{
+    uint32_t block = addr >> c->line_bits;
+    cache_line_t *set = &c->lines[(block & (c->sets - 1)) * c->ways];
+    cache_line_t *victim = NULL;
+    uint32_t i, cycles;
+
+    if (write) {
+        c->stats.writes++;
+    } else {
+        c->stats.reads++;
+    }
+    c->stamp++;
+    for (i = 0; i < c->ways; i++) {
+        if (set[i].valid && set[i].block == block) {
+            if (REVERSE.logging) {
+                reverse_undo_bytes(&set[i], sizeof(set[i]));
+            }
+            set[i].used = c->stamp;
+            if (write) {
+                if (c->write_back) {
+                    set[i].dirty = TRUE;
+                } else {
+                    write_below(c, addr);
+                }
+            }
+            return 0;
+        }
+    }
+
+    if (write) {
+        c->stats.write_misses++;
+        if (!c->write_back) {
+            /* no write allocate */
+            write_below(c, addr);
+            return 0;
+        }
+    } else {
+        c->stats.read_misses++;
+    }
+
+    for (i = 0; i < c->ways && victim == NULL; i++) {
+        if (!set[i].valid) {
+            victim = &set[i];
+        }
+    }
+    if (victim == NULL) {
+        if (c->replace == CACHE_RANDOM) {
+            victim = &set[next_random() % c->ways];
+        } else {
+            victim = &set[0];
+            for (i = 1; i < c->ways; i++) {
+                if (set[i].used < victim->used) {
+                    victim = &set[i];
+                }
+            }
+        }
+        if (victim->dirty) {
+            write_below(c, victim->block << c->line_bits);
+        }
+    }
+    cycles = refill(c, addr);
+    if (REVERSE.logging) {
+        reverse_undo_bytes(victim, sizeof(*victim));
+    }
+    victim->block = block;
+    victim->valid = TRUE;
+    victim->dirty = write;
+    victim->used = c->stamp;
+    return cycles;
+}
+
+/* TRUE when the access on port can complete this cycle, starting a miss if needed */
+static int port_ready(cache_port_t *port, cache_t *c, uint32_t addr, int write)
+{
+    uint32_t cycles;
+
+    if (port->busy && port->addr == addr) {
+        if (--port->remaining > 0) {
+            return FALSE;
+        }
+        port->busy = FALSE;
+        return TRUE;
+    }
+    port->busy = FALSE;
+    cycles = access(c, addr, write);
+    if (cycles == 0) {
+        return TRUE;
+    }
+    port->busy = TRUE;
+    port->addr = addr;
+    port->remaining = cycles;
+    return FALSE;
+}
+
+/***************************************************************/
+/* Can IF fetch pc this cycle                                                                                  */
+/***************************************************************/
+int cache_fetch_ready(uint32_t pc)
+{
+    if (!CACHES.enabled || CACHES.level[CACHE_L1I].size == 0) {
+        return TRUE;
+    }
+    return port_ready(&CACHES.fetch, &CACHES.level[CACHE_L1I], pc, FALSE);
+}
+
+/* IF reads one instruction cache line a cycle, the bundle it fetches ends with it */
+int cache_same_fetch_line(uint32_t a, uint32_t b)
+{
+    int bits;
+
+    if (!CACHES.enabled || CACHES.level[CACHE_L1I].size == 0) {
+        return TRUE;
+    }
+    bits = CACHES.level[CACHE_L1I].line_bits;
+    return (a >> bits) == (b >> bits);
+}
+
+/***************************************************************/
+/* Can MEM complete its load or store this cycle                                                 */
+/***************************************************************/
+int cache_data_ready(uint32_t addr, int write)
+{
+    if (!CACHES.enabled || CACHES.level[CACHE_L1D].size == 0) {
+        return TRUE;
+    }
+    return port_ready(&CACHES.data, &CACHES.level[CACHE_L1D], addr, write);
+}
+
+/* a redirect abandons the wrong-path fetch, the line it brought in stays */
+void cache_cancel_fetch()
+{
+    CACHES.fetch.busy = FALSE;
+}
+
+int cache_parse_level(const char *name)
+{
+    int i;
+
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        if (strcmp(name, LEVEL_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static double miss_rate(const cache_counters_t *s)
+{
+    uint64_t accesses = s->reads + s->writes;
+    return accesses ? (double)(s->read_misses + s->write_misses) / accesses : 0.0;
+}
+
+/***************************************************************/
+/* Print the configuration and counters of each level                                              */
+/***************************************************************/
+void cache_print(FILE *out)
+{
+    const cache_t *c;
+    int i;
+
+    fprintf(out, "Caches\t\t\t: %s (L2 %u cycles, memory %u cycles)\n", CACHES.enabled ? "on" : "off",
+            CACHES.level[CACHE_L2].latency, CACHES.mem_latency);
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        c = &CACHES.level[i];
+        if (c->size == 0) {
+            fprintf(out, "  %-4s: none\n", LEVEL_NAMES[i]);
+            continue;
+        }
+        fprintf(out, "  %-4s: %uB, %uB lines, %u-way, %s, %s\n", LEVEL_NAMES[i], c->size, c->line, c->ways,
+                c->replace == CACHE_LRU ? "lru" : "random", c->write_back ? "write-back" : "write-through");
+        fprintf(out, "        %llu reads (%llu misses), %llu writes (%llu misses), %llu written below, %.2f%% miss rate\n",
+                (unsigned long long)c->stats.reads, (unsigned long long)c->stats.read_misses,
+                (unsigned long long)c->stats.writes, (unsigned long long)c->stats.write_misses,
+                (unsigned long long)c->stats.writebacks, 100.0 * miss_rate(&c->stats));
+    }
+    fprintf(out, "  memory: %llu line reads, %llu writes\n",
+            (unsigned long long)CACHES.mem_reads, (unsigned long long)CACHES.mem_writes);
+}
+
+void cache_print_json(FILE *out)
+{
+    const cache_t *c;
+    int i;
+
+    fprintf(out, "{ \"enabled\": %s", CACHES.enabled ? "true" : "false");
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        c = &CACHES.level[i];
+        if (c->size == 0) {
+            continue;
+        }
+        fprintf(out, ", \"%s\": { \"size\": %u, \"line\": %u, \"ways\": %u, \"reads\": %llu, \"read_misses\": %llu, "
+                "\"writes\": %llu, \"write_misses\": %llu, \"writebacks\": %llu }",
+                LEVEL_NAMES[i], c->size, c->line, c->ways,
+                (unsigned long long)c->stats.reads, (unsigned long long)c->stats.read_misses,
+                (unsigned long long)c->stats.writes, (unsigned long long)c->stats.write_misses,
+                (unsigned long long)c->stats.writebacks);
+    }
+    fprintf(out, ", \"memory\": { \"reads\": %llu, \"writes\": %llu } }",
+            (unsigned long long)CACHES.mem_reads, (unsigned long long)CACHES.mem_writes);
+}
@@ -0,0 +1,91 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/***************************************************************/
+/* Cache hierarchy timing model                                                                             */
+/***************************************************************/
+/* The caches only track tags, data always comes from memory.c. A miss makes the
+ * requesting stage wait for the cycles the lower levels take to supply the line. */
+typedef enum {
+	CACHE_L1I = 0,
+	CACHE_L1D,
+	CACHE_L2,
+	CACHE_LEVELS
+} cache_level_t;
+
+typedef enum {
+	CACHE_LRU = 0,
+	CACHE_RANDOM
+} cache_replace_t;
+
+#define CACHE_DEFAULT_L2_LATENCY   10
+#define CACHE_DEFAULT_MEM_LATENCY  100
+
+typedef struct {
+	uint32_t block;         /* address >> line bits */
+	uint8_t valid;
+	uint8_t dirty;
+	uint64_t used;          /* access stamp for LRU */
+} cache_line_t;
+
+typedef struct {
+	uint64_t reads, writes;
+	uint64_t read_misses, write_misses;
+	uint64_t writebacks;    /* dirty lines evicted, or writes passed through */
+} cache_counters_t;
+
+typedef struct {
+	uint32_t size;          /* bytes, 0 when the level is absent */
+	uint32_t line;          /* bytes */
+	uint32_t ways;
+	uint32_t sets;
+	int line_bits;
+	cache_replace_t replace;
+	int write_back;         /* write-back with allocate, else write-through without */
+	uint32_t latency;       /* cycles to supply a line to the level above */
+	cache_line_t *lines;    /* sets * ways */
+	uint64_t stamp;
+	cache_counters_t stats;
+} cache_t;
+
+/* a miss in progress on one pipeline port */
+typedef struct {
+	int busy;
+	uint32_t addr;
+	uint32_t remaining;     /* cycles left before the stage may proceed */
+} cache_port_t;
+
+typedef struct {
+	int enabled;
+	cache_t level[CACHE_LEVELS];
+	uint32_t mem_latency;
+	uint64_t mem_reads, mem_writes;
+	cache_port_t fetch, data;
+	uint32_t random;        /* xorshift state for random replacement */
+} cache_sys_t;
+
+extern SIM_LOCAL cache_sys_t CACHES;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void cache_init();
+void cache_release();
+int cache_configure(int level, uint32_t size, uint32_t line, uint32_t ways, cache_replace_t replace, int write_back);
+void cache_set_latency(uint32_t l2, uint32_t mem);
+void cache_reset();
+void cache_reset_stats();
+int cache_fetch_ready(uint32_t pc);
+int cache_same_fetch_line(uint32_t a, uint32_t b);
+int cache_data_ready(uint32_t addr, int write);
+void cache_cancel_fetch();
+int cache_parse_level(const char *name);
+void cache_print(FILE *out);
+void cache_print_json(FILE *out);
+
+#endif
@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "stats.h"
+#include "threaded.h"
+#include "dbt.h"
+
+static SIM_LOCAL dbt_t DBT;
+
+/***************************************************************/
+/* Write hook: a store into text makes every translation suspect                  */
+/***************************************************************/
+static void dbt_invalidate(uint32_t address, uint32_t size)
+{
+    if (DBT.num_blocks != 0 && address <= MEM_TEXT_END && address + size > MEM_TEXT_BEGIN) {
+        DBT.ctx.flush = TRUE;
+    }
+}
+
+/***************************************************************/
+/* Drop every block and all host code after the trampoline                          */
+/***************************************************************/
+void dbt_flush()
+{
+    if (!DBT.available) {
+        return;
+    }
+    memset(DBT.hash, 0, sizeof(DBT.hash));
+    DBT.num_blocks = 0;
+    DBT.num_exits = 0;
+    DBT.used = DBT.epilogue - DBT.code + 16;
+    DBT.ctx.flush = FALSE;
+    DBT.flushes++;
+}
+
+static dbt_block_t *block_find(uint32_t pc)
+{
+    dbt_block_t *b;
+
+    for (b = DBT.hash[(pc >> 2) & ((1 << DBT_HASH_BITS) - 1)]; b != NULL; b = b->next) {
+        if (b->pc == pc) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* the block starting at pc, profiled from now on */
+static dbt_block_t *block_get(uint32_t pc)
+{
+    dbt_block_t *b = block_find(pc), **head;
+    const decoded_inst_t *d;
+
+    if (b != NULL) {
+        return b;
+    }
+    if (DBT.num_blocks == DBT_MAX_BLOCKS) {
+        dbt_flush();
+    }
+    b = &DBT.blocks[DBT.num_blocks++];
+    memset(b, 0, sizeof(*b));
+    b->pc = pc;
+    do {
+        d = decode_fetch(pc + 4 * b->len);
+        b->len++;
+    } while (!(d->flags & (INST_CTRL | INST_HALT)) && b->len < DBT_MAX_INSTS);
+    /* the cache only hears about writes to text */
+    b->untranslatable = pc < MEM_TEXT_BEGIN || pc + 4 * b->len - 1 > MEM_TEXT_END || (pc & 3);
+    head = &DBT.hash[(pc >> 2) & ((1 << DBT_HASH_BITS) - 1)];
+    b->next = *head;
+    *head = b;
+    return b;
+}
+
+#if defined(__x86_64__)
+
+/***************************************************************/
+/* x86-64 emitter                                                                                                      */
+/***************************************************************/
+#define OFF_REG(r)      ((uint32_t)(offsetof(CPU_State, REGS) + 4 * (r)))
+#define OFF_HI          ((uint32_t)offsetof(CPU_State, HI))
+#define OFF_LO          ((uint32_t)offsetof(CPU_State, LO))
+#define OFF_BUDGET      ((uint32_t)offsetof(dbt_ctx_t, budget))
+#define OFF_EXIT        ((uint32_t)offsetof(dbt_ctx_t, last_exit))
+#define OFF_FLUSH       ((uint32_t)offsetof(dbt_ctx_t, flush))
+
+#define EAX 0
+#define ECX 1
+#define EDX 2
+#define ESI 6
+#define EDI 7
+
+#define STUB_SIZE 15
+
+static SIM_LOCAL uint8_t *P;
+
+static void b1(uint8_t v)
+{
+    *P++ = v;
+}
+
+static void b4(uint32_t v)
+{
+    memcpy(P, &v, 4);
+    P += 4;
+}
+
+/* mov reg, [rbx + disp] */
+static void load_state(int reg, uint32_t disp)
+{
+    b1(0x8B); b1(0x80 | (reg << 3) | 3); b4(disp);
+}
+
+/* mov [rbx + disp], reg */
+static void store_state(uint32_t disp, int reg)
+{
+    b1(0x89); b1(0x80 | (reg << 3) | 3); b4(disp);
+}
+
+/* mov dword [rbx + disp], imm */
+static void store_state_imm(uint32_t disp, uint32_t imm)
+{
+    b1(0xC7); b1(0x83); b4(disp); b4(imm);
+}
+
+/* op qword [r12 + disp], imm with /ext selecting add, sub or cmp */
+static void ctx_budget(int ext, uint32_t imm)
+{
+    b1(0x49); b1(0x81); b1(0x80 | (ext << 3) | 4); b1(0x24); b4(OFF_BUDGET); b4(imm);
+}
+
+static void jmp_to(const uint8_t *target)
+{
+    b1(0xE9); b4((uint32_t)(target - (P + 4)));
+}
+
+static void call_abs(const void *fn)
+{
+    b1(0x48); b1(0xB8);
+    memcpy(P, &fn, 8);
+    P += 8;
+    b1(0xFF); b1(0xD0);
+}
+
+/* leave for dbt_run() at pc, through a patchable stub when the target is fixed */
+static void exit_to(uint32_t pc, int patchable)
+{
+    int32_t id = -1;
+
+    if (patchable && DBT.num_exits < DBT_MAX_EXITS) {
+        id = DBT.num_exits++;
+        DBT.exits[id].stub = P;
+        DBT.exits[id].target = pc;
+    }
+    b1(0xB8); b4(pc);
+    b1(0xBA); b4((uint32_t)id);
+    jmp_to(DBT.epilogue);
+}
+
+/* rs + imm into edi, the first argument of the memory functions */
+static void address_arg(const decoded_inst_t *d)
+{
+    load_state(EDI, OFF_REG(d->rs));
+    b1(0x81); b1(0xC7); b4(d->imm);
+}
+
+/* setcc al ; movzx eax, al */
+static void set_flag(uint8_t cc)
+{
+    b1(0x0F); b1(cc); b1(0xC0);
+    b1(0x0F); b1(0xB6); b1(0xC0);
+}
+
+/***************************************************************/
+/* Host code for one non-control instruction, FALSE if there is none            */
+/***************************************************************/
+/* left is the number of block instructions after this one, handed back to the
+ * budget when a store into text forces an early exit */
+static int emit_inst(const decoded_inst_t *d, uint32_t pc, uint32_t left)
+{
+    static const uint8_t alu_rr[OP_COUNT] = {
+        [OP_ADD] = 0x01, [OP_ADDU] = 0x01, [OP_SUB] = 0x29, [OP_SUBU] = 0x29,
+        [OP_AND] = 0x21, [OP_OR] = 0x09, [OP_XOR] = 0x31, [OP_NOR] = 0x09,
+    };
+    static const uint8_t alu_ri[OP_COUNT] = {
+        [OP_ADDI] = 0x05, [OP_ADDIU] = 0x05, [OP_ANDI] = 0x25, [OP_ORI] = 0x0D, [OP_XORI] = 0x35,
+    };
+
+    if ((d->flags & INST_WRITES_REG) && d->dest == 0) {
+        return TRUE;
+    }
+    switch (d->op) {
+        case OP_SLL: case OP_SRL: case OP_SRA:
+            load_state(EAX, OFF_REG(d->rt));
+            b1(0xC1); b1(d->op == OP_SLL ? 0xE0 : d->op == OP_SRL ? 0xE8 : 0xF8); b1(d->shamt);
+            store_state(OFF_REG(d->dest), EAX);
+            return TRUE;
+        case OP_ADD: case OP_ADDU: case OP_SUB: case OP_SUBU:
+        case OP_AND: case OP_OR: case OP_XOR: case OP_NOR:
+            load_state(EAX, OFF_REG(d->rs));
+            load_state(ECX, OFF_REG(d->rt));
+            b1(alu_rr[d->op]); b1(0xC8);
+            if (d->op == OP_NOR) {
+                b1(0xF7); b1(0xD0);
+            }
+            store_state(OFF_REG(d->dest), EAX);
+            return TRUE;
+        case OP_SLT:
+            load_state(EAX, OFF_REG(d->rs));
+            load_state(ECX, OFF_REG(d->rt));
+            b1(0x39); b1(0xC8);
+            set_flag(0x9C);
+            store_state(OFF_REG(d->dest), EAX);
+            return TRUE;
+        case OP_ADDI: case OP_ADDIU: case OP_ANDI: case OP_ORI: case OP_XORI:
+            load_state(EAX, OFF_REG(d->rs));
+            b1(alu_ri[d->op]); b4(d->imm);
+            store_state(OFF_REG(d->dest), EAX);
+            return TRUE;
+        case OP_SLTI:
+            load_state(EAX, OFF_REG(d->rs));
+            b1(0x3D); b4(d->imm);
+            set_flag(0x9C);
+            store_state(OFF_REG(d->dest), EAX);
+            return TRUE;
+        case OP_LUI:
+            store_state_imm(OFF_REG(d->dest), d->imm << 16);
+            return TRUE;
+        case OP_MFHI: case OP_MFLO:
+            load_state(EAX, d->op == OP_MFHI ? OFF_HI : OFF_LO);
+            store_state(OFF_REG(d->dest), EAX);
+            return TRUE;
+        case OP_MTHI: case OP_MTLO:
+            load_state(EAX, OFF_REG(d->rs));
+            store_state(d->op == OP_MTHI ? OFF_HI : OFF_LO, EAX);
+            return TRUE;
+        case OP_MULT: case OP_MULTU:
+            load_state(EAX, OFF_REG(d->rs));
+            load_state(ECX, OFF_REG(d->rt));
+            b1(0xF7); b1(d->op == OP_MULT ? 0xE9 : 0xE1);
+            store_state(OFF_LO, EAX);
+            store_state(OFF_HI, EDX);
+            return TRUE;
+        case OP_LB: case OP_LH: case OP_LW:
+            address_arg(d);
+            call_abs(d->op == OP_LB ? (void *)mem_read_8 : d->op == OP_LH ? (void *)mem_read_16 : (void *)mem_read_32);
+            if (d->op != OP_LW) {
+                b1(0x0F); b1(d->op == OP_LB ? 0xBE : 0xBF); b1(0xC0);
+            }
+            store_state(OFF_REG(d->dest), EAX);
+            return TRUE;
+        case OP_SB: case OP_SH: case OP_SW:
+            address_arg(d);
+            load_state(ESI, OFF_REG(d->rt));
+            call_abs(d->op == OP_SB ? (void *)mem_write_8 : d->op == OP_SH ? (void *)mem_write_16 : (void *)mem_write_32);
+            /* cmp byte [r12 + flush], 0 ; je over the exit */
+            b1(0x41); b1(0x80); b1(0xBC); b1(0x24); b4(OFF_FLUSH); b1(0x00);
+            b1(0x74); b1(12 + STUB_SIZE);
+            ctx_budget(0, left);
+            exit_to(pc + 4, FALSE);
+            return TRUE;
+        default:
+            /* syscall, div and anything new stay in the threaded engine */
+            return FALSE;
+    }
+}
+
+/***************************************************************/
+/* Host code ending a block at the control instruction d                                     */
+/***************************************************************/
+static void emit_control(const decoded_inst_t *d, uint32_t pc)
+{
+    uint32_t target = pc + 4 + d->imm;
+    uint8_t skip;
+
+    switch (d->op) {
+        case OP_BEQ: case OP_BNE:
+            load_state(EAX, OFF_REG(d->rs));
+            b1(0x3B); b1(0x83); b4(OFF_REG(d->rt));
+            skip = d->op == OP_BEQ ? 0x85 : 0x84;
+            break;
+        case OP_BLEZ: case OP_BGTZ: case OP_BLTZ: case OP_BGEZ:
+            /* cmp dword [rbx + rs], 0 */
+            b1(0x83); b1(0xBB); b4(OFF_REG(d->rs)); b1(0x00);
+            skip = d->op == OP_BLEZ ? 0x8F : d->op == OP_BGTZ ? 0x8E : d->op == OP_BLTZ ? 0x8D : 0x8C;
+            break;
+        case OP_J: case OP_JAL:
+            if (d->op == OP_JAL) {
+                store_state_imm(OFF_REG(31), pc + 4);
+            }
+            exit_to(((pc + 4) & 0xF0000000) | d->imm, TRUE);
+            return;
+        default:
+            /* jr, jalr: read the target before the link is written */
+            load_state(EAX, OFF_REG(d->rs));
+            if (d->op == OP_JALR && d->dest != 0) {
+                store_state_imm(OFF_REG(d->dest), pc + 4);
+            }
+            b1(0xBA); b4((uint32_t)-1);
+            jmp_to(DBT.epilogue);
+            return;
+    }
+    /* jcc over the taken exit */
+    b1(0x0F); b1(skip); b4(STUB_SIZE);
+    exit_to(target, TRUE);
+    exit_to(pc + 4, TRUE);
+}
+
+/***************************************************************/
+/* Translate block b, leaves b->code NULL if nothing could be translated     */
+/***************************************************************/
+/* returns b, or its replacement if the code cache had to be flushed first */
+static dbt_block_t *translate(dbt_block_t *b)
+{
+    const decoded_inst_t *d = NULL;
+    uint8_t *start, *cmp_len, *sub_len, *budget_jump;
+    uint32_t i, pc, exits = DBT.num_exits;
+
+    if (DBT_CACHE_SIZE - DBT.used < DBT_MAX_BLOCK_CODE) {
+        pc = b->pc;
+        dbt_flush();
+        b = block_get(pc);
+        exits = 0;
+    }
+    start = P = DBT.code + DBT.used;
+    /* cmp qword [r12 + budget], len ; jl budget exit ; sub qword [r12 + budget], len */
+    ctx_budget(7, 0);
+    cmp_len = P - 4;
+    b1(0x0F); b1(0x8C); budget_jump = P; b4(0);
+    ctx_budget(5, 0);
+    sub_len = P - 4;
+
+    for (i = 0; i < b->len; i++) {
+        pc = b->pc + 4 * i;
+        d = decode_fetch(pc);
+        if (d->flags & INST_CTRL) {
+            emit_control(d, pc);
+            i++;
+            break;
+        }
+        if (!emit_inst(d, pc, b->len - i - 1)) {
+            exit_to(pc, TRUE);
+            break;
+        }
+    }
+    if (i == 0) {
+        /* starts with an instruction the threaded engine has to run */
+        DBT.num_exits = exits;
+        b->untranslatable = TRUE;
+        return b;
+    }
+    if (i == b->len && !(d->flags & INST_CTRL)) {
+        /* cut at DBT_MAX_INSTS */
+        exit_to(b->pc + 4 * i, TRUE);
+    }
+    b->native_len = i;
+
+    /* fill in the block length now that it is known */
+    memcpy(cmp_len, &b->native_len, 4);
+    memcpy(sub_len, &b->native_len, 4);
+    i = P - (budget_jump + 4);
+    memcpy(budget_jump, &i, 4);
+    exit_to(b->pc, FALSE);
+
+    b->code = start;
+    DBT.used = P - DBT.code;
+    DBT.translated++;
+    return b;
+}
+
+/* shared entry and exit: rdi = &CURRENT_STATE, rsi = &ctx, rdx = block code */
+static void emit_trampoline()
+{
+    P = DBT.code;
+    DBT.trampoline = P;
+    b1(0x53);                                   /* push rbx */
+    b1(0x41); b1(0x54);                         /* push r12 */
+    b1(0x48); b1(0x83); b1(0xEC); b1(0x08);     /* sub rsp, 8 */
+    b1(0x48); b1(0x89); b1(0xFB);               /* mov rbx, rdi */
+    b1(0x49); b1(0x89); b1(0xF4);               /* mov r12, rsi */
+    b1(0xFF); b1(0xE2);                         /* jmp rdx */
+    DBT.epilogue = P;
+    b1(0x41); b1(0x89); b1(0x94); b1(0x24); b4(OFF_EXIT);   /* mov [r12 + exit], edx */
+    b1(0x48); b1(0x83); b1(0xC4); b1(0x08);     /* add rsp, 8 */
+    b1(0x41); b1(0x5C);                         /* pop r12 */
+    b1(0x5B);                                   /* pop rbx */
+    b1(0xC3);                                   /* ret */
+}
+
+/* point the stub of exit id straight at the translated block for its target */
+static void chain(int32_t id)
+{
+    dbt_block_t *target = block_find(DBT.exits[id].target);
+    uint8_t *stub = DBT.exits[id].stub;
+
+    if (target == NULL || target->code == NULL || stub[0] == 0xE9) {
+        return;
+    }
+    P = stub;
+    jmp_to(target->code);
+    DBT.chained++;
+}
+
+typedef uint32_t (*dbt_entry_t)(CPU_State *state, dbt_ctx_t *ctx, const uint8_t *code);
+
+#endif
+
+/***************************************************************/
+/* Map the code cache, without it dbt_run() uses the threaded engine only   */
+/***************************************************************/
+void dbt_init()
+{
+#if defined(__x86_64__)
+    void *code = mmap(NULL, DBT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    DBT.blocks = calloc(DBT_MAX_BLOCKS, sizeof(dbt_block_t));
+    DBT.exits = calloc(DBT_MAX_EXITS, sizeof(dbt_exit_t));
+    if (code == MAP_FAILED || DBT.blocks == NULL || DBT.exits == NULL) {
+        return;
+    }
+    DBT.code = code;
+    DBT.available = TRUE;
+    emit_trampoline();
+    dbt_flush();
+    DBT.flushes = 0;
+    mem_add_write_hook(dbt_invalidate);
+#endif
+}
+
+/***************************************************************/
+/* Unmap the code cache                                                                                           */
+/***************************************************************/
+void dbt_release()
+{
+    if (DBT.code != NULL) {
+        munmap(DBT.code, DBT_CACHE_SIZE);
+    }
+    free(DBT.blocks);
+    free(DBT.exits);
+    memset(&DBT, 0, sizeof(DBT));
+}
+
+/***************************************************************/
+/* Execute up to count instructions, returns how many completed                      */
+/***************************************************************/
+uint64_t dbt_run(uint64_t count)
+{
+#if defined(__x86_64__)
+    dbt_block_t *b;
+    uint64_t done = 0, n;
+    uint32_t pc;
+
+    if (!DBT.available) {
+        return tc_run(count);
+    }
+    while (done < count && RUN_FLAG) {
+        if (DBT.ctx.flush) {
+            dbt_flush();
+        }
+        pc = CURRENT_STATE.PC;
+        b = block_get(pc);
+        if (b->code == NULL && !b->untranslatable && ++b->runs >= DBT_HOT) {
+            b = translate(b);
+        }
+        if (b->code != NULL && count - done >= b->native_len) {
+            DBT.ctx.budget = count - done;
+            DBT.ctx.last_exit = -1;
+            CURRENT_STATE.PC = ((dbt_entry_t)DBT.trampoline)(&CURRENT_STATE, &DBT.ctx, b->code);
+            n = (count - done) - DBT.ctx.budget;
+            done += n;
+            DBT.native += n;
+            INSTRUCTION_COUNT += n;
+            STATS.fastforwarded += n;
+            if (DBT.ctx.last_exit >= 0 && !DBT.ctx.flush) {
+                chain(DBT.ctx.last_exit);
+            }
+            continue;
+        }
+        n = b->len < count - done ? b->len : count - done;
+        done += tc_run(n);
+    }
+    NEXT_STATE = CURRENT_STATE;
+    return done;
+#else
+    return tc_run(count);
+#endif
+}
+
+/***************************************************************/
+/* Print what the translator did                                                                             */
+/***************************************************************/
+void dbt_print(FILE *out)
+{
+    if (DBT.translated == 0) {
+        return;
+    }
+    fprintf(out, "Translated blocks\t: %llu (%llu chained exits, %llu cache flushes)\n",
+            (unsigned long long)DBT.translated, (unsigned long long)DBT.chained, (unsigned long long)DBT.flushes);
+    fprintf(out, "Native instructions\t: %llu\n", (unsigned long long)DBT.native);
+}
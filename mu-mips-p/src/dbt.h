@@ -0,0 +1,70 @@
+#ifndef DBT_H
+#define DBT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/***************************************************************/
+/* Dynamic binary translation of hot blocks to x86-64                                        */
+/***************************************************************/
+/* Basic blocks are profiled while the threaded engine runs them. Once a block
+ * has run DBT_HOT times it is translated into host code that works on
+ * CURRENT_STATE through a pinned pointer (rbx). Exits to known targets are
+ * patched into direct jumps once the target is translated too. Any write to a
+ * text page flushes the whole code cache. Instructions without a translation
+ * (syscall, div) end the block and run in the threaded engine. */
+#define DBT_HOT             16
+#define DBT_MAX_INSTS       64          /* per block */
+#define DBT_CACHE_SIZE      (16 << 20)  /* bytes of host code */
+#define DBT_MAX_BLOCK_CODE  (DBT_MAX_INSTS * 64 + 128)
+#define DBT_HASH_BITS       12
+#define DBT_MAX_BLOCKS      65536
+#define DBT_MAX_EXITS       (2 * DBT_MAX_BLOCKS)
+
+typedef struct dbt_block_struct {
+	uint32_t pc;
+	uint32_t len;           /* instructions up to and including the first control transfer */
+	uint32_t native_len;    /* instructions covered by the host code */
+	uint32_t runs;
+	int untranslatable;
+	uint8_t *code;          /* NULL until translated */
+	struct dbt_block_struct *next;
+} dbt_block_t;
+
+/* a direct exit whose jump can be patched to go straight to its target */
+typedef struct {
+	uint8_t *stub;
+	uint32_t target;
+} dbt_exit_t;
+
+/* state the host code reaches through r12 */
+typedef struct {
+	int64_t budget;         /* instructions left before returning to dbt_run() */
+	int32_t last_exit;      /* dbt_exit_t index of the exit taken, -1 if not patchable */
+	uint8_t flush;          /* a text page was written, leave at the next check */
+} dbt_ctx_t;
+
+typedef struct {
+	int available;          /* host is x86-64 and the code cache could be mapped */
+	uint8_t *code;
+	uint32_t used;
+	uint8_t *trampoline, *epilogue;
+	dbt_block_t *hash[1 << DBT_HASH_BITS];
+	dbt_block_t *blocks;
+	uint32_t num_blocks;
+	dbt_exit_t *exits;
+	uint32_t num_exits;
+	dbt_ctx_t ctx;
+	uint64_t translated, chained, flushes, native;
+} dbt_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void dbt_init();
+void dbt_flush();
+void dbt_release();
+uint64_t dbt_run(uint64_t count);
+void dbt_print(FILE *out);
+
+#endif
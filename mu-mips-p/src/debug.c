@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "disasm.h"
+#include "debug.h"
+
+SIM_LOCAL debug_state_t DEBUG;
+
+static uint32_t access_size(const decoded_inst_t *d)
+{
+    switch (d->op) {
+        case OP_LB:
+        case OP_SB:
+            return 1;
+        case OP_LH:
+        case OP_SH:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+static break_page_t *find_break_page(uint32_t vpn)
+{
+    int i;
+
+    for (i = 0; i < DEBUG.num_break_pages; i++) {
+        if (DEBUG.break_pages[i].vpn == vpn) {
+            return &DEBUG.break_pages[i];
+        }
+    }
+    return NULL;
+}
+
+/***************************************************************/
+/* Recompute the page table from the breakpoints and watches                       */
+/***************************************************************/
+/* The table is freed once both lists are empty, runs then check nothing. */
+static int rebuild()
+{
+    break_page_t *bp;
+    const watch_t *w;
+    uint32_t vpn;
+    int i;
+
+    if (DEBUG.num_breaks == 0 && DEBUG.num_watches == 0) {
+        free(DEBUG.pages);
+        DEBUG.pages = NULL;
+        DEBUG.num_break_pages = 0;
+        DEBUG.last = NULL;
+        return 0;
+    }
+    if (DEBUG.pages == NULL && (DEBUG.pages = malloc(DEBUG_PAGES)) == NULL) {
+        printf("Error: out of memory for the breakpoint table\n");
+        return -1;
+    }
+    memset(DEBUG.pages, 0, DEBUG_PAGES);
+    DEBUG.num_break_pages = 0;
+    DEBUG.last = NULL;
+    for (i = 0; i < DEBUG.num_breaks; i++) {
+        vpn = MEM_PAGE_NUM(DEBUG.breaks[i]);
+        if ((bp = find_break_page(vpn)) == NULL) {
+            bp = &DEBUG.break_pages[DEBUG.num_break_pages++];
+            memset(bp, 0, sizeof(*bp));
+            bp->vpn = vpn;
+        }
+        bp->bits[(DEBUG.breaks[i] & MEM_PAGE_MASK) / 4 / 32] |= 1u << ((DEBUG.breaks[i] / 4) % 32);
+        DEBUG.pages[vpn] |= DEBUG_PAGE_BREAK;
+    }
+    for (i = 0; i < DEBUG.num_watches; i++) {
+        w = &DEBUG.watches[i];
+        for (vpn = MEM_PAGE_NUM(w->addr); vpn <= MEM_PAGE_NUM(w->addr + w->len - 1); vpn++) {
+            DEBUG.pages[vpn] |= DEBUG_PAGE_WATCH;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Stop runs before the instruction at addr                                                              */
+/***************************************************************/
+int debug_break_add(uint32_t addr)
+{
+    int i;
+
+    if ((addr & 3) != 0 || mem_region_of(addr) < 0) {
+        printf("Error: a breakpoint must be a word aligned address in memory\n");
+        return -1;
+    }
+    for (i = 0; i < DEBUG.num_breaks; i++) {
+        if (DEBUG.breaks[i] == addr) {
+            return 0;
+        }
+    }
+    if (DEBUG.num_breaks == DEBUG_MAX_BREAKS) {
+        printf("Error: at most %d breakpoints\n", DEBUG_MAX_BREAKS);
+        return -1;
+    }
+    DEBUG.breaks[DEBUG.num_breaks++] = addr;
+    return rebuild();
+}
+
+/***************************************************************/
+/* Stop runs after a load or store touches [addr, addr + len)                          */
+/***************************************************************/
+int debug_watch_add(uint32_t addr, uint32_t len, int kinds)
+{
+    watch_t *w;
+
+    if (len == 0 || len > MEM_PAGE_SIZE || addr + len - 1 < addr || mem_region_of(addr) < 0) {
+        printf("Error: a watch covers 1 to %u bytes of memory\n", MEM_PAGE_SIZE);
+        return -1;
+    }
+    if (DEBUG.num_watches == DEBUG_MAX_WATCHES) {
+        printf("Error: at most %d watches\n", DEBUG_MAX_WATCHES);
+        return -1;
+    }
+    w = &DEBUG.watches[DEBUG.num_watches++];
+    w->addr = addr;
+    w->len = len;
+    w->kinds = kinds;
+    return rebuild();
+}
+
+/***************************************************************/
+/* Remove the breakpoint and the watches starting at addr, -1 if none        */
+/***************************************************************/
+int debug_delete(uint32_t addr)
+{
+    int i, n, found = FALSE;
+
+    for (i = 0, n = 0; i < DEBUG.num_breaks; i++) {
+        if (DEBUG.breaks[i] == addr) {
+            found = TRUE;
+        } else {
+            DEBUG.breaks[n++] = DEBUG.breaks[i];
+        }
+    }
+    DEBUG.num_breaks = n;
+    for (i = 0, n = 0; i < DEBUG.num_watches; i++) {
+        if (DEBUG.watches[i].addr == addr) {
+            found = TRUE;
+        } else {
+            DEBUG.watches[n++] = DEBUG.watches[i];
+        }
+    }
+    DEBUG.num_watches = n;
+    if (!found) {
+        printf("Error: no breakpoint or watch at 0x%08x\n", addr);
+        return -1;
+    }
+    return rebuild();
+}
+
+void debug_clear()
+{
+    DEBUG.num_breaks = 0;
+    DEBUG.num_watches = 0;
+    rebuild();
+}
+
+/***************************************************************/
+/* Start checking for the run about to begin                                                         */
+/***************************************************************/
+/* Only runs that call debug_stopped() after each cycle arm the checks; the
+ * samplers, benchmarks and other cores never see a breakpoint. */
+void debug_arm()
+{
+    DEBUG.active = DEBUG.pages;
+    DEBUG.stop = 0;
+}
+
+void debug_disarm()
+{
+    DEBUG.active = NULL;
+}
+
+/***************************************************************/
+/* Note IF fetching pc, in a page with breakpoints                                           */
+/***************************************************************/
+void debug_fetch(uint32_t pc)
+{
+    const break_page_t *bp = DEBUG.last;
+
+    if (bp == NULL || bp->vpn != MEM_PAGE_NUM(pc)) {
+        if ((bp = find_break_page(MEM_PAGE_NUM(pc))) == NULL) {
+            return;
+        }
+        DEBUG.last = bp;
+    }
+    if (!(bp->bits[(pc & MEM_PAGE_MASK) / 4 / 32] & (1u << ((pc / 4) % 32)))) {
+        return;
+    }
+    if (DEBUG.recording) {
+        DEBUG.found = TRUE;
+        DEBUG.event = CYCLE_COUNT;
+        return;
+    }
+    if (!(DEBUG.stop & STOP_BREAK)) {
+        DEBUG.hit = pc;
+    }
+    DEBUG.stop |= STOP_BREAK;
+}
+
+/***************************************************************/
+/* Report an access by d at pc to a watched page once it reached memory   */
+/***************************************************************/
+void debug_watch_access(const decoded_inst_t *d, uint32_t pc, uint32_t addr)
+{
+    const watch_t *w = NULL;
+    uint32_t size = access_size(d), value;
+    int kind = (d->flags & INST_STORE) ? WATCH_WRITE : WATCH_READ;
+    char text[64];
+    int i;
+
+    for (i = 0; i < DEBUG.num_watches && w == NULL; i++) {
+        if ((DEBUG.watches[i].kinds & kind) && addr < DEBUG.watches[i].addr + DEBUG.watches[i].len &&
+            DEBUG.watches[i].addr < addr + size) {
+            w = &DEBUG.watches[i];
+        }
+    }
+    if (w == NULL) {
+        return;
+    }
+    if (DEBUG.recording) {
+        DEBUG.found = TRUE;
+        DEBUG.event = CYCLE_COUNT;
+        return;
+    }
+    value = size == 1 ? mem_read_8(addr) : size == 2 ? mem_read_16(addr) : mem_read_32(addr);
+    printf("Watch 0x%08x: %s at 0x%08x %s 0x%08x at 0x%08x, cycle %u.\n", w->addr, disasm(d->raw, text, sizeof(text)),
+           pc, kind == WATCH_WRITE ? "wrote" : "read", value, addr, CYCLE_COUNT);
+    DEBUG.stop |= STOP_WATCH;
+}
+
+/***************************************************************/
+/* Note the cycles of hits instead of stopping, for going back to them         */
+/***************************************************************/
+/* While on, hits are noted with the cycle they happened in and no run stops. */
+void debug_record(int on)
+{
+    DEBUG.recording = on;
+    DEBUG.active = on ? DEBUG.pages : NULL;
+    DEBUG.stop = 0;
+    if (on) {
+        DEBUG.found = FALSE;
+    }
+}
+
+/***************************************************************/
+/* After a cycle that hit something, TRUE if the run stops here                     */
+/***************************************************************/
+int debug_stopped()
+{
+    int stop = DEBUG.stop;
+
+    DEBUG.stop = 0;
+    if (stop & STOP_BREAK) {
+        printf("Breakpoint at 0x%08x fetched, cycle %u.\n", DEBUG.hit, CYCLE_COUNT);
+    }
+    return stop != 0;
+}
+
+/***************************************************************/
+/* List the breakpoints and watches                                                                     */
+/***************************************************************/
+void debug_print(FILE *out)
+{
+    int i;
+
+    fprintf(out, "Breakpoints\t:");
+    for (i = 0; i < DEBUG.num_breaks; i++) {
+        fprintf(out, " 0x%08x", DEBUG.breaks[i]);
+    }
+    fprintf(out, "%s\nWatches\t\t:", DEBUG.num_breaks ? "" : " none");
+    for (i = 0; i < DEBUG.num_watches; i++) {
+        fprintf(out, "%s 0x%08x %u byte%s %s", i ? "," : "", DEBUG.watches[i].addr, DEBUG.watches[i].len,
+                DEBUG.watches[i].len == 1 ? "" : "s",
+                DEBUG.watches[i].kinds == WATCH_READ ? "read" : DEBUG.watches[i].kinds == WATCH_WRITE ? "write" : "access");
+    }
+    fprintf(out, "%s\n", DEBUG.num_watches ? "" : " none");
+}
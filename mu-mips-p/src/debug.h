@@ -0,0 +1,86 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+
+/***************************************************************/
+/* Breakpoints and watchpoints                                                                               */
+/***************************************************************/
+/* A byte per memory page says whether the page holds a breakpoint or a watched
+ * address. IF looks at it for every instruction it fetches and MEM for every
+ * access, so pages without either cost one table lookup, and nothing at all
+ * unless a run has armed the table (see debug_arm()). A page with breakpoints
+ * has a bit per word, a watched page is checked against each watch.
+ *
+ * A run stops at the end of the cycle IF fetched a breakpoint instruction in,
+ * with the instructions before it still in flight, and the next run picks up
+ * from there. Fetch is not held or drained, so a program takes the same cycles
+ * with breakpoints as without. A breakpoint fetched down a mispredicted path
+ * stops the run too, the branch squashes it later. A watched access stops the
+ * run at the end of the cycle it reached memory in. */
+#define DEBUG_MAX_BREAKS    32
+#define DEBUG_MAX_WATCHES   8
+#define DEBUG_PAGES         (1u << (32 - MEM_PAGE_BITS))
+#define DEBUG_PAGE_WORDS    (MEM_PAGE_SIZE / 4)
+
+#define DEBUG_PAGE_BREAK    0x1
+#define DEBUG_PAGE_WATCH    0x2
+
+#define WATCH_READ          0x1
+#define WATCH_WRITE         0x2
+
+#define STOP_BREAK          0x1
+#define STOP_WATCH          0x2
+
+typedef struct {
+	uint32_t vpn;
+	uint32_t bits[DEBUG_PAGE_WORDS / 32];   /* a bit per instruction word */
+} break_page_t;
+
+typedef struct {
+	uint32_t addr, len;
+	int kinds;                              /* WATCH_READ and/or WATCH_WRITE */
+} watch_t;
+
+typedef struct {
+	uint8_t *pages;                         /* DEBUG_PAGE_* per page, NULL with nothing set */
+	const uint8_t *active;                  /* pages while a run is armed, NULL otherwise */
+	uint32_t breaks[DEBUG_MAX_BREAKS];
+	int num_breaks;
+	break_page_t break_pages[DEBUG_MAX_BREAKS];
+	int num_break_pages;
+	const break_page_t *last;               /* page of the last breakpoint lookup */
+	watch_t watches[DEBUG_MAX_WATCHES];
+	int num_watches;
+	int stop;                               /* STOP_* seen during the current cycle */
+	uint32_t hit;                           /* first breakpoint IF fetched this cycle */
+	int recording;                          /* note hits without stopping, see debug_record() */
+	int found;
+	uint32_t event;                         /* cycle of the last hit noted */
+} debug_state_t;
+
+extern SIM_LOCAL debug_state_t DEBUG;
+
+/* TRUE when addr is in a page holding flag and a run is checking */
+#define DEBUG_PAGE(addr, flag) (DEBUG.active != NULL && (DEBUG.active[MEM_PAGE_NUM(addr)] & (flag)))
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int debug_break_add(uint32_t addr);
+int debug_watch_add(uint32_t addr, uint32_t len, int kinds);
+int debug_delete(uint32_t addr);
+void debug_clear();
+void debug_arm();
+void debug_disarm();
+void debug_fetch(uint32_t pc);
+void debug_watch_access(const decoded_inst_t *d, uint32_t pc, uint32_t addr);
+void debug_record(int on);
+int debug_stopped();
+void debug_print(FILE *out);
+
+#endif
@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+
+static SIM_LOCAL decode_cache_t DECODE;
+
+_Static_assert(DECODE_SCRATCH >= 4 * PIPE_MAX_WIDTH + PIPE_MAX_WIDTH, "a scratch record is reused while a latch still points at it");
+
+/***************************************************************/
+/* Execute handlers, one per operation                                                                  */
+/***************************************************************/
+static void exec_nop(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = 0;
+}
+
+static void exec_sll(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = b << d->shamt;
+}
+
+static void exec_srl(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = b >> d->shamt;
+}
+
+static void exec_sra(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = (uint32_t)((int32_t)b >> d->shamt);
+}
+
+static void exec_mfhi(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = CURRENT_STATE.HI;
+}
+
+static void exec_mthi(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->HI = a;
+}
+
+static void exec_mflo(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = CURRENT_STATE.LO;
+}
+
+static void exec_mtlo(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->LO = a;
+}
+
+static void exec_mult(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    int64_t product = (int64_t)(int32_t)a * (int64_t)(int32_t)b;
+    out->HI = (uint32_t)((uint64_t)product >> 32);
+    out->LO = (uint32_t)product;
+}
+
+static void exec_multu(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    uint64_t product = (uint64_t)a * (uint64_t)b;
+    out->HI = (uint32_t)(product >> 32);
+    out->LO = (uint32_t)product;
+}
+
+static void exec_div(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    /* division by zero leaves HI and LO unpredictable, keep the old values */
+    if (b == 0 || (a == 0x80000000 && b == 0xFFFFFFFF)) {
+        out->HI = CURRENT_STATE.HI;
+        out->LO = CURRENT_STATE.LO;
+        return;
+    }
+    out->LO = (uint32_t)((int32_t)a / (int32_t)b);
+    out->HI = (uint32_t)((int32_t)a % (int32_t)b);
+}
+
+static void exec_divu(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    if (b == 0) {
+        out->HI = CURRENT_STATE.HI;
+        out->LO = CURRENT_STATE.LO;
+        return;
+    }
+    out->LO = a / b;
+    out->HI = a % b;
+}
+
+static void exec_add(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = a + b;
+}
+
+static void exec_sub(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = a - b;
+}
+
+static void exec_and(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = a & b;
+}
+
+static void exec_or(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = a | b;
+}
+
+static void exec_xor(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = a ^ b;
+}
+
+static void exec_nor(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = ~(a | b);
+}
+
+static void exec_slt(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = ((int32_t)a < (int32_t)b) ? 1 : 0;
+}
+
+static void exec_addi(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = a + d->imm;
+}
+
+static void exec_slti(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = ((int32_t)a < (int32_t)d->imm) ? 1 : 0;
+}
+
+static void exec_andi(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = a & d->imm;
+}
+
+static void exec_ori(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = a | d->imm;
+}
+
+static void exec_xori(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = a ^ d->imm;
+}
+
+static void exec_lui(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = d->imm << 16;
+}
+
+/* loads and stores only compute the effective address here, MEM() does the access */
+static void exec_addr(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->ALUOutput = a + d->imm;
+}
+
+/* out->PC already holds the address of the following instruction */
+static void exec_beq(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->tar = (a == b) ? out->PC + d->imm : out->PC;
+}
+
+static void exec_bne(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->tar = (a != b) ? out->PC + d->imm : out->PC;
+}
+
+static void exec_blez(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->tar = ((int32_t)a <= 0) ? out->PC + d->imm : out->PC;
+}
+
+static void exec_bgtz(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->tar = ((int32_t)a > 0) ? out->PC + d->imm : out->PC;
+}
+
+static void exec_bltz(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->tar = ((int32_t)a < 0) ? out->PC + d->imm : out->PC;
+}
+
+static void exec_bgez(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->tar = ((int32_t)a >= 0) ? out->PC + d->imm : out->PC;
+}
+
+static void exec_j(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->tar = (out->PC & 0xF0000000) | d->imm;
+}
+
+/* without a delay slot the link address is the instruction after the jump */
+static void exec_jal(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->tar = (out->PC & 0xF0000000) | d->imm;
+    out->ALUOutput = out->PC;
+}
+
+static void exec_jr(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->tar = a;
+}
+
+static void exec_jalr(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b)
+{
+    out->tar = a;
+    out->ALUOutput = out->PC;
+}
+
+/***************************************************************/
+/* Static properties of each operation                                                                   */
+/***************************************************************/
+#define RD_RS   INST_READS_RS
+#define RD_RT   INST_READS_RT
+#define WR_REG  INST_WRITES_REG
+#define WR_HILO (INST_WRITES_HI | INST_WRITES_LO)
+#define RD_HILO (INST_READS_HI | INST_READS_LO)
+
+#define BR      INST_BRANCH
+#define JMP     INST_JUMP
+
+static const struct {
+    exec_fn_t exec;
+    uint16_t flags;
+    const char *name;
+} OP_INFO[OP_COUNT] = {
+    [OP_INVALID] = { exec_nop,   0, "invalid" },
+    [OP_SLL]     = { exec_sll,   WR_REG | RD_RT, "sll" },
+    [OP_SRL]     = { exec_srl,   WR_REG | RD_RT, "srl" },
+    [OP_SRA]     = { exec_sra,   WR_REG | RD_RT, "sra" },
+    [OP_SYSCALL] = { exec_nop,   INST_HALT, "syscall" },
+    [OP_MFHI]    = { exec_mfhi,  WR_REG | INST_READS_HI, "mfhi" },
+    [OP_MTHI]    = { exec_mthi,  INST_WRITES_HI | RD_RS, "mthi" },
+    [OP_MFLO]    = { exec_mflo,  WR_REG | INST_READS_LO, "mflo" },
+    [OP_MTLO]    = { exec_mtlo,  INST_WRITES_LO | RD_RS, "mtlo" },
+    [OP_MULT]    = { exec_mult,  WR_HILO | RD_RS | RD_RT, "mult" },
+    [OP_MULTU]   = { exec_multu, WR_HILO | RD_RS | RD_RT, "multu" },
+    [OP_DIV]     = { exec_div,   WR_HILO | RD_HILO | RD_RS | RD_RT, "div" },
+    [OP_DIVU]    = { exec_divu,  WR_HILO | RD_HILO | RD_RS | RD_RT, "divu" },
+    [OP_ADD]     = { exec_add,   WR_REG | RD_RS | RD_RT, "add" },
+    [OP_ADDU]    = { exec_add,   WR_REG | RD_RS | RD_RT, "addu" },
+    [OP_SUB]     = { exec_sub,   WR_REG | RD_RS | RD_RT, "sub" },
+    [OP_SUBU]    = { exec_sub,   WR_REG | RD_RS | RD_RT, "subu" },
+    [OP_AND]     = { exec_and,   WR_REG | RD_RS | RD_RT, "and" },
+    [OP_OR]      = { exec_or,    WR_REG | RD_RS | RD_RT, "or" },
+    [OP_XOR]     = { exec_xor,   WR_REG | RD_RS | RD_RT, "xor" },
+    [OP_NOR]     = { exec_nor,   WR_REG | RD_RS | RD_RT, "nor" },
+    [OP_SLT]     = { exec_slt,   WR_REG | RD_RS | RD_RT, "slt" },
+    [OP_ADDI]    = { exec_addi,  WR_REG | RD_RS, "addi" },
+    [OP_ADDIU]   = { exec_addi,  WR_REG | RD_RS, "addiu" },
+    [OP_SLTI]    = { exec_slti,  WR_REG | RD_RS, "slti" },
+    [OP_ANDI]    = { exec_andi,  WR_REG | RD_RS, "andi" },
+    [OP_ORI]     = { exec_ori,   WR_REG | RD_RS, "ori" },
+    [OP_XORI]    = { exec_xori,  WR_REG | RD_RS, "xori" },
+    [OP_LUI]     = { exec_lui,   WR_REG, "lui" },
+    [OP_LB]      = { exec_addr,  WR_REG | INST_LOAD | RD_RS, "lb" },
+    [OP_LH]      = { exec_addr,  WR_REG | INST_LOAD | RD_RS, "lh" },
+    [OP_LW]      = { exec_addr,  WR_REG | INST_LOAD | RD_RS, "lw" },
+    [OP_SB]      = { exec_addr,  INST_STORE | RD_RS | RD_RT, "sb" },
+    [OP_SH]      = { exec_addr,  INST_STORE | RD_RS | RD_RT, "sh" },
+    [OP_SW]      = { exec_addr,  INST_STORE | RD_RS | RD_RT, "sw" },
+    [OP_BEQ]     = { exec_beq,   BR | RD_RS | RD_RT, "beq" },
+    [OP_BNE]     = { exec_bne,   BR | RD_RS | RD_RT, "bne" },
+    [OP_BLEZ]    = { exec_blez,  BR | RD_RS, "blez" },
+    [OP_BGTZ]    = { exec_bgtz,  BR | RD_RS, "bgtz" },
+    [OP_BLTZ]    = { exec_bltz,  BR | RD_RS, "bltz" },
+    [OP_BGEZ]    = { exec_bgez,  BR | RD_RS, "bgez" },
+    [OP_J]       = { exec_j,     JMP, "j" },
+    [OP_JAL]     = { exec_jal,   JMP | WR_REG, "jal" },
+    [OP_JR]      = { exec_jr,    JMP | RD_RS, "jr" },
+    [OP_JALR]    = { exec_jalr,  JMP | WR_REG | RD_RS, "jalr" },
+    [OP_LL]      = { exec_addr,  WR_REG | INST_LOAD | RD_RS, "ll" },
+    [OP_SC]      = { exec_addr,  WR_REG | INST_LOAD | INST_STORE | RD_RS | RD_RT, "sc" },
+};
+
+/***************************************************************/
+/* Mnemonic of an operation                                                                                 */
+/***************************************************************/
+const char *decode_op_name(int op)
+{
+    if (op < 0 || op >= OP_COUNT) {
+        return "?";
+    }
+    return OP_INFO[op].name;
+}
+
+/***************************************************************/
+/* Decode one instruction word into a record                                                         */
+/***************************************************************/
+void decode_word(uint32_t word, decoded_inst_t *d)
+{
+    uint32_t opcode = word >> 26;
+    uint32_t immediate = word & 0x0000FFFF;
+    mips_op_t op = OP_INVALID;
+
+    memset(d, 0, sizeof(*d));
+    d->raw = word;
+    d->rs = (word & 0x03E00000) >> 21;
+    d->rt = (word & 0x001F0000) >> 16;
+    d->valid = 1;
+
+    if (opcode == 0) {
+        d->dest = (word & 0x0000F800) >> 11;
+        d->shamt = (word & 0x000007C0) >> 6;
+        switch (word & 0x0000003F) {
+            case 0x00: op = OP_SLL; break;
+            case 0x02: op = OP_SRL; break;
+            case 0x03: op = OP_SRA; break;
+            case 0x08: op = OP_JR; break;
+            case 0x09: op = OP_JALR; break;
+            case 0x0C: op = OP_SYSCALL; break;
+            case 0x10: op = OP_MFHI; break;
+            case 0x11: op = OP_MTHI; break;
+            case 0x12: op = OP_MFLO; break;
+            case 0x13: op = OP_MTLO; break;
+            case 0x18: op = OP_MULT; break;
+            case 0x19: op = OP_MULTU; break;
+            case 0x1A: op = OP_DIV; break;
+            case 0x1B: op = OP_DIVU; break;
+            case 0x20: op = OP_ADD; break;
+            case 0x21: op = OP_ADDU; break;
+            case 0x22: op = OP_SUB; break;
+            case 0x23: op = OP_SUBU; break;
+            case 0x24: op = OP_AND; break;
+            case 0x25: op = OP_OR; break;
+            case 0x26: op = OP_XOR; break;
+            case 0x27: op = OP_NOR; break;
+            case 0x2A: op = OP_SLT; break;
+        }
+    } else if (opcode == 0x02 || opcode == 0x03) {
+        op = (opcode == 0x02) ? OP_J : OP_JAL;
+        d->dest = 31;
+        d->imm = (word & 0x03FFFFFF) << 2;
+    } else {
+        d->dest = d->rt;
+        switch (opcode) {
+            case 0x01:
+                /* REGIMM, rt selects the condition */
+                if (d->rt == 0x00) {
+                    op = OP_BLTZ;
+                } else if (d->rt == 0x01) {
+                    op = OP_BGEZ;
+                }
+                break;
+            case 0x04: op = OP_BEQ; break;
+            case 0x05: op = OP_BNE; break;
+            case 0x06: op = OP_BLEZ; break;
+            case 0x07: op = OP_BGTZ; break;
+            case 0x08: op = OP_ADDI; break;
+            case 0x09: op = OP_ADDIU; break;
+            case 0x0A: op = OP_SLTI; break;
+            case 0x0C: op = OP_ANDI; break;
+            case 0x0D: op = OP_ORI; break;
+            case 0x0E: op = OP_XORI; break;
+            case 0x0F: op = OP_LUI; break;
+            case 0x20: op = OP_LB; break;
+            case 0x21: op = OP_LH; break;
+            case 0x23: op = OP_LW; break;
+            case 0x28: op = OP_SB; break;
+            case 0x29: op = OP_SH; break;
+            case 0x2B: op = OP_SW; break;
+            case 0x30: op = OP_LL; break;
+            case 0x38: op = OP_SC; break;
+        }
+        /* ANDI, ORI and XORI are zero extended, everything else sign extended */
+        if (op == OP_ANDI || op == OP_ORI || op == OP_XORI) {
+            d->imm = immediate;
+        } else if (OP_INFO[op].flags & INST_BRANCH) {
+            d->imm = sign_extension_32(immediate) << 2;
+        } else {
+            d->imm = sign_extension_32(immediate);
+        }
+    }
+
+    d->op = op;
+    d->exec = OP_INFO[op].exec;
+    d->flags = OP_INFO[op].flags;
+    if (!(d->flags & INST_WRITES_REG)) {
+        d->dest = 0;
+    }
+}
+
+/***************************************************************/
+/* Records for one text page, allocated and hooked on first use                         */
+/***************************************************************/
+static decoded_inst_t *decode_page(uint32_t index)
+{
+    decoded_inst_t *page = DECODE.pages[index];
+    if (page == NULL) {
+        page = calloc(DECODE_PAGE_WORDS, sizeof(decoded_inst_t));
+        if (page == NULL) {
+            printf("Error: out of memory allocating decode cache\n");
+            exit(-1);
+        }
+        DECODE.pages[index] = page;
+        mem_hook_page(MEM_TEXT_BEGIN + (index << MEM_PAGE_BITS));
+    }
+    return page;
+}
+
+/***************************************************************/
+/* Write hook: forget records for overwritten text words                                     */
+/***************************************************************/
+static void decode_invalidate(uint32_t address, uint32_t size)
+{
+    uint32_t a;
+    for (a = address & ~3u; a < address + size; a += 4) {
+        if (a < MEM_TEXT_BEGIN || a > MEM_TEXT_END) {
+            continue;
+        }
+        decoded_inst_t *page = DECODE.pages[(a - MEM_TEXT_BEGIN) >> MEM_PAGE_BITS];
+        if (page != NULL) {
+            page[(a & MEM_PAGE_MASK) >> 2].valid = 0;
+        }
+    }
+}
+
+/***************************************************************/
+/* Decode a range of the text segment ahead of time                                           */
+/***************************************************************/
+void decode_program(uint32_t start, uint32_t num_words)
+{
+    uint32_t i, pc;
+    for (i = 0; i < num_words; i++) {
+        pc = start + i*4;
+        if (pc < MEM_TEXT_BEGIN || pc > MEM_TEXT_END) {
+            continue;
+        }
+        decoded_inst_t *page = decode_page((pc - MEM_TEXT_BEGIN) >> MEM_PAGE_BITS);
+        decode_word(mem_read_32(pc), &page[(pc & MEM_PAGE_MASK) >> 2]);
+        DECODE.decoded++;
+    }
+}
+
+/***************************************************************/
+/* Return the decoded record for the instruction at pc                                       */
+/***************************************************************/
+const decoded_inst_t *decode_fetch(uint32_t pc)
+{
+    decoded_inst_t *d;
+
+    if (pc >= MEM_TEXT_BEGIN && pc <= MEM_TEXT_END && (pc & 3) == 0) {
+        d = &decode_page((pc - MEM_TEXT_BEGIN) >> MEM_PAGE_BITS)[(pc & MEM_PAGE_MASK) >> 2];
+        if (!d->valid) {
+            decode_word(mem_read_32(pc), d);
+            DECODE.decoded++;
+        }
+        return d;
+    }
+    /* outside the text segment: decode every time into a record that outlives the pipeline */
+    d = &DECODE.scratch[DECODE.next_scratch];
+    DECODE.next_scratch = (DECODE.next_scratch + 1) % DECODE_SCRATCH;
+    decode_word(mem_read_32(pc), d);
+    return d;
+}
+
+/***************************************************************/
+/* Drop every decoded record                                                                                 */
+/***************************************************************/
+void decode_flush()
+{
+    uint32_t i;
+    for (i = 0; i < DECODE_TEXT_PAGES; i++) {
+        free(DECODE.pages[i]);
+        DECODE.pages[i] = NULL;
+    }
+    DECODE.decoded = 0;
+}
+
+/***************************************************************/
+/* Free the decode cache                                                                                           */
+/***************************************************************/
+void decode_release()
+{
+    if (DECODE.pages != NULL) {
+        decode_flush();
+        free(DECODE.pages);
+        DECODE.pages = NULL;
+    }
+}
+
+/***************************************************************/
+/* Set up an empty decode cache                                                                           */
+/***************************************************************/
+void decode_init()
+{
+    if (DECODE.pages == NULL) {
+        DECODE.pages = calloc(DECODE_TEXT_PAGES, sizeof(decoded_inst_t *));
+        if (DECODE.pages == NULL) {
+            printf("Error: out of memory allocating decode cache\n");
+            exit(-1);
+        }
+    }
+    decode_flush();
+    mem_add_write_hook(decode_invalidate);
+}
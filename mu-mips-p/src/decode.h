@@ -0,0 +1,92 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/***************************************************************/
+/* Operations understood by the pipeline                                                            */
+/***************************************************************/
+typedef enum {
+	OP_INVALID = 0,
+	/* R-type */
+	OP_SLL, OP_SRL, OP_SRA,
+	OP_SYSCALL,
+	OP_MFHI, OP_MTHI, OP_MFLO, OP_MTLO,
+	OP_MULT, OP_MULTU, OP_DIV, OP_DIVU,
+	OP_ADD, OP_ADDU, OP_SUB, OP_SUBU,
+	OP_AND, OP_OR, OP_XOR, OP_NOR, OP_SLT,
+	/* I-type */
+	OP_ADDI, OP_ADDIU, OP_SLTI, OP_ANDI, OP_ORI, OP_XORI, OP_LUI,
+	OP_LB, OP_LH, OP_LW, OP_SB, OP_SH, OP_SW,
+	/* control flow, resolved in EX without a delay slot */
+	OP_BEQ, OP_BNE, OP_BLEZ, OP_BGTZ, OP_BLTZ, OP_BGEZ,
+	OP_J, OP_JAL, OP_JR, OP_JALR,
+	/* load linked / store conditional, sc is both a store and a load of its result */
+	OP_LL, OP_SC,
+	OP_COUNT
+} mips_op_t;
+
+/* instruction properties used by the later stages */
+#define INST_WRITES_REG  0x01  /* writes GPR dest */
+#define INST_LOAD        0x02
+#define INST_STORE       0x04
+#define INST_WRITES_HI   0x08
+#define INST_WRITES_LO   0x10
+#define INST_READS_RS    0x20
+#define INST_READS_RT    0x40
+#define INST_HALT        0x80  /* stops the simulation when it retires */
+#define INST_BRANCH      0x100 /* conditional, imm is the byte offset from PC+4 */
+#define INST_JUMP        0x200 /* unconditional, imm is the region target for J/JAL */
+#define INST_READS_HI    0x400 /* division by zero keeps the old HI and LO, so div reads them too */
+#define INST_READS_LO    0x800
+#define INST_CTRL        (INST_BRANCH | INST_JUMP)
+
+typedef struct decoded_inst_struct decoded_inst_t;
+
+/* computes ALUOutput (and HI/LO) into out from the source operand values,
+ * control flow instructions also set out->tar to the address executed next */
+typedef void (*exec_fn_t)(const decoded_inst_t *d, CPU_Pipeline_Reg *out, uint32_t a, uint32_t b);
+
+struct decoded_inst_struct {
+	exec_fn_t exec;
+	uint32_t imm;       /* already sign or zero extended */
+	uint32_t raw;
+	uint8_t op;         /* mips_op_t */
+	uint8_t rs, rt;
+	uint8_t dest;       /* rd for R-type, rt for I-type */
+	uint8_t shamt;
+	uint8_t valid;      /* cleared when the word is overwritten */
+	uint16_t flags;
+};
+
+/***************************************************************/
+/* Decoded text cache                                                                                              */
+/***************************************************************/
+/* one record per text word, allocated a text page at a time */
+#define DECODE_TEXT_PAGES  ((MEM_TEXT_END - MEM_TEXT_BEGIN + 1) >> MEM_PAGE_BITS)
+#define DECODE_PAGE_WORDS  (MEM_PAGE_SIZE / 4)
+/* fetches from outside the text segment are decoded into this many rotating records,
+ * enough for the four latches plus the bundle IF is fetching at the widest pipeline */
+#define DECODE_SCRATCH     32
+
+typedef struct {
+	decoded_inst_t **pages;                 /* DECODE_TEXT_PAGES entries, NULL until decoded */
+	decoded_inst_t scratch[DECODE_SCRATCH];
+	int next_scratch;
+	uint32_t decoded;                       /* number of words decoded, for reporting */
+} decode_cache_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void decode_init();
+void decode_flush();
+void decode_release();
+void decode_program(uint32_t start, uint32_t num_words);
+void decode_word(uint32_t word, decoded_inst_t *d);
+const decoded_inst_t *decode_fetch(uint32_t pc);
+const char *decode_op_name(int op);
+
+#endif
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "disasm.h"
+
+/***************************************************************/
+/* Disassemble one instruction word                                                                      */
+/***************************************************************/
+/* kept free of simulator state so the offline tools can link it on its own */
+char *disasm(uint32_t word, char *buf, size_t len)
+{
+    uint32_t opcode = word >> 26;
+    uint32_t rs = (word >> 21) & 0x1F;
+    uint32_t rt = (word >> 16) & 0x1F;
+    uint32_t rd = (word >> 11) & 0x1F;
+    uint32_t shamt = (word >> 6) & 0x1F;
+    uint32_t imm = word & 0xFFFF;
+    int32_t simm = (int16_t)imm;
+    const char *name = NULL;
+
+    if (opcode == 0) {
+        switch (word & 0x3F) {
+            case 0x00:
+                if (word == 0) {
+                    snprintf(buf, len, "nop");
+                } else {
+                    snprintf(buf, len, "sll $%u, $%u, %u", rd, rt, shamt);
+                }
+                return buf;
+            case 0x08: snprintf(buf, len, "jr $%u", rs); return buf;
+            case 0x09: snprintf(buf, len, "jalr $%u, $%u", rd, rs); return buf;
+            case 0x02: snprintf(buf, len, "srl $%u, $%u, %u", rd, rt, shamt); return buf;
+            case 0x03: snprintf(buf, len, "sra $%u, $%u, %u", rd, rt, shamt); return buf;
+            case 0x0C: snprintf(buf, len, "syscall"); return buf;
+            case 0x10: snprintf(buf, len, "mfhi $%u", rd); return buf;
+            case 0x11: snprintf(buf, len, "mthi $%u", rs); return buf;
+            case 0x12: snprintf(buf, len, "mflo $%u", rd); return buf;
+            case 0x13: snprintf(buf, len, "mtlo $%u", rs); return buf;
+            case 0x18: name = "mult"; break;
+            case 0x19: name = "multu"; break;
+            case 0x1A: name = "div"; break;
+            case 0x1B: name = "divu"; break;
+            case 0x20: snprintf(buf, len, "add $%u, $%u, $%u", rd, rs, rt); return buf;
+            case 0x21: snprintf(buf, len, "addu $%u, $%u, $%u", rd, rs, rt); return buf;
+            case 0x22: snprintf(buf, len, "sub $%u, $%u, $%u", rd, rs, rt); return buf;
+            case 0x23: snprintf(buf, len, "subu $%u, $%u, $%u", rd, rs, rt); return buf;
+            case 0x24: snprintf(buf, len, "and $%u, $%u, $%u", rd, rs, rt); return buf;
+            case 0x25: snprintf(buf, len, "or $%u, $%u, $%u", rd, rs, rt); return buf;
+            case 0x26: snprintf(buf, len, "xor $%u, $%u, $%u", rd, rs, rt); return buf;
+            case 0x27: snprintf(buf, len, "nor $%u, $%u, $%u", rd, rs, rt); return buf;
+            case 0x2A: snprintf(buf, len, "slt $%u, $%u, $%u", rd, rs, rt); return buf;
+        }
+        if (name != NULL) {
+            snprintf(buf, len, "%s $%u, $%u", name, rs, rt);
+            return buf;
+        }
+    } else {
+        /* branch offsets are shown in bytes from the following instruction */
+        switch (opcode) {
+            case 0x01:
+                if (rt == 0x00) {
+                    snprintf(buf, len, "bltz $%u, %d", rs, simm * 4);
+                    return buf;
+                } else if (rt == 0x01) {
+                    snprintf(buf, len, "bgez $%u, %d", rs, simm * 4);
+                    return buf;
+                }
+                break;
+            case 0x02: snprintf(buf, len, "j 0x%x", (word & 0x03FFFFFF) << 2); return buf;
+            case 0x03: snprintf(buf, len, "jal 0x%x", (word & 0x03FFFFFF) << 2); return buf;
+            case 0x04: snprintf(buf, len, "beq $%u, $%u, %d", rs, rt, simm * 4); return buf;
+            case 0x05: snprintf(buf, len, "bne $%u, $%u, %d", rs, rt, simm * 4); return buf;
+            case 0x06: snprintf(buf, len, "blez $%u, %d", rs, simm * 4); return buf;
+            case 0x07: snprintf(buf, len, "bgtz $%u, %d", rs, simm * 4); return buf;
+            case 0x08: snprintf(buf, len, "addi $%u, $%u, %d", rt, rs, simm); return buf;
+            case 0x09: snprintf(buf, len, "addiu $%u, $%u, %d", rt, rs, simm); return buf;
+            case 0x0A: snprintf(buf, len, "slti $%u, $%u, %d", rt, rs, simm); return buf;
+            case 0x0C: snprintf(buf, len, "andi $%u, $%u, 0x%x", rt, rs, imm); return buf;
+            case 0x0D: snprintf(buf, len, "ori $%u, $%u, 0x%x", rt, rs, imm); return buf;
+            case 0x0E: snprintf(buf, len, "xori $%u, $%u, 0x%x", rt, rs, imm); return buf;
+            case 0x0F: snprintf(buf, len, "lui $%u, 0x%x", rt, imm); return buf;
+            case 0x20: name = "lb"; break;
+            case 0x21: name = "lh"; break;
+            case 0x23: name = "lw"; break;
+            case 0x28: name = "sb"; break;
+            case 0x29: name = "sh"; break;
+            case 0x2B: name = "sw"; break;
+            case 0x30: name = "ll"; break;
+            case 0x38: name = "sc"; break;
+        }
+        if (name != NULL) {
+            snprintf(buf, len, "%s $%u, %d($%u)", name, rt, simm, rs);
+            return buf;
+        }
+    }
+    snprintf(buf, len, ".word 0x%08x", word);
+    return buf;
+}
@@ -0,0 +1,13 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+/* writes the MIPS assembly for word into buf, returns buf */
+char *disasm(uint32_t word, char *buf, size_t len);
+
+#endif
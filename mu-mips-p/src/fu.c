@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "fu.h"
+
+SIM_LOCAL fu_state_t FU = {
+    .config = {
+        [UNIT_MULT] = { 1, TRUE },
+        [UNIT_DIV] = { 1, FALSE },
+        [UNIT_MEM] = { 1, TRUE },
+    },
+};
+
+static const char *UNIT_NAMES[UNIT_KINDS] = { "mult", "div", "mem" };
+
+/***************************************************************/
+/* Set the latency of a unit and whether it is pipelined                                    */
+/***************************************************************/
+int fu_configure(int kind, int latency, int pipelined)
+{
+    if (kind < 0 || kind >= UNIT_KINDS) {
+        printf("Error: the functional units are mult, div and mem\n");
+        return -1;
+    }
+    if (latency < 1 || latency > FU_MAX_LATENCY) {
+        printf("Error: a unit's latency must be 1 to %d cycles\n", FU_MAX_LATENCY);
+        return -1;
+    }
+    FU.config[kind].latency = latency;
+    FU.config[kind].pipelined = pipelined;
+    return 0;
+}
+
+int fu_parse_kind(const char *name)
+{
+    int i;
+
+    for (i = 0; i < UNIT_KINDS; i++) {
+        if (strcmp(name, UNIT_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/***************************************************************/
+/* Configure a unit from <unit>:<latency>[:pipelined|:blocking]                         */
+/***************************************************************/
+int fu_parse(const char *spec)
+{
+    char name[16], *end = NULL;
+    long latency = 0;
+    int kind = -1, n = 0;
+
+    /* the whole spec has to match, "mult:4junk" is not a latency of 4 */
+    if (sscanf(spec, "%15[^:]:%n", name, &n) == 1 && n > 0 && (kind = fu_parse_kind(name)) >= 0) {
+        latency = strtol(spec + n, &end, 10);
+    }
+    if (kind < 0 || end == spec + n || (*end != '\0' && strcmp(end, ":pipelined") != 0 && strcmp(end, ":blocking") != 0)) {
+        printf("Error: a unit is given as mult|div|mem:<latency>[:pipelined|:blocking]\n");
+        return -1;
+    }
+    /* out of range, as an int too, is left for fu_configure() to report */
+    if (latency < 1 || latency > FU_MAX_LATENCY) {
+        latency = -1;
+    }
+    return fu_configure(kind, (int)latency, *end == '\0' ? FU.config[kind].pipelined : strcmp(end, ":pipelined") == 0);
+}
+
+/***************************************************************/
+/* Forget the scoreboard, the configuration is kept                                              */
+/***************************************************************/
+void fu_reset()
+{
+    memset(&FU.board, 0, sizeof(FU.board));
+}
+
+/* the unit d needs, -1 for the single cycle ALU */
+int fu_kind(const decoded_inst_t *d)
+{
+    if (d->flags & (INST_LOAD | INST_STORE)) {
+        return UNIT_MEM;
+    }
+    switch (d->op) {
+        case OP_MULT:
+        case OP_MULTU:
+            return UNIT_MULT;
+        case OP_DIV:
+        case OP_DIVU:
+            return UNIT_DIV;
+        default:
+            return -1;
+    }
+}
+
+/* cycles from d entering its unit to its result */
+int fu_latency(const decoded_inst_t *d)
+{
+    int kind = fu_kind(d);
+
+    return kind < 0 ? 1 : FU.config[kind].latency;
+}
+
+/* cycles from d entering its unit to the unit taking the next instruction */
+int fu_interval(const decoded_inst_t *d)
+{
+    int kind = fu_kind(d);
+
+    return (kind < 0 || FU.config[kind].pipelined) ? 1 : FU.config[kind].latency;
+}
+
+/***************************************************************/
+/* Record d entering its unit at cycle                                                                     */
+/***************************************************************/
+/* EX calls it for everything but loads and stores, MEM for those. An
+ * instruction that writes a register overrides the scoreboard entry an older
+ * load left, its own result comes through the forwarding paths. */
+void fu_enter(const decoded_inst_t *d, uint32_t cycle)
+{
+    int kind = fu_kind(d);
+    uint32_t ready = cycle + fu_latency(d);
+
+    if (kind >= 0) {
+        FU.board.free[kind] = cycle + fu_interval(d);
+    }
+    if (d->flags & INST_WRITES_REG) {
+        FU.board.ready[d->dest] = (d->flags & INST_LOAD) ? ready : 0;
+    }
+    if (d->flags & INST_WRITES_HI) {
+        FU.board.hi_ready = ready;
+    }
+    if (d->flags & INST_WRITES_LO) {
+        FU.board.lo_ready = ready;
+    }
+}
+
+/***************************************************************/
+/* First cycle d can be in EX as far as the scoreboard knows                           */
+/***************************************************************/
+uint32_t fu_ready_cycle(const decoded_inst_t *d)
+{
+    uint32_t cycle = 0;
+    int kind = fu_kind(d);
+
+    if ((d->flags & INST_READS_RS) && FU.board.ready[d->rs] > cycle) {
+        cycle = FU.board.ready[d->rs];
+    }
+    if ((d->flags & INST_READS_RT) && FU.board.ready[d->rt] > cycle) {
+        cycle = FU.board.ready[d->rt];
+    }
+    if ((d->flags & INST_READS_HI) && FU.board.hi_ready > cycle) {
+        cycle = FU.board.hi_ready;
+    }
+    if ((d->flags & INST_READS_LO) && FU.board.lo_ready > cycle) {
+        cycle = FU.board.lo_ready;
+    }
+    if (kind == UNIT_MEM) {
+        /* the memory port is entered a cycle after EX */
+        if (FU.board.free[kind] > cycle + 1) {
+            cycle = FU.board.free[kind] - 1;
+        }
+    } else if (kind >= 0 && FU.board.free[kind] > cycle) {
+        cycle = FU.board.free[kind];
+    }
+    return cycle;
+}
+
+/***************************************************************/
+/* Print the unit configuration                                                                            */
+/***************************************************************/
+void fu_print(FILE *out)
+{
+    int i;
+
+    fprintf(out, "Functional units\t:");
+    for (i = 0; i < UNIT_KINDS; i++) {
+        fprintf(out, "%s %s %d cycle%s%s", i ? "," : "", UNIT_NAMES[i], FU.config[i].latency,
+                FU.config[i].latency == 1 ? "" : "s", FU.config[i].pipelined ? " pipelined" : "");
+    }
+    fprintf(out, "\n");
+}
+
+void fu_print_json(FILE *out)
+{
+    int i;
+
+    fprintf(out, "{");
+    for (i = 0; i < UNIT_KINDS; i++) {
+        fprintf(out, "%s \"%s\": { \"latency\": %d, \"pipelined\": %s }", i ? "," : "", UNIT_NAMES[i],
+                FU.config[i].latency, FU.config[i].pipelined ? "true" : "false");
+    }
+    fprintf(out, " }");
+}
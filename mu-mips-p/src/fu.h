@@ -0,0 +1,62 @@
+#ifndef FU_H
+#define FU_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+
+/***************************************************************/
+/* Multi-cycle functional units                                                                             */
+/***************************************************************/
+/* The multiplier, the divider and the data memory port take latency cycles to
+ * produce a result. A pipelined unit takes a new instruction every cycle,
+ * otherwise it is busy until its result is out. Results still go down the
+ * pipeline and are written back in order; the latency decides when the
+ * instructions that need them may go. A scoreboard keeps the first cycle each
+ * load result, HI and LO can be used in EX, and the first cycle each unit is
+ * free. A latency of 1 is the single cycle EX and MEM have always taken. */
+#define FU_MAX_LATENCY  64
+
+typedef enum {
+	UNIT_MULT = 0,          /* mult, multu */
+	UNIT_DIV,               /* div, divu */
+	UNIT_MEM,               /* loads and stores, entered in MEM */
+	UNIT_KINDS
+} unit_kind_t;
+
+typedef struct {
+	int latency;            /* cycles from entering the unit to the result */
+	int pipelined;
+} unit_config_t;
+
+typedef struct {
+	uint32_t free[UNIT_KINDS];      /* first cycle each unit takes another instruction */
+	uint32_t ready[MIPS_REGS];      /* first cycle a load result can be used in EX */
+	uint32_t hi_ready, lo_ready;
+} fu_scoreboard_t;
+
+typedef struct {
+	unit_config_t config[UNIT_KINDS];
+	fu_scoreboard_t board;
+} fu_state_t;
+
+extern SIM_LOCAL fu_state_t FU;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int fu_configure(int kind, int latency, int pipelined);
+int fu_parse(const char *spec);
+int fu_parse_kind(const char *name);
+void fu_reset();
+int fu_kind(const decoded_inst_t *d);
+int fu_latency(const decoded_inst_t *d);
+int fu_interval(const decoded_inst_t *d);
+void fu_enter(const decoded_inst_t *d, uint32_t cycle);
+uint32_t fu_ready_cycle(const decoded_inst_t *d);
+void fu_print(FILE *out);
+void fu_print_json(FILE *out);
+
+#endif
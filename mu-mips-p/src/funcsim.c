@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "stats.h"
+#include "funcsim.h"
+
+static SIM_LOCAL func_link_t LINK;
+
+void func_clear_link()
+{
+    LINK.valid = FALSE;
+}
+
+void func_get_link(func_link_t *link)
+{
+    *link = LINK;
+}
+
+void func_set_link(const func_link_t *link)
+{
+    LINK = *link;
+}
+
+/***************************************************************/
+/* Perform the memory access of a load or store, returns the loaded value  */
+/***************************************************************/
+/* shared with the MEM stage so both engines agree on widths and sign extension,
+ * sc returns 1 if it stored and 0 if not */
+uint32_t func_access(const decoded_inst_t *d, uint32_t address, uint32_t data)
+{
+    int stored;
+
+    switch (d->op) {
+        case OP_LB:
+            return (uint32_t)(int32_t)(int8_t)mem_read_8(address);
+        case OP_LH:
+            return (uint32_t)(int32_t)(int16_t)mem_read_16(address);
+        case OP_LW:
+            return mem_read_32(address);
+        case OP_SB:
+            mem_write_8(address, data);
+            break;
+        case OP_SH:
+            mem_write_16(address, data);
+            break;
+        case OP_SW:
+            mem_write_32(address, data);
+            break;
+        case OP_LL:
+            LINK.valid = TRUE;
+            LINK.address = address;
+            LINK.value = mem_read_32(address);
+            return LINK.value;
+        case OP_SC:
+            stored = LINK.valid && LINK.address == address && mem_cas_32(address, LINK.value, data);
+            LINK.valid = FALSE;
+            return stored;
+        default:
+            break;
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Execute up to count instructions, returns how many completed                      */
+/***************************************************************/
+/* Stops early when a syscall halts the program. Uses the same predecoded
+ * records and exec handlers as the pipeline. */
+uint64_t func_run(uint64_t count)
+{
+    CPU_Pipeline_Reg r;
+    const decoded_inst_t *d;
+    uint32_t pc = CURRENT_STATE.PC;
+    uint64_t n;
+
+    for (n = 0; n < count && RUN_FLAG; n++) {
+        d = decode_fetch(pc);
+        r.PC = pc + 4;
+        r.ALUOutput = 0;
+        d->exec(d, &r, CURRENT_STATE.REGS[d->rs], CURRENT_STATE.REGS[d->rt]);
+        if (d->flags & (INST_LOAD | INST_STORE)) {
+            r.LMD = func_access(d, r.ALUOutput, CURRENT_STATE.REGS[d->rt]);
+            if (d->flags & INST_LOAD) {
+                r.ALUOutput = r.LMD;
+            }
+        }
+        if ((d->flags & INST_WRITES_REG) && d->dest != 0) {
+            CURRENT_STATE.REGS[d->dest] = r.ALUOutput;
+        }
+        if (d->flags & INST_WRITES_HI) {
+            CURRENT_STATE.HI = r.HI;
+        }
+        if (d->flags & INST_WRITES_LO) {
+            CURRENT_STATE.LO = r.LO;
+        }
+        if (d->flags & INST_HALT) {
+            RUN_FLAG = FALSE;
+        }
+        pc = (d->flags & INST_CTRL) ? r.tar : pc + 4;
+    }
+    CURRENT_STATE.PC = pc;
+    NEXT_STATE = CURRENT_STATE;
+    INSTRUCTION_COUNT += n;
+    STATS.fastforwarded += n;
+    return n;
+}
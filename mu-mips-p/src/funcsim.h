@@ -0,0 +1,30 @@
+#ifndef FUNCSIM_H
+#define FUNCSIM_H
+
+#include <stdint.h>
+
+#include "decode.h"
+
+/* The word ll read. sc stores only if memory still holds it, which other
+ * cores sharing memory can only change through a real store. */
+typedef struct {
+	int valid;
+	uint32_t address, value;
+} func_link_t;
+
+/***************************************************************/
+/* Functional engine, one whole instruction at a time                                           */
+/***************************************************************/
+/* Works directly on CURRENT_STATE and memory with no timing. The pipeline must be
+ * empty before it runs, see drain_pipeline(). */
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+uint64_t func_run(uint64_t count);
+uint32_t func_access(const decoded_inst_t *d, uint32_t address, uint32_t data);
+void func_clear_link();
+void func_get_link(func_link_t *link);
+void func_set_link(const func_link_t *link);
+
+#endif
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "hazard.h"
+#include "stats.h"
+#include "fu.h"
+
+SIM_LOCAL hazard_unit_t HAZARD = { .forwarding = TRUE };
+
+/***************************************************************/
+/* Record what a latch will write back, for forwarding into EX                          */
+/***************************************************************/
+static void capture(const CPU_Pipeline_Reg *latch, fwd_source_t *src, int after_mem)
+{
+    const decoded_inst_t *d = latch->inst;
+
+    src->dest = 0;
+    if (d == NULL || !(d->flags & INST_WRITES_REG) || d->dest == 0) {
+        return;
+    }
+    src->dest = d->dest;
+    if (d->flags & INST_LOAD) {
+        /* loaded data only exists once the load has been through MEM */
+        src->ready = after_mem;
+        src->value = latch->LMD;
+    } else {
+        src->ready = TRUE;
+        src->value = latch->ALUOutput;
+    }
+}
+
+static int reads_reg(const decoded_inst_t *d, uint8_t reg)
+{
+    if (reg == 0) {
+        return FALSE;
+    }
+    return ((d->flags & INST_READS_RS) && d->rs == reg) ||
+           ((d->flags & INST_READS_RT) && d->rt == reg);
+}
+
+static uint8_t written_reg(const decoded_inst_t *d)
+{
+    return (d != NULL && (d->flags & INST_WRITES_REG)) ? d->dest : 0;
+}
+
+/* HI and LO are not forwarded, exec reads them from CURRENT_STATE once WB has written them */
+static int reads_hilo_of(const decoded_inst_t *next, const decoded_inst_t *d)
+{
+    return d != NULL && (((next->flags & INST_READS_HI) && (d->flags & INST_WRITES_HI)) ||
+                         ((next->flags & INST_READS_LO) && (d->flags & INST_WRITES_LO)));
+}
+
+/* instructions that need the multiplier or the HI and LO registers */
+static int uses_hilo(const decoded_inst_t *d)
+{
+    return d->flags & (INST_WRITES_HI | INST_WRITES_LO | INST_READS_HI | INST_READS_LO);
+}
+
+/***************************************************************/
+/* Stall cause of an instruction waiting on older ones, -1 if there is none */
+/***************************************************************/
+static int older_hazard(const decoded_inst_t *next)
+{
+    const decoded_inst_t *ex, *mem;
+    int i;
+
+    for (i = 0; i < PIPE_WIDTH; i++) {
+        ex = ID_EX[i].inst;
+        mem = EX_MEM[i].inst;
+        if (HAZARD.forwarding) {
+            /* a load's data reaches MEM/WB one cycle too late for the next instruction */
+            if (ex != NULL && (ex->flags & INST_LOAD) && reads_reg(next, written_reg(ex))) {
+                return STALL_LOAD_USE;
+            }
+        } else if (reads_reg(next, written_reg(ex)) || reads_reg(next, written_reg(mem))) {
+            return STALL_RAW;
+        }
+        if (reads_hilo_of(next, ex) || reads_hilo_of(next, mem)) {
+            return STALL_HILO;
+        }
+    }
+    return -1;
+}
+
+/***************************************************************/
+/* Whether next waits on a multi-cycle unit, STALL_UNIT or -1                       */
+/***************************************************************/
+/* next would be in EX next cycle and in MEM the one after. The scoreboard
+ * covers what has entered a unit already; the instruction in ID/EX enters
+ * its unit this cycle, EX or MEM, and the load or store in EX/MEM enters MEM
+ * this cycle, so those are worked out from the latches. */
+static int unit_hazard(const decoded_inst_t *next)
+{
+    const decoded_inst_t *d;
+    int kind = fu_kind(next), i;
+
+    if (fu_ready_cycle(next) > CYCLE_COUNT + 1) {
+        return STALL_UNIT;
+    }
+    for (i = 0; i < PIPE_WIDTH; i++) {
+        d = ID_EX[i].inst;
+        if (d != NULL && kind >= 0 && fu_kind(d) == kind && fu_interval(d) > 1) {
+            return STALL_UNIT;
+        }
+        d = EX_MEM[i].inst;
+        if (d == NULL || fu_kind(d) != UNIT_MEM) {
+            continue;
+        }
+        if (kind == UNIT_MEM && fu_interval(d) > 2) {
+            return STALL_UNIT;
+        }
+        if ((d->flags & INST_LOAD) && reads_reg(next, written_reg(d)) && fu_latency(d) > 1) {
+            return STALL_UNIT;
+        }
+    }
+    return -1;
+}
+
+/***************************************************************/
+/* Why IF/ID slot can not issue with the slots before it, -1 if it can         */
+/***************************************************************/
+/* A bundle goes through EX together, so nothing in it can use a result of
+ * another, and it gets one memory port and one multiplier. */
+static int bundle_limit(int slot)
+{
+    const decoded_inst_t *next = IF_ID[slot].inst, *d;
+    int i;
+
+    for (i = 0; i < slot; i++) {
+        d = IF_ID[i].inst;
+        if (d->flags & INST_HALT) {
+            return ISSUE_SERIAL;
+        }
+        if (reads_reg(next, written_reg(d))) {
+            return ISSUE_DEPENDENCE;
+        }
+        if ((d->flags & (INST_LOAD | INST_STORE)) && (next->flags & (INST_LOAD | INST_STORE))) {
+            return ISSUE_MEM_PORT;
+        }
+        if (uses_hilo(d) && uses_hilo(next)) {
+            return ISSUE_MULDIV;
+        }
+    }
+    return -1;
+}
+
+/***************************************************************/
+/* Decide at the start of a cycle how many instructions ID issues              */
+/***************************************************************/
+/* Runs before the stages so it sees the latches as they were at the end of the
+ * previous cycle: IF_ID is about to be decoded, ID_EX executed and EX_MEM sent
+ * to memory. The register file is written by WB before ID reads it, so the
+ * instructions in MEM_WB never cause a stall. Issue is in order, the first
+ * instruction that has to wait holds up the ones behind it, and ID stalls
+ * when that is the oldest. */
+void hazard_detect()
+{
+    int i, limit, cause = -1;
+
+    HAZARD.stall = FALSE;
+    HAZARD.flush = FALSE;
+    HAZARD.freeze = FALSE;
+    for (i = 0; i < PIPE_WIDTH; i++) {
+        capture(&EX_MEM[i], &HAZARD.ex_mem[i], FALSE);
+        capture(&MEM_WB[i], &HAZARD.mem_wb[i], TRUE);
+    }
+
+    HAZARD.limit = ISSUE_FETCH;
+    for (i = 0; i < PIPE_WIDTH && IF_ID[i].inst != NULL; i++) {
+        limit = bundle_limit(i);
+        if (limit < 0 && ((cause = older_hazard(IF_ID[i].inst)) >= 0 || (cause = unit_hazard(IF_ID[i].inst)) >= 0)) {
+            limit = ISSUE_HAZARD;
+        }
+        if (limit >= 0) {
+            HAZARD.limit = limit;
+            break;
+        }
+    }
+    HAZARD.issue = i;
+    if (i == 0 && IF_ID[0].inst != NULL) {
+        /* nothing is older in the bundle, so it waits on the pipeline */
+        HAZARD.stall = TRUE;
+        HAZARD.stall_cause = cause;
+        STATS.stalls[cause]++;
+        PIPELINE_EVENTS |= PIPE_STALL;
+    }
+}
+
+/***************************************************************/
+/* Squash the wrong path after EX resolved a mispredicted branch                   */
+/***************************************************************/
+/* Called from EX, before ID and IF run. A stall decided for the instruction in
+ * IF/ID is dropped, that instruction is on the wrong path and gets squashed. */
+void hazard_flush(uint32_t target)
+{
+    if (HAZARD.stall) {
+        HAZARD.stall = FALSE;
+        STATS.stalls[HAZARD.stall_cause]--;
+        PIPELINE_EVENTS &= ~PIPE_STALL;
+    }
+    HAZARD.flush = TRUE;
+    HAZARD.redirect = target;
+    PIPELINE_EVENTS |= PIPE_FLUSH;
+}
+
+/***************************************************************/
+/* Hold EX, ID and IF while MEM waits for a data cache miss                               */
+/***************************************************************/
+/* Called from MEM. The cycle is charged to the miss rather than to a stall ID
+ * had already decided on, which resumes once MEM completes. */
+void hazard_freeze()
+{
+    if (HAZARD.stall) {
+        HAZARD.stall = FALSE;
+        STATS.stalls[HAZARD.stall_cause]--;
+    }
+    HAZARD.freeze = TRUE;
+    STATS.stalls[STALL_DCACHE]++;
+    PIPELINE_EVENTS |= PIPE_STALL;
+}
+
+/***************************************************************/
+/* Value of a source register in EX, value is what ID read                                  */
+/***************************************************************/
+uint32_t hazard_operand(uint8_t reg, uint32_t value)
+{
+    int i;
+
+    if (!HAZARD.forwarding || reg == 0) {
+        return value;
+    }
+    /* the youngest producer wins, the last slot of a latch is the youngest in it */
+    for (i = PIPE_WIDTH - 1; i >= 0; i--) {
+        if (HAZARD.ex_mem[i].dest == reg) {
+            /* the load-use stall keeps a load's consumer out of EX until it has been through MEM */
+            assert(HAZARD.ex_mem[i].ready);
+            STATS.fwd_ex_mem++;
+            return HAZARD.ex_mem[i].value;
+        }
+    }
+    for (i = PIPE_WIDTH - 1; i >= 0; i--) {
+        if (HAZARD.mem_wb[i].dest == reg) {
+            assert(HAZARD.mem_wb[i].ready);
+            STATS.fwd_mem_wb++;
+            return HAZARD.mem_wb[i].value;
+        }
+    }
+    return value;
+}
@@ -0,0 +1,40 @@
+#ifndef HAZARD_H
+#define HAZARD_H
+
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/***************************************************************/
+/* Hazard detection and forwarding unit                                                               */
+/***************************************************************/
+/* a result that can be forwarded into EX, taken from a latch at the start of the cycle */
+typedef struct {
+	uint8_t dest;       /* 0 when the latch writes no register */
+	uint8_t ready;      /* value is known (a load in EX/MEM is not) */
+	uint32_t value;
+} fwd_source_t;
+
+typedef struct {
+	int forwarding;             /* EX/MEM->EX and MEM/WB->EX paths enabled */
+	int issue;                  /* IF/ID slots ID may pass on, the rest wait */
+	int limit;                  /* issue_limit_t when that is not all of them */
+	int stall;                  /* hold IF/ID and send a bubble to EX this cycle */
+	int stall_cause;            /* stall_cause_t counted for the stall */
+	int flush;                  /* EX found a mispredict, squash IF/ID and IF */
+	uint32_t redirect;          /* address fetched after a flush */
+	int freeze;                 /* MEM is waiting on the data cache, nothing behind it moves */
+	fwd_source_t ex_mem[PIPE_MAX_WIDTH], mem_wb[PIPE_MAX_WIDTH];
+} hazard_unit_t;
+
+extern SIM_LOCAL hazard_unit_t HAZARD;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void hazard_detect();
+uint32_t hazard_operand(uint8_t reg, uint32_t value);
+void hazard_flush(uint32_t target);
+void hazard_freeze();
+
+#endif
@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mu-mips.h"
+#include "trace.h"
+#include "loader.h"
+
+SIM_LOCAL program_image_t PROGRAM_IMAGE;
+
+static const char *FORMAT_NAMES[LOAD_FORMATS] = { "auto", "hex", "bin", "bin-le", "elf" };
+
+/* ELF32 header and program header offsets */
+#define ELF_EI_CLASS    4
+#define ELF_EI_DATA     5
+#define ELF_E_MACHINE   18
+#define ELF_E_ENTRY     24
+#define ELF_E_PHOFF     28
+#define ELF_E_PHENTSIZE 42
+#define ELF_E_PHNUM     44
+#define ELF_HDR_SIZE    52
+#define ELF_PH_SIZE     32
+#define ELF_PT_LOAD     1
+#define ELF_PF_X        1
+#define ELF_EM_MIPS     8
+
+/***************************************************************/
+/* Forget the loaded segments                                                                                */
+/***************************************************************/
+void loader_release()
+{
+    int i;
+
+    for (i = 0; i < PROGRAM_IMAGE.num_segs; i++) {
+        free(PROGRAM_IMAGE.segs[i].bytes);
+    }
+    memset(&PROGRAM_IMAGE, 0, sizeof(PROGRAM_IMAGE));
+}
+
+static load_segment_t *add_segment(uint32_t addr, uint32_t len, int exec)
+{
+    load_segment_t *seg;
+
+    if (PROGRAM_IMAGE.num_segs == LOAD_MAX_SEGMENTS) {
+        printf("Error: more than %d loadable segments\n", LOAD_MAX_SEGMENTS);
+        return NULL;
+    }
+    len = (len + 3) & ~3u;
+    seg = &PROGRAM_IMAGE.segs[PROGRAM_IMAGE.num_segs];
+    seg->bytes = calloc(len ? len : 4, 1);
+    if (seg->bytes == NULL) {
+        printf("Error: out of memory loading segment at 0x%08x\n", addr);
+        return NULL;
+    }
+    seg->addr = addr;
+    seg->len = len;
+    seg->exec = exec;
+    PROGRAM_IMAGE.num_segs++;
+    PROGRAM_IMAGE.words += len / 4;
+    if (exec && PROGRAM_IMAGE.text_words == 0) {
+        PROGRAM_IMAGE.text_start = addr;
+        PROGRAM_IMAGE.text_words = len / 4;
+    }
+    return seg;
+}
+
+static uint32_t read_field(const uint8_t *p, int size)
+{
+    uint32_t v = 0;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        v |= (uint32_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+/***************************************************************/
+/* One hex word per line                                                                                          */
+/***************************************************************/
+static int load_hex(const char *file, const uint8_t *data, size_t size)
+{
+    load_segment_t *seg;
+    uint32_t *words = NULL, cap = 0, n = 0, word, i;
+    size_t pos = 0;
+    int line = 1, digits, c;
+
+    while (pos < size) {
+        c = data[pos];
+        if (c == '\n' || c == ' ' || c == '\t' || c == '\r') {
+            line += c == '\n';
+            pos++;
+            continue;
+        }
+        if (c == '0' && pos + 1 < size && (data[pos+1] == 'x' || data[pos+1] == 'X')) {
+            pos += 2;
+        }
+        word = 0;
+        for (digits = 0; pos < size; digits++, pos++) {
+            c = data[pos];
+            if (c >= '0' && c <= '9') {
+                c -= '0';
+            } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+                c = (c | 0x20) - 'a' + 10;
+            } else {
+                break;
+            }
+            word = (word << 4) | c;
+        }
+        if (digits == 0 || digits > 8 || (pos < size && !strchr(" \t\r\n", data[pos]))) {
+            printf("Error: %s:%d is not a hex word\n", file, line);
+            free(words);
+            return -1;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            words = realloc(words, cap * sizeof(uint32_t));
+            if (words == NULL) {
+                printf("Error: out of memory reading %s\n", file);
+                return -1;
+            }
+        }
+        words[n++] = word;
+    }
+
+    seg = add_segment(MEM_TEXT_BEGIN, n * 4, TRUE);
+    if (seg != NULL) {
+        for (i = 0; i < n; i++) {
+            seg->bytes[i*4 + 0] = words[i];
+            seg->bytes[i*4 + 1] = words[i] >> 8;
+            seg->bytes[i*4 + 2] = words[i] >> 16;
+            seg->bytes[i*4 + 3] = words[i] >> 24;
+        }
+    }
+    free(words);
+    return seg ? 0 : -1;
+}
+
+/***************************************************************/
+/* Raw words, the whole file is text                                                                    */
+/***************************************************************/
+static int load_bin(const uint8_t *data, size_t size)
+{
+    load_segment_t *seg;
+
+    if (size > MEM_TEXT_END - MEM_TEXT_BEGIN + 1) {
+        printf("Error: raw image of %zu bytes does not fit in the text segment\n", size);
+        return -1;
+    }
+    seg = add_segment(MEM_TEXT_BEGIN, size, TRUE);
+    if (seg == NULL) {
+        return -1;
+    }
+    memcpy(seg->bytes, data, size);
+    return 0;
+}
+
+/***************************************************************/
+/* 32-bit MIPS ELF executable                                                                                */
+/***************************************************************/
+static int load_elf(const char *file, const uint8_t *data, size_t size)
+{
+    const uint8_t *ph;
+    load_segment_t *seg;
+    uint32_t phoff, phentsize, phnum, offset, vaddr, filesz, memsz, flags, i;
+
+    if (size < ELF_HDR_SIZE || data[ELF_EI_CLASS] != 1 || (data[ELF_EI_DATA] != 1 && data[ELF_EI_DATA] != 2)) {
+        printf("Error: %s is not a 32-bit ELF file\n", file);
+        return -1;
+    }
+    /* memory.c is little-endian only, swapping words would still leave byte and halfword accesses wrong */
+    if (data[ELF_EI_DATA] == 2) {
+        printf("Error: %s is a big-endian executable, only little-endian MIPS is simulated\n", file);
+        return -1;
+    }
+    if (read_field(data + ELF_E_MACHINE, 2) != ELF_EM_MIPS) {
+        printf("Error: %s is not a MIPS executable\n", file);
+        return -1;
+    }
+    PROGRAM_IMAGE.entry = read_field(data + ELF_E_ENTRY, 4);
+    phoff = read_field(data + ELF_E_PHOFF, 4);
+    phentsize = read_field(data + ELF_E_PHENTSIZE, 2);
+    phnum = read_field(data + ELF_E_PHNUM, 2);
+    if (phentsize < ELF_PH_SIZE || phoff > size || (uint64_t)phnum * phentsize > size - phoff) {
+        printf("Error: %s has a truncated program header table\n", file);
+        return -1;
+    }
+
+    for (i = 0; i < phnum; i++) {
+        ph = data + phoff + i * phentsize;
+        if (read_field(ph, 4) != ELF_PT_LOAD) {
+            continue;
+        }
+        offset = read_field(ph + 4, 4);
+        vaddr = read_field(ph + 8, 4);
+        filesz = read_field(ph + 16, 4);
+        memsz = read_field(ph + 20, 4);
+        flags = read_field(ph + 24, 4);
+        if (offset > size || filesz > size - offset || filesz > memsz) {
+            printf("Error: %s segment at 0x%08x lies outside the file\n", file, vaddr);
+            return -1;
+        }
+        /* memory is zero after reset, so .bss needs no bytes of its own */
+        seg = add_segment(vaddr, filesz, flags & ELF_PF_X);
+        if (seg == NULL) {
+            return -1;
+        }
+        memcpy(seg->bytes, data + offset, filesz);
+    }
+    if (PROGRAM_IMAGE.num_segs == 0) {
+        printf("Error: %s has no loadable segments\n", file);
+        return -1;
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Copy every segment into simulated memory                                                       */
+/***************************************************************/
+int loader_restore()
+{
+    const load_segment_t *seg;
+    int i;
+
+    for (i = 0; i < PROGRAM_IMAGE.num_segs; i++) {
+        seg = &PROGRAM_IMAGE.segs[i];
+        if (mem_write_block(seg->addr, seg->bytes, seg->len) != 0) {
+            printf("Error: segment 0x%08x..0x%08x is outside simulated memory\n", seg->addr, seg->addr + seg->len - 1);
+            return -1;
+        }
+        TRACE(TRACE_INST, "segment 0x%08x: %u bytes%s\n", seg->addr, seg->len, seg->exec ? " (text)" : "");
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Map file and load it in the given format                                                             */
+/***************************************************************/
+int loader_load(const char *file, load_format_t format)
+{
+    const uint8_t *data = NULL;
+    struct stat st;
+    size_t len;
+    int fd, ret;
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printf("Error: Can't open program file %s\n", file);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if (st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            printf("Error: Can't map program file %s\n", file);
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    len = st.st_size;
+
+    if (format == LOAD_AUTO) {
+        if (len >= 4 && memcmp(data, "\177ELF", 4) == 0) {
+            format = LOAD_ELF;
+        } else if (strlen(file) > 4 && strcmp(file + strlen(file) - 4, ".bin") == 0) {
+            format = LOAD_BIN_LE;
+        } else {
+            format = LOAD_HEX;
+        }
+    }
+
+    loader_release();
+    PROGRAM_IMAGE.format = format;
+    PROGRAM_IMAGE.entry = MEM_TEXT_BEGIN;
+    switch (format) {
+        case LOAD_ELF:
+            ret = load_elf(file, data, len);
+            break;
+        case LOAD_BIN_BE:
+            printf("Error: %s: big-endian raw images are not supported, only little-endian MIPS is simulated (use bin-le)\n", file);
+            ret = -1;
+            break;
+        case LOAD_BIN_LE:
+            ret = load_bin(data, len);
+            break;
+        default:
+            ret = load_hex(file, data, len);
+            break;
+    }
+    if (data != NULL) {
+        munmap((void *)data, len);
+    }
+    if (ret == 0) {
+        ret = loader_restore();
+    }
+    return ret;
+}
+
+int loader_parse_format(const char *name)
+{
+    int i;
+
+    for (i = 0; i < LOAD_FORMATS; i++) {
+        if (strcmp(name, FORMAT_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *loader_format_name(int format)
+{
+    return (format >= 0 && format < LOAD_FORMATS) ? FORMAT_NAMES[format] : "?";
+}
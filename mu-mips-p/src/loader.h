@@ -0,0 +1,50 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/***************************************************************/
+/* Program loader                                                                                                   */
+/***************************************************************/
+typedef enum {
+	LOAD_AUTO = 0,      /* ELF by magic, .bin as little-endian raw, anything else hex */
+	LOAD_HEX,           /* one hex word per line at MEM_TEXT_BEGIN */
+	LOAD_BIN_BE,        /* raw big-endian words, rejected since memory is little-endian */
+	LOAD_BIN_LE,        /* raw little-endian words at MEM_TEXT_BEGIN */
+	LOAD_ELF,           /* 32-bit MIPS ELF executable, PT_LOAD segments */
+	LOAD_FORMATS
+} load_format_t;
+
+#define LOAD_MAX_SEGMENTS 16
+
+typedef struct {
+	uint32_t addr;
+	uint32_t len;           /* bytes, rounded up to whole words */
+	int exec;               /* holds instructions to predecode */
+	uint8_t *bytes;         /* in simulated byte order, kept so reset() can restore it */
+} load_segment_t;
+
+typedef struct {
+	load_format_t format;
+	load_segment_t segs[LOAD_MAX_SEGMENTS];
+	int num_segs;
+	uint32_t entry;
+	uint32_t words;         /* total over all segments */
+	uint32_t text_start;    /* first executable segment */
+	uint32_t text_words;
+} program_image_t;
+
+extern SIM_LOCAL program_image_t PROGRAM_IMAGE;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int loader_load(const char *file, load_format_t format);
+int loader_restore();
+void loader_release();
+int loader_parse_format(const char *name);
+const char *loader_format_name(int format);
+
+#endif
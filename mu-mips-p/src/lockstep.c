@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "stats.h"
+#include "funcsim.h"
+#include "dbt.h"
+#include "lockstep.h"
+
+static SIM_LOCAL lockstep_t *LS;
+
+/***************************************************************/
+/* Vector kernels                                                                                                     */
+/***************************************************************/
+/* Written with GCC vector types, eight lanes per step. On x86-64 each kernel is
+ * built twice and the AVX2 copy is picked at load time where the host has it,
+ * the default copy uses SSE2. Lane counts are rounded up to LS_VEC, the slots
+ * past the convoy hold garbage that is never looked at. */
+typedef uint32_t vec_t __attribute__((vector_size(4 * LS_VEC)));
+typedef int32_t svec_t __attribute__((vector_size(4 * LS_VEC)));
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define LS_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define LS_KERNEL
+#endif
+
+/* d = a op b for the three-register ALU operations */
+static LS_KERNEL void k_rr(int op, uint32_t *d, const uint32_t *a, const uint32_t *b, uint32_t n)
+{
+    vec_t *vd = (vec_t *)d;
+    const vec_t *va = (const vec_t *)a, *vb = (const vec_t *)b;
+    uint32_t i;
+
+    n /= LS_VEC;
+    switch (op) {
+        case OP_ADD: case OP_ADDU:
+            for (i = 0; i < n; i++) vd[i] = va[i] + vb[i];
+            break;
+        case OP_SUB: case OP_SUBU:
+            for (i = 0; i < n; i++) vd[i] = va[i] - vb[i];
+            break;
+        case OP_AND:
+            for (i = 0; i < n; i++) vd[i] = va[i] & vb[i];
+            break;
+        case OP_OR:
+            for (i = 0; i < n; i++) vd[i] = va[i] | vb[i];
+            break;
+        case OP_XOR:
+            for (i = 0; i < n; i++) vd[i] = va[i] ^ vb[i];
+            break;
+        case OP_NOR:
+            for (i = 0; i < n; i++) vd[i] = ~(va[i] | vb[i]);
+            break;
+        default: /* OP_SLT */
+            for (i = 0; i < n; i++) vd[i] = -(vec_t)((svec_t)va[i] < (svec_t)vb[i]);
+            break;
+    }
+}
+
+/* d = a op imm for the immediate forms */
+static LS_KERNEL void k_ri(int op, uint32_t *d, const uint32_t *a, uint32_t imm, uint32_t n)
+{
+    vec_t *vd = (vec_t *)d;
+    const vec_t *va = (const vec_t *)a;
+    uint32_t i;
+
+    n /= LS_VEC;
+    switch (op) {
+        case OP_ADDI: case OP_ADDIU:
+            for (i = 0; i < n; i++) vd[i] = va[i] + imm;
+            break;
+        case OP_ANDI:
+            for (i = 0; i < n; i++) vd[i] = va[i] & imm;
+            break;
+        case OP_ORI:
+            for (i = 0; i < n; i++) vd[i] = va[i] | imm;
+            break;
+        case OP_XORI:
+            for (i = 0; i < n; i++) vd[i] = va[i] ^ imm;
+            break;
+        default: /* OP_SLTI */
+            for (i = 0; i < n; i++) vd[i] = -(vec_t)((svec_t)va[i] < (int32_t)imm);
+            break;
+    }
+}
+
+static LS_KERNEL void k_shift(int op, uint32_t *d, const uint32_t *a, uint32_t sh, uint32_t n)
+{
+    vec_t *vd = (vec_t *)d;
+    const vec_t *va = (const vec_t *)a;
+    uint32_t i;
+
+    n /= LS_VEC;
+    switch (op) {
+        case OP_SLL:
+            for (i = 0; i < n; i++) vd[i] = va[i] << sh;
+            break;
+        case OP_SRL:
+            for (i = 0; i < n; i++) vd[i] = va[i] >> sh;
+            break;
+        default: /* OP_SRA */
+            for (i = 0; i < n; i++) vd[i] = (vec_t)((svec_t)va[i] >> sh);
+            break;
+    }
+}
+
+static LS_KERNEL void k_splat(uint32_t *d, uint32_t v, uint32_t n)
+{
+    vec_t *vd = (vec_t *)d;
+    uint32_t i;
+
+    n /= LS_VEC;
+    for (i = 0; i < n; i++) vd[i] = (vec_t){} + v;
+}
+
+/* key = branch condition per lane, only its uniformity and first value matter */
+static LS_KERNEL void k_cond(int op, uint32_t *key, const uint32_t *a, const uint32_t *b, uint32_t n)
+{
+    vec_t *vk = (vec_t *)key;
+    const vec_t *va = (const vec_t *)a, *vb = (const vec_t *)b;
+    uint32_t i;
+
+    n /= LS_VEC;
+    switch (op) {
+        case OP_BEQ:
+            for (i = 0; i < n; i++) vk[i] = (vec_t)(va[i] == vb[i]);
+            break;
+        case OP_BNE:
+            for (i = 0; i < n; i++) vk[i] = (vec_t)(va[i] != vb[i]);
+            break;
+        case OP_BLEZ:
+            for (i = 0; i < n; i++) vk[i] = (vec_t)((svec_t)va[i] <= 0);
+            break;
+        case OP_BGTZ:
+            for (i = 0; i < n; i++) vk[i] = (vec_t)((svec_t)va[i] > 0);
+            break;
+        case OP_BLTZ:
+            for (i = 0; i < n; i++) vk[i] = (vec_t)((svec_t)va[i] < 0);
+            break;
+        default: /* OP_BGEZ */
+            for (i = 0; i < n; i++) vk[i] = (vec_t)((svec_t)va[i] >= 0);
+            break;
+    }
+}
+
+/* mult and div per lane, div by zero keeps HI and LO like exec_div() */
+static LS_KERNEL void k_muldiv(int op, uint32_t *hi, uint32_t *lo, const uint32_t *a, const uint32_t *b, uint32_t n)
+{
+    uint64_t p;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        switch (op) {
+            case OP_MULT:
+                p = (uint64_t)((int64_t)(int32_t)a[i] * (int32_t)b[i]);
+                break;
+            case OP_MULTU:
+                p = (uint64_t)a[i] * b[i];
+                break;
+            case OP_DIV:
+                if (b[i] == 0 || (a[i] == 0x80000000 && b[i] == 0xFFFFFFFF)) {
+                    continue;
+                }
+                p = ((uint64_t)(uint32_t)((int32_t)a[i] % (int32_t)b[i]) << 32) | (uint32_t)((int32_t)a[i] / (int32_t)b[i]);
+                break;
+            default: /* OP_DIVU */
+                if (b[i] == 0) {
+                    continue;
+                }
+                p = ((uint64_t)(a[i] % b[i]) << 32) | (a[i] / b[i]);
+                break;
+        }
+        lo[i] = (uint32_t)p;
+        hi[i] = (uint32_t)(p >> 32);
+    }
+}
+
+static LS_KERNEL int k_uniform(const uint32_t *key, uint32_t n)
+{
+    uint32_t i, diff = 0;
+
+    for (i = 0; i < n; i++) {
+        diff |= key[i] ^ key[0];
+    }
+    return diff == 0;
+}
+
+/***************************************************************/
+/* Send the convoy slots whose key differs from slot 0 off on their own      */
+/***************************************************************/
+/* Runs before the instruction at LS->pc, which the lanes that leave execute
+ * again on the scalar path. Slot 0 never leaves. */
+static void diverge(const uint32_t *key)
+{
+    lane_t *lane;
+    uint32_t i, j, r;
+
+    if (k_uniform(key, LS->n)) {
+        return;
+    }
+    for (i = 0, j = 0; i < LS->n; i++) {
+        if (key[i] == key[0]) {
+            if (i != j) {
+                for (r = 0; r < MIPS_REGS; r++) {
+                    LS->regs[r][j] = LS->regs[r][i];
+                }
+                LS->hi[j] = LS->hi[i];
+                LS->lo[j] = LS->lo[i];
+                LS->id[j] = LS->id[i];
+            }
+            j++;
+            continue;
+        }
+        lane = &LS->lanes[LS->id[i]];
+        for (r = 0; r < MIPS_REGS; r++) {
+            lane->state.REGS[r] = LS->regs[r][i];
+        }
+        lane->state.HI = LS->hi[i];
+        lane->state.LO = LS->lo[i];
+        lane->state.PC = LS->pc;
+        lane->count = LS->executed;
+        lane->split = LS->executed;
+        lane->left = TRUE;
+        if (mem_snapshot(&lane->mem) != 0) {
+            printf("Error: out of memory splitting instance %u off\n", LS->id[i]);
+            lane->left = FALSE;
+            lane->status = LANE_LIMIT;
+        }
+        LS->splits++;
+    }
+    LS->n = j;
+}
+
+/***************************************************************/
+/* Run the convoy until it halts or reaches max instructions                               */
+/***************************************************************/
+static void run_convoy(uint64_t max)
+{
+    const decoded_inst_t *d;
+    uint32_t (*R)[LS_MAX_LANES] = LS->regs;
+    uint32_t n, next, value;
+    int halted = FALSE;
+
+    while (LS->executed < max && !halted) {
+        d = decode_fetch(LS->pc);
+        n = (LS->n + LS_VEC - 1) & ~(LS_VEC - 1);
+        next = LS->pc + 4;
+        switch (d->op) {
+            case OP_SLL: case OP_SRL: case OP_SRA:
+                if (d->dest != 0) k_shift(d->op, R[d->dest], R[d->rt], d->shamt, n);
+                break;
+            case OP_ADD: case OP_ADDU: case OP_SUB: case OP_SUBU:
+            case OP_AND: case OP_OR: case OP_XOR: case OP_NOR: case OP_SLT:
+                if (d->dest != 0) k_rr(d->op, R[d->dest], R[d->rs], R[d->rt], n);
+                break;
+            case OP_ADDI: case OP_ADDIU: case OP_SLTI: case OP_ANDI: case OP_ORI: case OP_XORI:
+                if (d->dest != 0) k_ri(d->op, R[d->dest], R[d->rs], d->imm, n);
+                break;
+            case OP_LUI:
+                if (d->dest != 0) k_splat(R[d->dest], d->imm << 16, n);
+                break;
+            case OP_MFHI: case OP_MFLO:
+                if (d->dest != 0) memcpy(R[d->dest], d->op == OP_MFHI ? LS->hi : LS->lo, n * sizeof(uint32_t));
+                break;
+            case OP_MTHI: case OP_MTLO:
+                memcpy(d->op == OP_MTHI ? LS->hi : LS->lo, R[d->rs], n * sizeof(uint32_t));
+                break;
+            case OP_MULT: case OP_MULTU: case OP_DIV: case OP_DIVU:
+                k_muldiv(d->op, LS->hi, LS->lo, R[d->rs], R[d->rt], n);
+                break;
+            case OP_LB: case OP_LH: case OP_LW: case OP_LL:
+                k_ri(OP_ADDIU, LS->key, R[d->rs], d->imm, n);
+                diverge(LS->key);
+                value = func_access(d, LS->key[0], 0);
+                if (d->dest != 0) k_splat(R[d->dest], value, n);
+                break;
+            case OP_SB: case OP_SH: case OP_SW: case OP_SC:
+                k_ri(OP_ADDIU, LS->key, R[d->rs], d->imm, n);
+                diverge(LS->key);
+                value = LS->key[0];
+                /* only the stored bytes have to agree */
+                k_ri(OP_ANDI, LS->key, R[d->rt], d->op == OP_SB ? 0xFF : d->op == OP_SH ? 0xFFFF : 0xFFFFFFFF, n);
+                diverge(LS->key);
+                value = func_access(d, value, R[d->rt][0]);
+                if (d->op == OP_SC && d->dest != 0) k_splat(R[d->dest], value, n);
+                break;
+            case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ: case OP_BLTZ: case OP_BGEZ:
+                k_cond(d->op, LS->key, R[d->rs], R[d->rt], n);
+                diverge(LS->key);
+                if (LS->key[0]) {
+                    next = LS->pc + 4 + d->imm;
+                }
+                break;
+            case OP_J: case OP_JAL:
+                if (d->op == OP_JAL) k_splat(R[31], LS->pc + 4, n);
+                next = ((LS->pc + 4) & 0xF0000000) | d->imm;
+                break;
+            case OP_JR: case OP_JALR:
+                diverge(R[d->rs]);
+                next = R[d->rs][0];
+                if (d->op == OP_JALR && d->dest != 0) k_splat(R[d->dest], LS->pc + 4, n);
+                break;
+            default:
+                /* syscall halts, anything else does nothing, as in func_run() */
+                halted = (d->flags & INST_HALT) != 0;
+                break;
+        }
+        LS->executed++;
+        LS->pc = next;
+    }
+
+    for (n = 0; n < LS->n; n++) {
+        lane_t *lane = &LS->lanes[LS->id[n]];
+        uint32_t r;
+
+        for (r = 0; r < MIPS_REGS; r++) {
+            lane->state.REGS[r] = R[r][n];
+        }
+        lane->state.HI = LS->hi[n];
+        lane->state.LO = LS->lo[n];
+        lane->state.PC = LS->pc;
+        lane->count = LS->executed;
+        lane->status = halted ? LANE_HALTED : LANE_LIMIT;
+    }
+}
+
+/***************************************************************/
+/* Read one instance per line, <reg>=<val> pairs over the current registers */
+/***************************************************************/
+static int read_instances(const char *file, const CPU_State *base)
+{
+    char line[512], *tok, *eq, *end;
+    lane_t *lane;
+    unsigned long reg;
+    uint32_t value;
+    FILE *fp = fopen(file, "r");
+    int lineno = 0;
+
+    if (fp == NULL) {
+        printf("Error: Can't open sweep file %s\n", file);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        if ((tok = strchr(line, '#')) != NULL) {
+            *tok = '\0';
+        }
+        if ((tok = strtok(line, " \t\r\n")) == NULL) {
+            continue;
+        }
+        if (LS->num_lanes == LS_MAX_LANES) {
+            printf("Error: %s has more than %d instances\n", file, LS_MAX_LANES);
+            fclose(fp);
+            return -1;
+        }
+        lane = &LS->lanes[LS->num_lanes++];
+        memset(lane, 0, sizeof(*lane));
+        lane->state = *base;
+        for (; tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+            if ((eq = strchr(tok, '=')) == NULL) {
+                break;
+            }
+            *eq = '\0';
+            value = strtoul(eq + 1, &end, 0);
+            if (*end != '\0') {
+                break;
+            }
+            if (strcmp(tok, "hi") == 0) {
+                lane->state.HI = value;
+            } else if (strcmp(tok, "lo") == 0) {
+                lane->state.LO = value;
+            } else if ((reg = strtoul(tok, &end, 10)) > 0 && reg < MIPS_REGS && *end == '\0') {
+                lane->state.REGS[reg] = value;
+            } else {
+                break;
+            }
+        }
+        if (tok != NULL) {
+            printf("Error: %s:%d: expected <reg>=<value>, hi=<value> or lo=<value>\n", file, lineno);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    if (LS->num_lanes == 0) {
+        printf("Error: %s holds no instances\n", file);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_lanes(double elapsed)
+{
+    static const char *status_names[] = { "running", "halted", "limit" };
+    const lane_t *lane;
+    uint64_t total = 0;
+    uint32_t i;
+
+    printf("-------------------------------------------------------------\n");
+    printf("[Instance]\t[Status]\t[Instructions]\t[PC]\t\t[$2]\t\t[$3]\t\t[Lockstep]\n");
+    printf("-------------------------------------------------------------\n");
+    for (i = 0; i < LS->num_lanes; i++) {
+        lane = &LS->lanes[i];
+        printf("%u\t\t%s\t\t%llu\t\t0x%08x\t0x%08x\t0x%08x\t", i, status_names[lane->status],
+               (unsigned long long)lane->count, lane->state.PC, lane->state.REGS[2], lane->state.REGS[3]);
+        if (lane->left) {
+            printf("%llu\n", (unsigned long long)lane->split);
+        } else {
+            printf("all\n");
+        }
+        total += lane->count;
+    }
+    printf("-------------------------------------------------------------\n");
+    printf("%u instances, %u left the convoy, %llu instructions in %.3f s (%.1f ns/inst)\n\n", LS->num_lanes, LS->splits,
+           (unsigned long long)total, elapsed, total ? elapsed * 1e9 / total : 0.0);
+}
+
+/***************************************************************/
+/* Run the program from the current state once per instance in file            */
+/***************************************************************/
+/* The simulator is put back as it was afterwards, only the table remains. */
+int lockstep_sweep(const char *file, uint64_t max)
+{
+    CPU_State base;
+    mem_snapshot_t base_mem;
+    sim_stats_t base_stats;
+    uint32_t base_count = INSTRUCTION_COUNT, i, r;
+    int base_run = RUN_FLAG;
+    struct timespec t0, t1;
+    lane_t *lane;
+    uint64_t n;
+
+    if (RUN_FLAG == FALSE) {
+        printf("Simulation Stopped\n\n");
+        return -1;
+    }
+    drain_pipeline();
+    base = CURRENT_STATE;
+    base_stats = STATS;
+    LS = aligned_alloc(32, sizeof(lockstep_t));
+    if (LS == NULL || (LS->lanes = calloc(LS_MAX_LANES, sizeof(lane_t))) == NULL) {
+        printf("Error: out of memory allocating sweep\n");
+        free(LS);
+        LS = NULL;
+        return -1;
+    }
+    LS->num_lanes = 0;
+    if (read_instances(file, &base) != 0 || mem_snapshot(&base_mem) != 0) {
+        free(LS->lanes);
+        free(LS);
+        LS = NULL;
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    memset(LS->regs, 0, sizeof(LS->regs));
+    for (i = 0; i < LS->num_lanes; i++) {
+        for (r = 1; r < MIPS_REGS; r++) {
+            LS->regs[r][i] = LS->lanes[i].state.REGS[r];
+        }
+        LS->hi[i] = LS->lanes[i].state.HI;
+        LS->lo[i] = LS->lanes[i].state.LO;
+        LS->id[i] = i;
+    }
+    LS->n = LS->num_lanes;
+    LS->pc = base.PC;
+    LS->executed = 0;
+    LS->splits = 0;
+    run_convoy(max);
+
+    /* the instances that left finish one at a time from their own snapshot */
+    for (i = 0; i < LS->num_lanes; i++) {
+        lane = &LS->lanes[i];
+        if (!lane->left) {
+            continue;
+        }
+        mem_restore(&lane->mem);
+        mem_snapshot_free(&lane->mem);
+        CURRENT_STATE = lane->state;
+        RUN_FLAG = TRUE;
+        n = dbt_run(max - lane->count);
+        lane->count += n;
+        lane->status = RUN_FLAG ? LANE_LIMIT : LANE_HALTED;
+        lane->state = CURRENT_STATE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    mem_restore(&base_mem);
+    mem_snapshot_free(&base_mem);
+    CURRENT_STATE = base;
+    NEXT_STATE = base;
+    RUN_FLAG = base_run;
+    INSTRUCTION_COUNT = base_count;
+    STATS = base_stats;
+
+    print_lanes((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+    free(LS->lanes);
+    free(LS);
+    LS = NULL;
+    return 0;
+}
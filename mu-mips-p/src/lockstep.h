@@ -0,0 +1,55 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/***************************************************************/
+/* Lockstep sweeps of one program over many initial register sets           */
+/***************************************************************/
+/* The instances of a sweep share one PC and keep their registers in
+ * struct-of-arrays form, so every ALU operation runs as a vector kernel across
+ * the convoy (AVX2 where the host has it). An instance whose branch outcome,
+ * jump target, memory address or store value differs from the first one
+ * leaves the convoy with a copy-on-write snapshot of memory and finishes
+ * afterwards on the dbt engine. */
+#define LS_MAX_LANES    1024
+#define LS_VEC          8               /* lanes per kernel step */
+#define LS_DEFAULT_MAX  100000000       /* instructions per instance */
+
+typedef enum {
+	LANE_RUNNING = 0,
+	LANE_HALTED,
+	LANE_LIMIT
+} lane_status_t;
+
+typedef struct {
+	lane_status_t status;
+	uint64_t count;                 /* instructions executed */
+	uint64_t split;                 /* convoy instructions before it left */
+	int left;                       /* TRUE once it ran on its own */
+	CPU_State state;                /* at the split, then final */
+	mem_snapshot_t mem;             /* memory at the split */
+} lane_t;
+
+typedef struct {
+	uint32_t regs[MIPS_REGS][LS_MAX_LANES] __attribute__((aligned(32)));
+	uint32_t hi[LS_MAX_LANES] __attribute__((aligned(32)));
+	uint32_t lo[LS_MAX_LANES] __attribute__((aligned(32)));
+	uint32_t key[LS_MAX_LANES] __attribute__((aligned(32)));   /* per lane branch outcome or address */
+	uint32_t id[LS_MAX_LANES];      /* lane of each convoy slot */
+	uint32_t n;                     /* slots still in the convoy */
+	uint32_t pc;
+	uint64_t executed;              /* convoy instructions */
+	uint32_t splits;
+	lane_t *lanes;
+	uint32_t num_lanes;
+} lockstep_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int lockstep_sweep(const char *file, uint64_t max);
+
+#endif
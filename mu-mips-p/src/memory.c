@@ -0,0 +1,641 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+/* regions only gate which addresses are valid, storage lives in the page table */
+mem_region_t MEM_REGIONS[NUM_MEM_REGION] = {
+	{ MEM_TEXT_BEGIN, MEM_TEXT_END },
+	{ MEM_DATA_BEGIN, MEM_DATA_END },
+	{ MEM_KDATA_BEGIN, MEM_KDATA_END },
+	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END }
+};
+
+static SIM_LOCAL mem_t MEMORY;
+
+/* the page table in use, this thread's own unless it shares another one */
+#define STORE (MEMORY.shared != NULL ? MEMORY.shared : &MEMORY.own)
+
+/* word view of page data for atomic access */
+typedef uint32_t __attribute__((may_alias)) mem_word_t;
+
+static void store_lock(mem_store_t *store)
+{
+    while (__atomic_test_and_set(&store->lock, __ATOMIC_ACQUIRE)) {
+    }
+}
+
+static void store_unlock(mem_store_t *store)
+{
+    __atomic_clear(&store->lock, __ATOMIC_RELEASE);
+}
+
+/***************************************************************/
+/* Return the index of the region holding address, or -1                                  */
+/***************************************************************/
+int mem_region_of(uint32_t address)
+{
+    int i;
+    for (i = 0; i < NUM_MEM_REGION; i++) {
+        if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/***************************************************************/
+/* Look up the page holding address, NULL if never written                              */
+/***************************************************************/
+/* tables and pages are published with release stores, so no lock is needed */
+static mem_page_t *page_lookup(uint32_t address)
+{
+    mem_page_t **table = __atomic_load_n(&STORE->dir[MEM_DIR_INDEX(address)], __ATOMIC_ACQUIRE);
+    if (table == NULL) {
+        return NULL;
+    }
+    return __atomic_load_n(&table[MEM_TABLE_INDEX(address)], __ATOMIC_ACQUIRE);
+}
+
+/***************************************************************/
+/* Look up the page holding address, allocating it on first touch                  */
+/***************************************************************/
+static mem_page_t *page_touch(uint32_t address)
+{
+    mem_store_t *store = STORE;
+    mem_page_t ***slot = &store->dir[MEM_DIR_INDEX(address)];
+    mem_page_t **table, *page = page_lookup(address);
+
+    if (page != NULL) {
+        return page;
+    }
+    store_lock(store);
+    table = *slot;
+    if (table == NULL) {
+        table = calloc(MEM_TABLE_SIZE, sizeof(mem_page_t *));
+        if (table == NULL) {
+            printf("Error: out of memory allocating page table\n");
+            exit(-1);
+        }
+        __atomic_store_n(slot, table, __ATOMIC_RELEASE);
+    }
+    page = table[MEM_TABLE_INDEX(address)];
+    if (page == NULL) {
+        page = calloc(1, sizeof(mem_page_t));
+        if (page == NULL) {
+            printf("Error: out of memory allocating page 0x%08x\n", address & ~MEM_PAGE_MASK);
+            exit(-1);
+        }
+        page->vpn = MEM_PAGE_NUM(address);
+        store->pages++;
+        __atomic_store_n(&table[MEM_TABLE_INDEX(address)], page, __ATOMIC_RELEASE);
+    }
+    store_unlock(store);
+    return page;
+}
+
+/***************************************************************/
+/* Look up a page for writing and remember that it is dirty                               */
+/***************************************************************/
+static mem_page_t *page_dirty(uint32_t address)
+{
+    mem_store_t *store = STORE;
+    mem_page_t *page = page_touch(address);
+
+    store_lock(store);
+    if (!(page->flags & MEM_PAGE_DIRTY)) {
+        if (store->num_dirty == store->max_dirty) {
+            store->max_dirty = store->max_dirty ? store->max_dirty * 2 : 64;
+            store->dirty = realloc(store->dirty, store->max_dirty * sizeof(mem_page_t *));
+            if (store->dirty == NULL) {
+                printf("Error: out of memory tracking dirty pages\n");
+                exit(-1);
+            }
+        }
+        store->dirty[store->num_dirty++] = page;
+        page->flags |= MEM_PAGE_DIRTY;
+    }
+    store_unlock(store);
+    return page;
+}
+
+/***************************************************************/
+/* Drop a reference to a snapshot frame                                                                 */
+/***************************************************************/
+static void frame_put(mem_frame_t *frame)
+{
+    if (frame != NULL && --frame->refs == 0) {
+        free(frame);
+    }
+}
+
+/***************************************************************/
+/* Host side loads/stores of little endian simulated words                                   */
+/***************************************************************/
+static inline uint32_t load_le32(const uint8_t *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+#else
+    return (p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+#endif
+}
+
+static inline void store_le32(uint8_t *p, uint32_t v)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(p, &v, 4);
+#else
+    p[3] = (v >> 24) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[1] = (v >>  8) & 0xFF;
+    p[0] = (v >>  0) & 0xFF;
+#endif
+}
+
+/***************************************************************/
+/* Translate address for reading, NULL if outside every region or never written */
+/***************************************************************/
+static mem_page_t *translate_read(uint32_t address)
+{
+    mem_tlb_entry_t *e = &MEMORY.rtlb[MEM_TLB_INDEX(address)];
+    mem_page_t *page;
+
+    if (e->vpn == MEM_PAGE_NUM(address)) {
+        return e->page;
+    }
+    if (mem_region_of(address) < 0) {
+        return NULL;
+    }
+    page = page_lookup(address);
+    if (page != NULL) {
+        e->vpn = MEM_PAGE_NUM(address);
+        e->page = page;
+    }
+    return page;
+}
+
+/***************************************************************/
+/* Translate address for writing, NULL if outside every region                           */
+/***************************************************************/
+static mem_page_t *translate_write(uint32_t address)
+{
+    mem_tlb_entry_t *e = &MEMORY.wtlb[MEM_TLB_INDEX(address)];
+    mem_page_t *page;
+
+    if (e->vpn == MEM_PAGE_NUM(address)) {
+        return e->page;
+    }
+    if (mem_region_of(address) < 0) {
+        return NULL;
+    }
+    page = page_dirty(address);
+    /* the page no longer matches the snapshot image it shared */
+    if (page->frame != NULL) {
+        frame_put(page->frame);
+        page->frame = NULL;
+    }
+    /* hooked pages stay out of the cache so every write reaches notify_write() */
+    if (!(page->flags & MEM_PAGE_HOOKED)) {
+        e->vpn = MEM_PAGE_NUM(address);
+        e->page = page;
+    }
+    return page;
+}
+
+/***************************************************************/
+/* Tell the write hooks about a store into a hooked page                                      */
+/***************************************************************/
+static void notify_write(mem_page_t *page, uint32_t address, uint32_t size)
+{
+    int i;
+    if (page->flags & MEM_PAGE_HOOKED) {
+        for (i = 0; i < MEMORY.num_hooks; i++) {
+            MEMORY.hooks[i](address, size);
+        }
+    }
+}
+
+/***************************************************************/
+/* Single byte accessors, also used when an access straddles two pages          */
+/***************************************************************/
+uint32_t mem_read_8(uint32_t address)
+{
+    mem_page_t *page = translate_read(address);
+    return page ? page->data[address & MEM_PAGE_MASK] : 0;
+}
+
+void mem_write_8(uint32_t address, uint32_t value)
+{
+    mem_page_t *page = translate_write(address);
+    if (page != NULL) {
+        page->data[address & MEM_PAGE_MASK] = value & 0xFF;
+        notify_write(page, address, 1);
+    }
+}
+
+/***************************************************************/
+/* Read a 16-bit halfword from memory                                                                    */
+/***************************************************************/
+uint32_t mem_read_16(uint32_t address)
+{
+    uint32_t offset = address & MEM_PAGE_MASK;
+    mem_page_t *page;
+
+    if (offset > MEM_PAGE_SIZE - 2) {
+        return (mem_read_8(address+1) << 8) | mem_read_8(address);
+    }
+    page = translate_read(address);
+    if (page == NULL) {
+        return 0;
+    }
+    return (page->data[offset+1] << 8) | page->data[offset];
+}
+
+/***************************************************************/
+/* Write a 16-bit halfword to memory                                                                       */
+/***************************************************************/
+void mem_write_16(uint32_t address, uint32_t value)
+{
+    uint32_t offset = address & MEM_PAGE_MASK;
+    mem_page_t *page;
+
+    if (offset > MEM_PAGE_SIZE - 2) {
+        mem_write_8(address+1, value >> 8);
+        mem_write_8(address, value);
+        return;
+    }
+    page = translate_write(address);
+    if (page != NULL) {
+        page->data[offset+1] = (value >> 8) & 0xFF;
+        page->data[offset] = value & 0xFF;
+        notify_write(page, address, 2);
+    }
+}
+
+/***************************************************************/
+/* Read a 32-bit word from memory                                                                            */
+/***************************************************************/
+uint32_t mem_read_32(uint32_t address)
+{
+    mem_tlb_entry_t *e = &MEMORY.rtlb[MEM_TLB_INDEX(address)];
+    uint32_t offset = address & MEM_PAGE_MASK;
+    mem_page_t *page;
+
+    /* fast path: aligned word in a recently used page */
+    if (e->vpn == MEM_PAGE_NUM(address) && (address & 3) == 0) {
+        return load_le32(e->page->data + offset);
+    }
+    if (offset > MEM_PAGE_SIZE - 4) {
+        return (mem_read_8(address+3) << 24) |
+        (mem_read_8(address+2) << 16) |
+        (mem_read_8(address+1) <<  8) |
+        (mem_read_8(address+0) <<  0);
+    }
+    page = translate_read(address);
+    if (page == NULL) {
+        return 0;
+    }
+    return load_le32(page->data + offset);
+}
+
+/***************************************************************/
+/* Write a 32-bit word to memory                                                                                */
+/***************************************************************/
+void mem_write_32(uint32_t address, uint32_t value)
+{
+    mem_tlb_entry_t *e = &MEMORY.wtlb[MEM_TLB_INDEX(address)];
+    uint32_t offset = address & MEM_PAGE_MASK;
+    mem_page_t *page;
+
+    if (e->vpn == MEM_PAGE_NUM(address) && (address & 3) == 0) {
+        store_le32(e->page->data + offset, value);
+        return;
+    }
+    if (offset > MEM_PAGE_SIZE - 4) {
+        mem_write_8(address+3, value >> 24);
+        mem_write_8(address+2, value >> 16);
+        mem_write_8(address+1, value >>  8);
+        mem_write_8(address+0, value >>  0);
+        return;
+    }
+    page = translate_write(address);
+    if (page != NULL) {
+        store_le32(page->data + offset, value);
+        notify_write(page, address, 4);
+    }
+}
+
+/***************************************************************/
+/* Copy len bytes into memory a page at a time, -1 if some fall outside     */
+/***************************************************************/
+/* src is already in simulated byte order, loaders use this instead of word stores */
+int mem_write_block(uint32_t address, const uint8_t *src, uint32_t len)
+{
+    mem_page_t *page;
+    uint32_t offset, n;
+
+    while (len > 0) {
+        offset = address & MEM_PAGE_MASK;
+        n = MEM_PAGE_SIZE - offset;
+        if (n > len) {
+            n = len;
+        }
+        page = translate_write(address);
+        if (page == NULL) {
+            return -1;
+        }
+        memcpy(page->data + offset, src, n);
+        notify_write(page, address, n);
+        address += n;
+        src += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Store value if the aligned word at address holds expected, atomically      */
+/***************************************************************/
+/* Returns TRUE if the store happened. Cores sharing memory use this for SC. */
+int mem_cas_32(uint32_t address, uint32_t expected, uint32_t value)
+{
+    mem_page_t *page;
+
+    if ((address & 3) != 0 || (page = translate_write(address)) == NULL) {
+        return FALSE;
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (!__atomic_compare_exchange_n((mem_word_t *)(page->data + (address & MEM_PAGE_MASK)), &expected, value,
+                                     FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return FALSE;
+    }
+#else
+    if (load_le32(page->data + (address & MEM_PAGE_MASK)) != expected) {
+        return FALSE;
+    }
+    store_le32(page->data + (address & MEM_PAGE_MASK), value);
+#endif
+    notify_write(page, address, 4);
+    return TRUE;
+}
+
+/***************************************************************/
+/* Register a function called after every write into a hooked page                 */
+/***************************************************************/
+void mem_add_write_hook(mem_write_hook_t hook)
+{
+    int i;
+    for (i = 0; i < MEMORY.num_hooks; i++) {
+        if (MEMORY.hooks[i] == hook) {
+            return;
+        }
+    }
+    if (MEMORY.num_hooks == MEM_MAX_HOOKS) {
+        printf("Error: too many memory write hooks\n");
+        exit(-1);
+    }
+    MEMORY.hooks[MEMORY.num_hooks++] = hook;
+}
+
+/***************************************************************/
+/* Report every future write into the page holding address to the hooks      */
+/***************************************************************/
+void mem_hook_page(uint32_t address)
+{
+    mem_page_t *page;
+    if (mem_region_of(address) < 0) {
+        return;
+    }
+    page = page_touch(address);
+    store_lock(STORE);
+    page->flags |= MEM_PAGE_HOOKED;
+    store_unlock(STORE);
+    if (MEMORY.wtlb[MEM_TLB_INDEX(address)].vpn == MEM_PAGE_NUM(address)) {
+        MEMORY.wtlb[MEM_TLB_INDEX(address)].vpn = MEM_TLB_INVALID;
+    }
+}
+
+/***************************************************************/
+/* Drop every cached translation                                                                           */
+/***************************************************************/
+void mem_tlb_flush()
+{
+    uint32_t i;
+    for (i = 0; i < MEM_TLB_SIZE; i++) {
+        MEMORY.rtlb[i].vpn = MEM_TLB_INVALID;
+        MEMORY.wtlb[i].vpn = MEM_TLB_INVALID;
+    }
+}
+
+/***************************************************************/
+/* Number of pages currently backed by host memory                                          */
+/***************************************************************/
+uint32_t mem_page_count()
+{
+    return STORE->pages;
+}
+
+/***************************************************************/
+/* Number of pages written since the last reset                                                 */
+/***************************************************************/
+uint32_t mem_dirty_count()
+{
+    return STORE->num_dirty;
+}
+
+/***************************************************************/
+/* Zero the pages written since the last reset, keeping them allocated          */
+/***************************************************************/
+void mem_reset()
+{
+    mem_store_t *store = STORE;
+    uint32_t i;
+    for (i = 0; i < store->num_dirty; i++) {
+        memset(store->dirty[i]->data, 0, MEM_PAGE_SIZE);
+        store->dirty[i]->flags &= ~MEM_PAGE_DIRTY;
+        frame_put(store->dirty[i]->frame);
+        store->dirty[i]->frame = NULL;
+    }
+    store->num_dirty = 0;
+    mem_tlb_flush();
+}
+
+/***************************************************************/
+/* Free every page, memory reads as zero afterwards                                       */
+/***************************************************************/
+void mem_release()
+{
+    mem_store_t *store = STORE;
+    uint32_t i, j;
+    mem_tlb_flush();
+    for (i = 0; i < MEM_DIR_SIZE; i++) {
+        if (store->dir[i] == NULL) {
+            continue;
+        }
+        for (j = 0; j < MEM_TABLE_SIZE; j++) {
+            if (store->dir[i][j] != NULL) {
+                frame_put(store->dir[i][j]->frame);
+            }
+            free(store->dir[i][j]);
+        }
+        free(store->dir[i]);
+        store->dir[i] = NULL;
+    }
+    store->pages = 0;
+    free(store->dirty);
+    store->dirty = NULL;
+    store->num_dirty = 0;
+    store->max_dirty = 0;
+}
+
+/***************************************************************/
+/* Record every written page in snap, -1 if out of memory                                 */
+/***************************************************************/
+/* Only pages written since they were last captured are copied, the rest share
+ * the frame already taken. Write translations are dropped so the next store to
+ * each page goes through translate_write() and lets go of its frame. */
+int mem_snapshot(mem_snapshot_t *snap)
+{
+    mem_store_t *store = STORE;
+    mem_page_t *page;
+    uint32_t i;
+
+    snap->pages = malloc((store->num_dirty ? store->num_dirty : 1) * sizeof(mem_snap_page_t));
+    snap->num_pages = 0;
+    if (snap->pages == NULL) {
+        return -1;
+    }
+    for (i = 0; i < store->num_dirty; i++) {
+        page = store->dirty[i];
+        if (page->frame == NULL) {
+            page->frame = malloc(sizeof(mem_frame_t));
+            if (page->frame == NULL) {
+                mem_snapshot_free(snap);
+                return -1;
+            }
+            memcpy(page->frame->data, page->data, MEM_PAGE_SIZE);
+            page->frame->refs = 1;
+        }
+        page->frame->refs++;
+        snap->pages[snap->num_pages].vpn = page->vpn;
+        snap->pages[snap->num_pages].frame = page->frame;
+        snap->num_pages++;
+    }
+    for (i = 0; i < MEM_TLB_SIZE; i++) {
+        MEMORY.wtlb[i].vpn = MEM_TLB_INVALID;
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Append a copy of one page to snap, for snapshots read from a file          */
+/***************************************************************/
+int mem_snapshot_add(mem_snapshot_t *snap, uint32_t vpn, const uint8_t *data)
+{
+    mem_snap_page_t *pages = realloc(snap->pages, (snap->num_pages + 1) * sizeof(mem_snap_page_t));
+    mem_frame_t *frame = malloc(sizeof(mem_frame_t));
+
+    if (pages == NULL || frame == NULL) {
+        free(frame);
+        if (pages != NULL) {
+            snap->pages = pages;
+        }
+        return -1;
+    }
+    memcpy(frame->data, data, MEM_PAGE_SIZE);
+    frame->refs = 1;
+    snap->pages = pages;
+    snap->pages[snap->num_pages].vpn = vpn;
+    snap->pages[snap->num_pages].frame = frame;
+    snap->num_pages++;
+    return 0;
+}
+
+/***************************************************************/
+/* Make memory match snap, copying only pages that differ from it              */
+/***************************************************************/
+/* Pages written since snap was taken are copied back, pages it does not hold
+ * are zeroed. Changed hooked pages are reported so decoded text is dropped. */
+void mem_restore(const mem_snapshot_t *snap)
+{
+    mem_store_t *store = STORE;
+    const mem_snap_page_t *s;
+    mem_page_t *page;
+    uint32_t i, n, address;
+
+    store->restores++;
+    for (i = 0; i < snap->num_pages; i++) {
+        s = &snap->pages[i];
+        address = s->vpn << MEM_PAGE_BITS;
+        page = page_dirty(address);
+        page->mark = store->restores;
+        if (page->frame != s->frame) {
+            memcpy(page->data, s->frame->data, MEM_PAGE_SIZE);
+            frame_put(page->frame);
+            page->frame = s->frame;
+            page->frame->refs++;
+            notify_write(page, address, MEM_PAGE_SIZE);
+        }
+    }
+    for (i = 0, n = 0; i < store->num_dirty; i++) {
+        page = store->dirty[i];
+        if (page->mark == store->restores) {
+            store->dirty[n++] = page;
+            continue;
+        }
+        memset(page->data, 0, MEM_PAGE_SIZE);
+        page->flags &= ~MEM_PAGE_DIRTY;
+        frame_put(page->frame);
+        page->frame = NULL;
+        notify_write(page, page->vpn << MEM_PAGE_BITS, MEM_PAGE_SIZE);
+    }
+    store->num_dirty = n;
+    mem_tlb_flush();
+}
+
+/***************************************************************/
+/* Release the frames held by snap                                                                       */
+/***************************************************************/
+void mem_snapshot_free(mem_snapshot_t *snap)
+{
+    uint32_t i;
+    for (i = 0; i < snap->num_pages; i++) {
+        frame_put(snap->pages[i].frame);
+    }
+    free(snap->pages);
+    snap->pages = NULL;
+    snap->num_pages = 0;
+}
+
+/***************************************************************/
+/* The store this thread uses, for handing to mem_share() on another thread */
+/***************************************************************/
+mem_store_t *mem_store()
+{
+    return STORE;
+}
+
+/***************************************************************/
+/* Use store instead of this thread's own pages, NULL goes back to them       */
+/***************************************************************/
+/* store must outlive the sharing. Snapshots, mem_reset() and mem_release()
+ * act on the shared pages, so only the owner should call them. Write hooks stay
+ * per thread: a core is not told about code another core overwrites. */
+void mem_share(mem_store_t *store)
+{
+    MEMORY.shared = (store == &MEMORY.own) ? NULL : store;
+    mem_tlb_flush();
+}
+
+/***************************************************************/
+/* Set up an empty address space, pages are allocated lazily                          */
+/***************************************************************/
+void init_memory()
+{
+    mem_release();
+}
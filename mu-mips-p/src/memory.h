@@ -0,0 +1,141 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* MIPS memory layout                                                                                                                                      */
+/******************************************************************************/
+#define MEM_TEXT_BEGIN  0x00400000
+#define MEM_TEXT_END      0x0FFFFFFF
+/*Memory address 0x10000000 to 0x1000FFFF access by $gp*/
+#define MEM_DATA_BEGIN  0x10010000
+#define MEM_DATA_END   0x7FFFFFFF
+
+#define MEM_KTEXT_BEGIN 0x80000000
+#define MEM_KTEXT_END  0x8FFFFFFF
+
+#define MEM_KDATA_BEGIN 0x90000000
+#define MEM_KDATA_END  0xFFFEFFFF
+
+/*stack and data segments occupy the same memory space. Stack grows backward (from higher address to lower address) */
+#define MEM_STACK_BEGIN 0x7FFFFFFF
+#define MEM_STACK_END  0x10010000
+
+typedef struct {
+	uint32_t begin, end;
+} mem_region_t;
+
+#define NUM_MEM_REGION 4
+
+extern mem_region_t MEM_REGIONS[NUM_MEM_REGION];
+
+/******************************************************************************/
+/* Sparse paged backing store                                                                                                                      */
+/******************************************************************************/
+/* The 32-bit address space is covered by a two level page table. Pages are   */
+/* allocated the first time they are written; reading a page that was never  */
+/* written returns zero. All region bounds above are page aligned.            */
+#define MEM_PAGE_BITS   12
+#define MEM_PAGE_SIZE   (1u << MEM_PAGE_BITS)
+#define MEM_PAGE_MASK   (MEM_PAGE_SIZE - 1)
+#define MEM_DIR_BITS    10
+#define MEM_DIR_SIZE    (1u << MEM_DIR_BITS)
+#define MEM_TABLE_BITS  (32 - MEM_DIR_BITS - MEM_PAGE_BITS)
+#define MEM_TABLE_SIZE  (1u << MEM_TABLE_BITS)
+
+#define MEM_PAGE_NUM(addr)   ((uint32_t)(addr) >> MEM_PAGE_BITS)
+#define MEM_DIR_INDEX(addr)  ((uint32_t)(addr) >> (32 - MEM_DIR_BITS))
+#define MEM_TABLE_INDEX(addr) (((uint32_t)(addr) >> MEM_PAGE_BITS) & (MEM_TABLE_SIZE - 1))
+
+#define MEM_PAGE_DIRTY  0x1
+#define MEM_PAGE_HOOKED 0x2    /* writes are reported to the write hooks */
+
+#define MEM_MAX_HOOKS   4
+typedef void (*mem_write_hook_t)(uint32_t address, uint32_t size);
+
+/* direct mapped translation cache in front of the page table, keyed by page number */
+#define MEM_TLB_BITS    6
+#define MEM_TLB_SIZE    (1u << MEM_TLB_BITS)
+#define MEM_TLB_INDEX(addr) (MEM_PAGE_NUM(addr) & (MEM_TLB_SIZE - 1))
+#define MEM_TLB_INVALID 0xFFFFFFFF
+
+/* a page image kept by one or more snapshots */
+typedef struct {
+	uint32_t refs;
+	uint8_t data[MEM_PAGE_SIZE];
+} mem_frame_t;
+
+typedef struct {
+	uint8_t data[MEM_PAGE_SIZE];
+	uint32_t vpn;                  /* page number this page backs */
+	uint32_t flags;
+	mem_frame_t *frame;            /* snapshot image equal to data, dropped on the next write */
+	uint32_t mark;                 /* restore that last set this page */
+} mem_page_t;
+
+typedef struct {
+	uint32_t vpn;                  /* MEM_TLB_INVALID when empty */
+	mem_page_t *page;
+} mem_tlb_entry_t;
+
+/* The pages themselves. Threads simulating cores of one machine share a store
+ * (see mem_share()), page allocation and flag changes then take the lock. */
+typedef struct {
+	mem_page_t **dir[MEM_DIR_SIZE]; /* second level tables, NULL until touched */
+	uint32_t pages;                 /* number of pages currently allocated */
+	mem_page_t **dirty;             /* pages written since the last mem_reset() */
+	uint32_t num_dirty, max_dirty;
+	uint32_t restores;
+	char lock;
+} mem_store_t;
+
+typedef struct {
+	mem_tlb_entry_t rtlb[MEM_TLB_SIZE];  /* any allocated page */
+	mem_tlb_entry_t wtlb[MEM_TLB_SIZE];  /* dirty pages only, so writes skip the dirty check */
+	mem_store_t own;
+	mem_store_t *shared;            /* another thread's store in use instead of own, or NULL */
+	mem_write_hook_t hooks[MEM_MAX_HOOKS];
+	int num_hooks;
+} mem_t;
+
+/* Snapshots copy only the pages written since the previous snapshot, pages
+ * left alone share one frame between every snapshot and the live page. */
+typedef struct {
+	uint32_t vpn;
+	mem_frame_t *frame;
+} mem_snap_page_t;
+
+typedef struct {
+	mem_snap_page_t *pages;
+	uint32_t num_pages;
+} mem_snapshot_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void init_memory();
+void mem_release();
+void mem_reset();
+uint32_t mem_read_32(uint32_t address);
+uint32_t mem_read_16(uint32_t address);
+uint32_t mem_read_8(uint32_t address);
+void mem_write_32(uint32_t address, uint32_t value);
+void mem_write_16(uint32_t address, uint32_t value);
+void mem_write_8(uint32_t address, uint32_t value);
+int mem_write_block(uint32_t address, const uint8_t *src, uint32_t len);
+int mem_cas_32(uint32_t address, uint32_t expected, uint32_t value);
+void mem_tlb_flush();
+void mem_add_write_hook(mem_write_hook_t hook);
+void mem_hook_page(uint32_t address);
+int mem_region_of(uint32_t address);
+uint32_t mem_page_count();
+uint32_t mem_dirty_count();
+int mem_snapshot(mem_snapshot_t *snap);
+int mem_snapshot_add(mem_snapshot_t *snap, uint32_t vpn, const uint8_t *data);
+void mem_restore(const mem_snapshot_t *snap);
+void mem_snapshot_free(mem_snapshot_t *snap);
+mem_store_t *mem_store();
+void mem_share(mem_store_t *store);
+
+#endif
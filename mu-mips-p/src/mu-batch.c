@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "mu-mips.h"
+#include "bpred.h"
+#include "loader.h"
+#include "sim.h"
+
+/***************************************************************/
+/* Run every program in a directory on a pool of simulator threads           */
+/***************************************************************/
+
+/* a program that never halts must not hold up the rest, -m 0 lifts the limit */
+#define BATCH_DEFAULT_MAX_CYCLES    100000000ull
+
+static const char *STATUS_NAMES[] = { "halted", "limit", "error" };
+
+typedef struct {
+	char path[512];
+	sim_result_t result;
+} batch_job_t;
+
+static struct {
+	batch_job_t *jobs;
+	int num_jobs;
+	int next;                   /* next job to hand out, taken atomically */
+	sim_config_t config;
+	uint64_t max_cycles;        /* 0 for no limit */
+} BATCH = { .max_cycles = BATCH_DEFAULT_MAX_CYCLES };
+
+static int compare_jobs(const void *a, const void *b)
+{
+    return strcmp(((const batch_job_t *)a)->path, ((const batch_job_t *)b)->path);
+}
+
+/***************************************************************/
+/* Collect the regular files in dir, sorted by name                                                */
+/***************************************************************/
+static int find_jobs(const char *dir)
+{
+    DIR *d = opendir(dir);
+    struct dirent *e;
+    struct stat st;
+    batch_job_t *jobs;
+    int cap = 0;
+
+    if (d == NULL) {
+        printf("Error: Can't open directory %s\n", dir);
+        return -1;
+    }
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') {
+            continue;
+        }
+        if (BATCH.num_jobs == cap) {
+            cap = cap ? cap * 2 : 64;
+            jobs = realloc(BATCH.jobs, cap * sizeof(batch_job_t));
+            if (jobs == NULL) {
+                printf("Error: out of memory listing %s\n", dir);
+                closedir(d);
+                return -1;
+            }
+            BATCH.jobs = jobs;
+        }
+        snprintf(BATCH.jobs[BATCH.num_jobs].path, sizeof(BATCH.jobs[0].path), "%s/%s", dir, e->d_name);
+        if (stat(BATCH.jobs[BATCH.num_jobs].path, &st) == 0 && S_ISREG(st.st_mode)) {
+            memset(&BATCH.jobs[BATCH.num_jobs].result, 0, sizeof(sim_result_t));
+            BATCH.jobs[BATCH.num_jobs].result.status = SIM_ERROR;
+            BATCH.num_jobs++;
+        }
+    }
+    closedir(d);
+    qsort(BATCH.jobs, BATCH.num_jobs, sizeof(batch_job_t), compare_jobs);
+    return 0;
+}
+
+/***************************************************************/
+/* Worker: one simulator context, programs taken until none are left           */
+/***************************************************************/
+static void *worker(void *arg)
+{
+    batch_job_t *job;
+    sim_t *sim;
+    int i;
+
+    (void)arg;
+    sim = sim_create(&BATCH.config);
+    if (sim == NULL) {
+        return NULL;
+    }
+    while ((i = __atomic_fetch_add(&BATCH.next, 1, __ATOMIC_RELAXED)) < BATCH.num_jobs) {
+        job = &BATCH.jobs[i];
+        if (sim_load(sim, job->path) == 0) {
+            sim_run(sim, BATCH.max_cycles);
+        }
+        sim_result(sim, &job->result);
+    }
+    sim_destroy(sim);
+    return NULL;
+}
+
+static void print_results(double elapsed)
+{
+    const sim_result_t *r;
+    uint64_t cycles = 0, insts = 0;
+    int i;
+
+    printf("-------------------------------------------------------------\n");
+    printf("[Program]\t[Status]\t[Cycles]\t[Instructions]\t[CPI]\t[PC]\n");
+    printf("-------------------------------------------------------------\n");
+    for (i = 0; i < BATCH.num_jobs; i++) {
+        r = &BATCH.jobs[i].result;
+        printf("%s\t%s\t\t%u\t\t%u\t\t%.3f\t0x%08x\n", BATCH.jobs[i].path, STATUS_NAMES[r->status], r->cycles,
+               r->instructions, r->instructions ? (double)r->cycles / r->instructions : 0.0, r->state.PC);
+        cycles += r->cycles;
+        insts += r->instructions;
+    }
+    printf("-------------------------------------------------------------\n");
+    printf("%d programs, %llu cycles, %llu instructions in %.3f s (%.1f M cycles/s)\n", BATCH.num_jobs,
+           (unsigned long long)cycles, (unsigned long long)insts, elapsed, elapsed > 0 ? cycles / elapsed / 1e6 : 0.0);
+}
+
+/***************************************************************/
+/* Per-program results and final registers as JSON                                                 */
+/***************************************************************/
+static int write_json(const char *file)
+{
+    const sim_result_t *r;
+    FILE *fp = fopen(file, "w");
+    int i, j;
+
+    if (fp == NULL) {
+        printf("Error: Can't open results file %s\n", file);
+        return -1;
+    }
+    fprintf(fp, "[\n");
+    for (i = 0; i < BATCH.num_jobs; i++) {
+        r = &BATCH.jobs[i].result;
+        fprintf(fp, "  {\"program\": ");
+        stats_print_json_string(fp, BATCH.jobs[i].path);
+        fprintf(fp, ", \"status\": \"%s\", \"cycles\": %u, \"instructions\": %u, \"pc\": %u, \"regs\": [",
+                STATUS_NAMES[r->status], r->cycles, r->instructions, r->state.PC);
+        for (j = 0; j < MIPS_REGS; j++) {
+            fprintf(fp, "%s%u", j ? ", " : "", r->state.REGS[j]);
+        }
+        fprintf(fp, "], \"hi\": %u, \"lo\": %u}%s\n", r->state.HI, r->state.LO, i + 1 < BATCH.num_jobs ? "," : "");
+    }
+    fprintf(fp, "]\n");
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+/* 1 if a program failed or never ran, 2 if one hit the cycle limit, 0 if all halted */
+static int exit_status()
+{
+    int i, status = 0;
+
+    for (i = 0; i < BATCH.num_jobs; i++) {
+        if (BATCH.jobs[i].result.status == SIM_ERROR) {
+            return 1;
+        }
+        if (BATCH.jobs[i].result.status == SIM_LIMIT) {
+            status = 2;
+        }
+    }
+    return status;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [-n threads] [-m max cycles, default %llu, 0 for none] [-j results json file] [-F] [-C] [-p nottaken|bimodal|gshare|btb] [-w width] [-O] [-u unit:latency[:pipelined|:blocking]] [-f auto|hex|bin|bin-le|elf] <program directory>\n", prog,
+           (unsigned long long)BATCH_DEFAULT_MAX_CYCLES);
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t *threads;
+    struct timespec t0, t1;
+    const char *json_file = NULL;
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt, kind, i, status;
+
+    sim_default_config(&BATCH.config);
+    while ((opt = getopt(argc, argv, "n:m:j:FCp:f:w:Ou:")) != -1) {
+        switch (opt) {
+            case 'n':
+                num_threads = strtol(optarg, NULL, 0);
+                break;
+            case 'm':
+                BATCH.max_cycles = strtoull(optarg, NULL, 0);
+                break;
+            case 'j':
+                json_file = optarg;
+                break;
+            case 'F':
+                BATCH.config.forwarding = FALSE;
+                break;
+            case 'C':
+                BATCH.config.caches = TRUE;
+                break;
+            case 'p':
+                if ((kind = bpred_parse_kind(optarg)) < 0) {
+                    printf("Error: unknown branch predictor %s\n", optarg);
+                    return 1;
+                }
+                BATCH.config.bpred_kind = kind;
+                break;
+            case 'w':
+                BATCH.config.width = atoi(optarg);
+                if (BATCH.config.width < 1 || BATCH.config.width > PIPE_MAX_WIDTH) {
+                    printf("Error: pipeline width must be 1 to %d\n", PIPE_MAX_WIDTH);
+                    return 1;
+                }
+                break;
+            case 'O':
+                BATCH.config.ooo = TRUE;
+                break;
+            case 'u':
+                if (fu_parse(optarg) != 0) {
+                    return 1;
+                }
+                memcpy(BATCH.config.units, FU.config, sizeof(BATCH.config.units));
+                break;
+            case 'f':
+                if ((kind = loader_parse_format(optarg)) < 0) {
+                    printf("Error: program format must be auto, hex, bin, bin-le or elf\n");
+                    return 1;
+                }
+                BATCH.config.format = kind;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (find_jobs(argv[optind]) != 0) {
+        return 1;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    if (num_threads > BATCH.num_jobs) {
+        num_threads = BATCH.num_jobs ? BATCH.num_jobs : 1;
+    }
+
+    threads = malloc(num_threads * sizeof(pthread_t));
+    if (threads == NULL) {
+        printf("Error: out of memory starting threads\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+            printf("Error: Can't start worker thread %d\n", i);
+            num_threads = i;
+            break;
+        }
+    }
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    print_results((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+    status = exit_status();
+    if (json_file != NULL && write_json(json_file) != 0) {
+        status = 1;
+    }
+    free(threads);
+    free(BATCH.jobs);
+    return status;
+}
@@ -4,8 +4,58 @@
 #include <stdint.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <getopt.h>
 
 #include "mu-mips.h"
+#include "decode.h"
+#include "trace.h"
+#include "btrace.h"
+#include "disasm.h"
+#include "hazard.h"
+#include "stats.h"
+#include "bpred.h"
+#include "cache.h"
+#include "loader.h"
+#include "funcsim.h"
+#include "threaded.h"
+#include "dbt.h"
+#include "snapshot.h"
+#include "lockstep.h"
+#include "multicore.h"
+#include "sample.h"
+#include "bench.h"
+#include "ooo.h"
+#include "fu.h"
+#include "debug.h"
+#include "reverse.h"
+
+/***************************************************************/
+/* CPU State info.                                                                                                               */
+/***************************************************************/
+SIM_LOCAL CPU_State CURRENT_STATE, NEXT_STATE;
+SIM_LOCAL int RUN_FLAG;
+SIM_LOCAL uint32_t INSTRUCTION_COUNT;
+SIM_LOCAL uint32_t CYCLE_COUNT;
+SIM_LOCAL uint32_t PROGRAM_SIZE;
+SIM_LOCAL uint32_t PIPELINE_EVENTS;
+
+SIM_LOCAL int PIPE_WIDTH = 1;
+
+SIM_LOCAL CPU_Pipeline_Reg IF_ID[PIPE_MAX_WIDTH];
+SIM_LOCAL CPU_Pipeline_Reg ID_EX[PIPE_MAX_WIDTH];
+SIM_LOCAL CPU_Pipeline_Reg EX_MEM[PIPE_MAX_WIDTH];
+SIM_LOCAL CPU_Pipeline_Reg MEM_WB[PIPE_MAX_WIDTH];
+
+SIM_LOCAL char prog_file[256];
+
+SIM_LOCAL int FETCH_OFF;
+
+int QUIET;
+
+/* format given with -f, the loader guesses otherwise */
+static SIM_LOCAL load_format_t LOAD_FORMAT = LOAD_AUTO;
+
 uint32_t sign_extension_32(uint32_t val){
     //check on the sign and repicate first bit
     if ((val & 0x00008000) == 0x00008000){
@@ -33,55 +83,118 @@ void help() {
     printf("low <val>\t-- set the LO register to <val>\n");
     printf("print\t-- print the program loaded into memory\n");
     printf("show\t-- print the current content of the pipeline registers\n");
+    printf("stats [json [file]]\t-- print the performance counters\n");
+    printf("trace <level> [file]\t-- set tracing to off, summary, inst or stage\n");
+    printf("btrace <file>|off\t-- record a binary pipeline trace (decode with mu-trace)\n");
+    printf("forward on|off\t-- enable or disable the EX/MEM and MEM/WB forwarding paths\n");
+    printf("width [n]\t-- show or set the number of instructions issued per cycle, 1 to %d\n", PIPE_MAX_WIDTH);
+    printf("ooo [on|off]\t-- show the out-of-order core, or run the program on it instead of the pipeline\n");
+    printf("ooo <rob> <rs> [width [alu muldiv mem]]\t-- size the reorder buffer, reservation stations, width and units\n");
+    printf("unit [<mult|div|mem> <latency> [pipelined|blocking]]\t-- show or set a functional unit's latency in cycles\n");
+    printf("ff <n> [interp|threaded|dbt]\t-- run <n> instructions functionally, then continue in the pipeline\n");
+    printf("bench <n>\t-- time <n> instructions on the pipeline and each functional engine\n");
+    printf("bpred <kind> [bits]\t-- predict branches with nottaken, bimodal, gshare or btb\n");
+    printf("cache [on|off]\t-- show the cache model, or turn it on or off\n");
+    printf("cache <l1i|l1d|l2> <size> <line> <ways> [lru|random] [wb|wt]\t-- configure a level, size 0 removes it\n");
+    printf("cache latency <l2> <memory>\t-- set the miss latencies in cycles\n");
+    printf("save <file>\t-- write registers, pipeline, counters and memory to <file>\n");
+    printf("load <file>\t-- continue from a state written by save\n");
+    printf("snap [n]\t-- keep the current state in memory as snapshot <n>\n");
+    printf("restore <n>\t-- return to snapshot <n>\n");
+    printf("multi <n> [quantum [max]]\t-- run the program on <n> cores sharing memory, synchronizing every <quantum> cycles\n");
+    printf("sample [interval [warmup [k]]]\t-- estimate the CPI from up to <k> clusters of representative intervals\n");
+    printf("sweep <file> [n]\t-- run the program once per register set in <file>, in lockstep, for up to <n> instructions each\n");
+    printf("break [addr]\t-- list the breakpoints and watches, or stop runs once the instruction at <addr> is fetched\n");
+    printf("watch [r|w|rw] <addr> [len]\t-- stop runs after a load or store touches <len> bytes at <addr>, default w 4\n");
+    printf("delete <addr>|all\t-- remove the breakpoint and watches at <addr>, or all of them\n");
+    printf("record [on|off] [interval]\t-- show or set checkpointing every <interval> cycles of run and sim for going back\n");
+    printf("rstep [n]\t-- go back <n> cycles, 1 by default\n");
+    printf("rcontinue\t-- go back to the last cycle a breakpoint instruction was fetched or a watched access happened\n");
     printf("?\t-- display help menu\n");
     printf("quit\t-- exit the simulator\n\n");
+    printf("Commands on one line are separated by ';', a '#' starts a comment.\n\n");
     printf("------------------------------------------------------------------\n\n");
 }
 
 /***************************************************************/
-/* Read a 32-bit word from memory                                                                            */
+/* Execute one cycle                                                                                                              */
 /***************************************************************/
-uint32_t mem_read_32(uint32_t address)
-{
-    int i;
-    for (i = 0; i < NUM_MEM_REGION; i++) {
-        if ( (address >= MEM_REGIONS[i].begin) &&  ( address <= MEM_REGIONS[i].end) ) {
-            uint32_t offset = address - MEM_REGIONS[i].begin;
-            return (MEM_REGIONS[i].mem[offset+3] << 24) |
-            (MEM_REGIONS[i].mem[offset+2] << 16) |
-            (MEM_REGIONS[i].mem[offset+1] <<  8) |
-            (MEM_REGIONS[i].mem[offset+0] <<  0);
-        }
+void cycle() {
+    PIPELINE_EVENTS = 0;
+    handle_pipeline();
+    if (BTRACE_ON) {
+        btrace_record();
     }
-    return 0;
+    CURRENT_STATE = NEXT_STATE;
+    CYCLE_COUNT++;
 }
 
 /***************************************************************/
-/* Write a 32-bit word to memory                                                                                */
+/* Cycles from now the pipeline provably spends stalled, each like the next */
 /***************************************************************/
-void mem_write_32(uint32_t address, uint32_t value)
-{
-    int i;
-    uint32_t offset;
-    for (i = 0; i < NUM_MEM_REGION; i++) {
-        if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
-            offset = address - MEM_REGIONS[i].begin;
-            
-            MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
-            MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
-            MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
-            MEM_REGIONS[i].mem[offset+0] = (value >>  0) & 0xFF;
+/* Three waits leave every latch as it is until a known cycle: MEM frozen on a
+ * data cache miss once the bundle ahead has retired, IF waiting on an
+ * instruction cache miss with the pipeline empty, and IF/ID waiting on a
+ * multi-cycle unit with the pipeline behind it empty. Such a cycle only counts
+ * a stall of *cause, a bubble per WB slot and an empty issue. */
+static uint32_t idle_cycles(int *cause) {
+    const decoded_inst_t *d;
+    uint32_t ready;
+    int i, empty = TRUE;
+    
+    for (i = 0; i < PIPE_WIDTH; i++){
+        if (MEM_WB[i].inst != NULL){
+            return 0;
+        }
+        d = EX_MEM[i].inst;
+        if (d != NULL && (d->flags & (INST_LOAD | INST_STORE)) && CACHES.data.busy && CACHES.data.addr == EX_MEM[i].ALUOutput){
+            *cause = STALL_DCACHE;
+            return CACHES.data.remaining - 1;
         }
+        if (d != NULL || ID_EX[i].inst != NULL){
+            empty = FALSE;
+        }
+    }
+    if (!empty){
+        return 0;
+    }
+    if (IF_ID[0].inst == NULL){
+        *cause = STALL_ICACHE;
+        return (!FETCH_OFF && CACHES.fetch.busy && CACHES.fetch.addr == CURRENT_STATE.PC) ? CACHES.fetch.remaining - 1 : 0;
     }
+    /*with nothing older in flight only the scoreboard can hold IF/ID, the stall lasts until the last cycle before it lets go*/
+    ready = fu_ready_cycle(IF_ID[0].inst);
+    *cause = STALL_UNIT;
+    return ready > CYCLE_COUNT + 1 ? ready - 1 - CYCLE_COUNT : 0;
 }
 
 /***************************************************************/
-/* Execute one cycle                                                                                                              */
+/* Execute one cycle, first jumping over idle ones, up to max in all           */
 /***************************************************************/
-void cycle() {
-    handle_pipeline();
-    CURRENT_STATE = NEXT_STATE;
-    CYCLE_COUNT++;
+/* The cycles jumped over are counted as cycle() would have counted them. The
+ * out-of-order core, stage tracing and the binary trace go cycle by cycle.
+ * Returns the number of cycles executed. */
+uint32_t cycle_skip(uint32_t max) {
+    uint32_t n = 0;
+    int cause;
+    
+    if (max > 1 && !OOO.enabled && !BTRACE_ON && !TRACE_ON(TRACE_STAGE) && (n = idle_cycles(&cause)) > 0){
+        if (n > max - 1){
+            n = max - 1;
+        }
+        if (cause == STALL_DCACHE){
+            CACHES.data.remaining -= n;
+        } else if (cause == STALL_ICACHE){
+            CACHES.fetch.remaining -= n;
+        }
+        STATS.stalls[cause] += n;
+        STATS.bubbles += (uint64_t)n * PIPE_WIDTH;
+        STATS.issued[0] += n;
+        STATS.skipped += n;
+        CYCLE_COUNT += n;
+    }
+    cycle();
+    return n + 1;
 }
 
 /***************************************************************/
@@ -96,13 +209,113 @@ void run(int num_cycles) {
     
     printf("Running simulator for %d cycles...\n\n", num_cycles);
     int i;
-    for (i = 0; i < num_cycles; i++) {
+    reverse_begin();
+    debug_arm();
+    for (i = 0; i < num_cycles; ) {
         if (RUN_FLAG == FALSE) {
             printf("Simulation Stopped.\n\n");
             break;
         }
-        cycle();
+        if (REVERSE.logging) {
+            reverse_frame();
+        }
+        i += cycle_skip(num_cycles - i);
+        if (CYCLE_COUNT >= REVERSE.next) {
+            reverse_checkpoint();
+        }
+        if (DEBUG.stop && debug_stopped()) {
+            break;
+        }
     }
+    debug_disarm();
+    reverse_end();
+    TRACE(TRACE_SUMMARY, "run: %u cycles, %u instructions, PC 0x%08x\n", CYCLE_COUNT, INSTRUCTION_COUNT, CURRENT_STATE.PC);
+    trace_flush();
+}
+
+/***************************************************************/
+/* Let the instructions in flight finish without fetching new ones                */
+/***************************************************************/
+/* Wrong-path instructions are squashed as usual, so CURRENT_STATE.PC ends up at
+ * the next instruction of the program. */
+void drain_pipeline() {
+    FETCH_OFF = TRUE;
+    cache_cancel_fetch();
+    while (RUN_FLAG && !pipeline_empty()){
+        cycle_skip(UINT32_MAX);
+    }
+    FETCH_OFF = FALSE;
+}
+
+/***************************************************************/
+/* TRUE when no latch holds an instruction                                                          */
+/***************************************************************/
+int pipeline_empty() {
+    int i;
+    
+    if (!ooo_empty()){
+        return FALSE;
+    }
+    for (i = 0; i < PIPE_WIDTH; i++){
+        if (IF_ID[i].inst != NULL || ID_EX[i].inst != NULL || EX_MEM[i].inst != NULL || MEM_WB[i].inst != NULL){
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/***************************************************************/
+/* Change the number of instructions each stage handles per cycle             */
+/***************************************************************/
+/* The latches are drained first, so no instruction is left in a slot the new
+ * width does not use. */
+int pipeline_set_width(int width) {
+    int i;
+    
+    if (width < 1 || width > PIPE_MAX_WIDTH){
+        printf("Error: pipeline width must be 1 to %d\n", PIPE_MAX_WIDTH);
+        return -1;
+    }
+    if (width > 1 && BTRACE_ON){
+        printf("Error: the binary trace records a scalar pipeline, turn it off first\n");
+        return -1;
+    }
+    drain_pipeline();
+    for (i = width; i < PIPE_MAX_WIDTH; i++){
+        memset(&IF_ID[i], 0, sizeof(IF_ID[i]));
+        memset(&ID_EX[i], 0, sizeof(ID_EX[i]));
+        memset(&EX_MEM[i], 0, sizeof(EX_MEM[i]));
+        memset(&MEM_WB[i], 0, sizeof(MEM_WB[i]));
+    }
+    PIPE_WIDTH = width;
+    return 0;
+}
+
+/***************************************************************/
+/* Run n instructions functionally, the pipeline refills from the new PC      */
+/***************************************************************/
+void fast_forward(uint64_t n, int engine) {
+    uint64_t done;
+    
+    if (RUN_FLAG == FALSE) {
+        printf("Simulation Stopped\n\n");
+        return;
+    }
+    drain_pipeline();
+    switch (engine) {
+        case ENGINE_INTERP:
+            done = func_run(n);
+            break;
+        case ENGINE_THREADED:
+            done = tc_run(n);
+            break;
+        default:
+            done = dbt_run(n);
+            break;
+    }
+    printf("Fast-forwarded %llu instructions, PC 0x%08x.\n\n", (unsigned long long)done, CURRENT_STATE.PC);
+    TRACE(TRACE_SUMMARY, "ff: %llu instructions, PC 0x%08x\n", (unsigned long long)done, CURRENT_STATE.PC);
+    trace_flush();
 }
 
 /***************************************************************/
@@ -115,10 +328,27 @@ void runAll() {
     }
     
     printf("Simulation Started...\n\n");
+    reverse_begin();
+    debug_arm();
     while (RUN_FLAG){
-        cycle();
+        if (REVERSE.logging){
+            reverse_frame();
+        }
+        cycle_skip(UINT32_MAX);
+        if (CYCLE_COUNT >= REVERSE.next){
+            reverse_checkpoint();
+        }
+        if (DEBUG.stop && debug_stopped()){
+            break;
+        }
+    }
+    debug_disarm();
+    reverse_end();
+    TRACE(TRACE_SUMMARY, "sim: %u cycles, %u instructions, PC 0x%08x\n", CYCLE_COUNT, INSTRUCTION_COUNT, CURRENT_STATE.PC);
+    trace_flush();
+    if (RUN_FLAG == FALSE){
+        printf("Simulation Finished.\n\n");
     }
-    printf("Simulation Finished.\n\n");
 }
 
 /***************************************************************/
@@ -147,6 +377,10 @@ void rdump() {
     printf("-------------------------------------\n");
     printf("# Instructions Executed\t: %u\n", INSTRUCTION_COUNT);
     printf("# Cycles Executed\t: %u\n", CYCLE_COUNT);
+    /*fast-forwarded instructions count in INSTRUCTION_COUNT but took no cycles, so divide by what retired like stats does*/
+    if (STATS.retired > 0){
+        printf("CPI\t\t\t: %.3f\n", (double)CYCLE_COUNT / STATS.retired);
+    }
     printf("PC\t: 0x%08x\n", CURRENT_STATE.PC);
     printf("-------------------------------------\n");
     printf("[Register]\t[Value]\n");
@@ -161,33 +395,260 @@ void rdump() {
 }
 
 /***************************************************************/
-/* Read a command from standard input.                                                               */
+/* cache [on|off|latency <l2> <mem>|<level> <size> <line> <ways> [lru|random] [wb|wt]] */
+/***************************************************************/
+static int handle_cache_command(const char *args) {
+    char name[16], replace[16], write[16];
+    uint32_t size, line_size, ways, l2, mem;
+    int level, n;
+    
+    if (sscanf(args, "%15s", name) != 1){
+        cache_print(stdout);
+        return 0;
+    }
+    if (strcmp(name, "on") == 0 || strcmp(name, "off") == 0){
+        CACHES.enabled = strcmp(name, "on") == 0;
+        printf("Cache model %s.\n", CACHES.enabled ? "enabled" : "disabled");
+        return 0;
+    }
+    if (strcmp(name, "latency") == 0){
+        if (sscanf(args, "%*s %u %u", &l2, &mem) != 2){
+            printf("Usage: cache latency <l2 cycles> <memory cycles>\n");
+            return -1;
+        }
+        cache_set_latency(l2, mem);
+        return 0;
+    }
+    if ((level = cache_parse_level(name)) < 0){
+        printf("Cache level must be l1i, l1d or l2.\n");
+        return -1;
+    }
+    strcpy(replace, "lru");
+    strcpy(write, "wb");
+    n = sscanf(args, "%*s %u %u %u %15s %15s", &size, &line_size, &ways, replace, write);
+    if (n == 1 && size == 0){
+        return cache_configure(level, 0, 0, 0, CACHE_LRU, TRUE);
+    }
+    if (n < 3){
+        printf("Usage: cache <l1i|l1d|l2> <size> <line> <ways> [lru|random] [wb|wt]\n");
+        return -1;
+    }
+    return cache_configure(level, size, line_size, ways, strcmp(replace, "random") == 0 ? CACHE_RANDOM : CACHE_LRU,
+                           strcmp(write, "wt") != 0);
+}
+
+/***************************************************************/
+/* ooo [on|off|<rob> <rs> [width [alu muldiv mem]]]                                               */
+/***************************************************************/
+static int handle_ooo_command(const char *args) {
+    char name[16];
+    int rob, rs, width, units[FU_CLASSES], n;
+    
+    if (sscanf(args, "%15s", name) != 1){
+        ooo_print(stdout);
+        return 0;
+    }
+    if (strcmp(name, "on") == 0 || strcmp(name, "off") == 0){
+        if (ooo_enable(strcmp(name, "on") == 0) != 0){
+            return -1;
+        }
+        printf("Out-of-order core %s.\n", OOO.enabled ? "enabled" : "disabled");
+        return 0;
+    }
+    width = OOO.width;
+    memcpy(units, OOO.units, sizeof(units));
+    n = sscanf(args, "%d %d %d %d %d %d", &rob, &rs, &width, &units[FU_ALU], &units[FU_MULDIV], &units[FU_MEM]);
+    if (n != 2 && n != 3 && n != 6){
+        printf("Usage: ooo <rob entries> <reservation stations> [width [alu muldiv mem]]\n");
+        return -1;
+    }
+    if (ooo_configure(rob, rs, width, units) != 0){
+        return -1;
+    }
+    ooo_print(stdout);
+    return 0;
+}
+
+/***************************************************************/
+/* unit [<mult|div|mem> <latency> [pipelined|blocking]]                                         */
+/***************************************************************/
+static int handle_unit_command(const char *args) {
+    char name[16], mode[16], extra;
+    int kind, latency, n;
+    
+    if (sscanf(args, "%15s", name) != 1){
+        fu_print(stdout);
+        return 0;
+    }
+    n = sscanf(args, "%15s %d %15s %c", name, &latency, mode, &extra);
+    if ((kind = fu_parse_kind(name)) < 0 || n < 2 || n > 3 ||
+        (n == 3 && strcmp(mode, "pipelined") != 0 && strcmp(mode, "blocking") != 0)){
+        printf("Usage: unit <mult|div|mem> <latency> [pipelined|blocking]\n");
+        return -1;
+    }
+    if (fu_configure(kind, latency, n == 3 ? strcmp(mode, "pipelined") == 0 : FU.config[kind].pipelined) != 0){
+        return -1;
+    }
+    fu_print(stdout);
+    return 0;
+}
+
+static int bad_arguments(const char *command) {
+    printf("Missing or invalid arguments to %s, see ? for usage.\n", command);
+    return -1;
+}
+
+/***************************************************************/
+/* Copy word index of args into word                                                                  */
+/***************************************************************/
+/* Returns 1 when it is there, 0 when args has fewer words and -1 when it does
+ * not fit in size bytes, which is never acted on cut short. */
+static int arg_word(const char *args, int index, char *word, size_t size) {
+    size_t n;
+    
+    for (;;){
+        args += strspn(args, " \t\r\n");
+        n = strcspn(args, " \t\r\n");
+        if (n == 0){
+            return 0;
+        }
+        if (index-- == 0){
+            break;
+        }
+        args += n;
+    }
+    if (n >= size){
+        printf("Error: argument %.*s... is longer than %u characters\n", 20, args, (unsigned)(size - 1));
+        return -1;
+    }
+    memcpy(word, args, n);
+    word[n] = '\0';
+    return 1;
+}
+
+/***************************************************************/
+/* Run one command, its arguments follow it on the same line                          */
 /***************************************************************/
-void handle_command() {
+/* Returns 0 when the command ran, -1 when it is unknown or failed and 1 for
+ * quit. An empty command does nothing. */
+int execute_command(const char *command) {
     char buffer[20];
+    char file[CMD_LINE_MAX];
+    const char *args;
+    int level, kind, n;
     uint32_t start, stop, cycles;
     uint32_t register_no;
     int register_value;
     int hi_reg_value, lo_reg_value;
+    int status = 0;
     
-    printf("MU-MIPS SIM:> ");
-    
-    if (scanf("%s", buffer) == EOF){
-        exit(0);
+    if (sscanf(command, " %19s%n", buffer, &n) != 1){
+        return 0;
     }
+    args = command + n;
     
     switch(buffer[0]) {
         case 'S':
         case 's':
             if (buffer[1] == 'h' || buffer[1] == 'H'){
                 show_pipeline();
+            }else if ((buffer[1] == 'a' || buffer[1] == 'A') && (buffer[2] == 'm' || buffer[2] == 'M')){
+                /*sample [interval [warmup [max k]]]*/
+                if (sscanf(args, "%u", &start) != 1){
+                    start = SAMPLE_DEFAULT_INTERVAL;
+                }
+                if (sscanf(args, "%*u %u", &stop) != 1){
+                    stop = SAMPLE_DEFAULT_WARMUP;
+                }
+                if (sscanf(args, "%*u %*u %d", &level) != 1){
+                    level = SAMPLE_MAX_K;
+                }
+                if (sample_run(start, stop, level) < 0){
+                    status = -1;
+                }
+            }else if (buffer[1] == 'a' || buffer[1] == 'A'){
+                /*save <file>*/
+                if ((n = arg_word(args, 0, file, sizeof(file))) != 1){
+                    status = n < 0 ? -1 : bad_arguments(buffer);
+                    break;
+                }
+                if ((level = snapshot_save(file)) < 0){
+                    status = -1;
+                    break;
+                }
+                printf("Saved state at cycle %u (%d pages) to %s.\n", CYCLE_COUNT, level, file);
+            }else if (buffer[1] == 'n' || buffer[1] == 'N'){
+                /*snap [n]*/
+                if (sscanf(args, "%d", &level) != 1){
+                    level = -1;
+                }
+                if ((level = snapshot_take(level)) < 0){
+                    status = -1;
+                    break;
+                }
+                printf("Snapshot %d taken at cycle %u.\n", level, CYCLE_COUNT);
+            }else if (buffer[1] == 'w' || buffer[1] == 'W'){
+                /*sweep <file> [n]*/
+                if ((n = arg_word(args, 0, file, sizeof(file))) != 1){
+                    status = n < 0 ? -1 : bad_arguments(buffer);
+                    break;
+                }
+                if (sscanf(args, "%*s %u", &cycles) != 1){
+                    cycles = LS_DEFAULT_MAX;
+                }
+                if (lockstep_sweep(file, cycles) < 0){
+                    status = -1;
+                }
+            }else if (buffer[1] == 't' || buffer[1] == 'T'){
+                /*stats [json [file]]*/
+                if (sscanf(args, "%19s", buffer) != 1 || strcmp(buffer, "json") != 0){
+                    stats_print(stdout);
+                }else if ((n = arg_word(args, 1, file, sizeof(file))) == 1){
+                    if (stats_dump_json(file) != 0){
+                        status = -1;
+                    }
+                }else if (n < 0){
+                    status = -1;
+                }else {
+                    stats_print_json(stdout);
+                }
             }else {
                 runAll();
             }
             break;
+        case 'C':
+        case 'c':
+            status = handle_cache_command(args);
+            break;
+        case 'O':
+        case 'o':
+            status = handle_ooo_command(args);
+            break;
+        case 'U':
+        case 'u':
+            status = handle_unit_command(args);
+            break;
         case 'M':
         case 'm':
-            if (scanf("%x %x", &start, &stop) != 2){
+            if (buffer[1] == 'u' || buffer[1] == 'U'){
+                /*multi <n> [quantum [max cycles]]*/
+                if (sscanf(args, "%d", &level) != 1){
+                    status = bad_arguments(buffer);
+                    break;
+                }
+                if (sscanf(args, "%*d %u", &start) != 1){
+                    start = MC_DEFAULT_QUANTUM;
+                }
+                if (sscanf(args, "%*d %*u %u", &cycles) != 1){
+                    cycles = 0;
+                }
+                if (multicore_run(level, start, cycles) < 0){
+                    status = -1;
+                }
+                break;
+            }
+            if (sscanf(args, "%x %x", &start, &stop) != 2){
+                status = bad_arguments(buffer);
                 break;
             }
             mdump(start, stop);
@@ -197,19 +658,53 @@ void handle_command() {
             break;
         case 'Q':
         case 'q':
-            printf("**************************\n");
-            printf("Exiting MU-MIPS! Good Bye...\n");
-            printf("**************************\n");
-            exit(0);
+            status = 1;
+            break;
         case 'R':
         case 'r':
             if (buffer[1] == 'd' || buffer[1] == 'D'){
                 rdump();
+            }else if (buffer[1] == 's' || buffer[1] == 'S'){
+                /*rstep [n]*/
+                if (sscanf(args, "%u", &cycles) != 1){
+                    cycles = 1;
+                }
+                status = reverse_step(cycles);
+            }else if (buffer[1] == 'c' || buffer[1] == 'C'){
+                status = reverse_continue();
+            }else if ((buffer[1] == 'e' || buffer[1] == 'E') && (buffer[2] == 'c' || buffer[2] == 'C')){
+                /*record [on|off] [interval]*/
+                if (sscanf(args, "%19s", file) != 1){
+                    reverse_print(stdout);
+                    break;
+                }
+                if (strcmp(file, "on") != 0 && strcmp(file, "off") != 0){
+                    status = bad_arguments(buffer);
+                    break;
+                }
+                if (sscanf(args, "%*s %u", &cycles) != 1){
+                    cycles = 0;
+                }
+                if ((status = reverse_record(strcmp(file, "on") == 0, cycles)) == 0){
+                    reverse_print(stdout);
+                }
+            }else if((buffer[1] == 'e' || buffer[1] == 'E') && (buffer[3] == 't' || buffer[3] == 'T')){
+                /*restore <n>*/
+                if (sscanf(args, "%d", &level) != 1){
+                    status = bad_arguments(buffer);
+                    break;
+                }
+                if (snapshot_restore(level) != 0){
+                    status = -1;
+                    break;
+                }
+                printf("Restored snapshot %d, cycle %u.\n", level, CYCLE_COUNT);
             }else if(buffer[1] == 'e' || buffer[1] == 'E'){
                 reset();
             }
             else {
-                if (scanf("%d", &cycles) != 1) {
+                if (sscanf(args, "%u", &cycles) != 1) {
+                    status = bad_arguments(buffer);
                     break;
                 }
                 run(cycles);
@@ -217,7 +712,8 @@ void handle_command() {
             break;
         case 'I':
         case 'i':
-            if (scanf("%u %i", &register_no, &register_value) != 2){
+            if (sscanf(args, "%u %i", &register_no, &register_value) != 2 || register_no >= MIPS_REGS){
+                status = bad_arguments(buffer);
                 break;
             }
             CURRENT_STATE.REGS[register_no] = register_value;
@@ -225,7 +721,8 @@ void handle_command() {
             break;
         case 'H':
         case 'h':
-            if (scanf("%i", &hi_reg_value) != 1){
+            if (sscanf(args, "%i", &hi_reg_value) != 1){
+                status = bad_arguments(buffer);
                 break;
             }
             CURRENT_STATE.HI = hi_reg_value;
@@ -233,7 +730,21 @@ void handle_command() {
             break;
         case 'L':
         case 'l':
-            if (scanf("%i", &lo_reg_value) != 1){
+            if (buffer[2] == 'a' || buffer[2] == 'A'){
+                /*load <file>*/
+                if ((n = arg_word(args, 0, file, sizeof(file))) != 1){
+                    status = n < 0 ? -1 : bad_arguments(buffer);
+                    break;
+                }
+                if ((level = snapshot_load(file)) < 0){
+                    status = -1;
+                    break;
+                }
+                printf("Loaded state at cycle %u (%d pages) from %s.\n", CYCLE_COUNT, level, file);
+                break;
+            }
+            if (sscanf(args, "%i", &lo_reg_value) != 1){
+                status = bad_arguments(buffer);
                 break;
             }
             CURRENT_STATE.LO = lo_reg_value;
@@ -243,16 +754,231 @@ void handle_command() {
         case 'p':
             print_program();
             break;
+        case 'B':
+        case 'b':
+            if (buffer[1] == 'e' || buffer[1] == 'E'){
+                if (sscanf(args, "%u", &cycles) != 1){
+                    status = bad_arguments(buffer);
+                    break;
+                }
+                bench_engines(cycles);
+                break;
+            }
+            if (buffer[1] == 'r' || buffer[1] == 'R'){
+                /*break [addr]*/
+                if (sscanf(args, "%x", &start) != 1){
+                    debug_print(stdout);
+                }else if (debug_break_add(start) != 0){
+                    status = -1;
+                }
+                break;
+            }
+            if (buffer[1] == 'p' || buffer[1] == 'P'){
+                /*bpred <kind> [bits]*/
+                if (sscanf(args, "%19s", buffer) != 1){
+                    status = bad_arguments("bpred");
+                    break;
+                }
+                if ((kind = bpred_parse_kind(buffer)) < 0){
+                    printf("Predictor must be nottaken, bimodal, gshare or btb (now %s).\n", bpred_kind_name(BPRED.kind));
+                    status = -1;
+                    break;
+                }
+                if (sscanf(args, "%*s %u", &start) != 1){
+                    start = BPRED.bits;
+                }
+                if (bpred_configure(kind, start) != 0){
+                    status = -1;
+                    break;
+                }
+                printf("Branch predictor %s, %d bits.\n", bpred_kind_name(BPRED.kind), BPRED.bits);
+                break;
+            }
+            if ((n = arg_word(args, 0, file, sizeof(file))) != 1){
+                status = n < 0 ? -1 : bad_arguments(buffer);
+                break;
+            }
+            if (strcmp(file, "off") == 0){
+                btrace_close();
+            } else if (btrace_open(file) != 0){
+                status = -1;
+            }
+            break;
+        case 'F':
+        case 'f':
+            if (buffer[1] == 'f' || buffer[1] == 'F'){
+                /*ff <n> [interp|threaded|dbt]*/
+                if (sscanf(args, "%u", &cycles) != 1){
+                    status = bad_arguments(buffer);
+                    break;
+                }
+                if (sscanf(args, "%*u %19s", buffer) != 1){
+                    kind = ENGINE_DBT;
+                }else if ((kind = engine_parse(buffer)) <= ENGINE_PIPELINE){
+                    printf("Fast-forward engine must be interp, threaded or dbt.\n");
+                    status = -1;
+                    break;
+                }
+                fast_forward(cycles, kind);
+                break;
+            }
+            if (sscanf(args, "%19s", buffer) != 1 || (strcmp(buffer, "on") != 0 && strcmp(buffer, "off") != 0)){
+                printf("Usage: forward on|off\n");
+                status = -1;
+                break;
+            }
+            HAZARD.forwarding = strcmp(buffer, "on") == 0;
+            printf("Forwarding %s.\n", HAZARD.forwarding ? "enabled" : "disabled");
+            break;
+        case 'T':
+        case 't':
+            if ((n = arg_word(args, 1, file, sizeof(file))) < 0){
+                status = -1;
+                break;
+            }
+            n += sscanf(args, "%19s", buffer) == 1;
+            if (n == 2 && trace_open(strcmp(file, "-") ? file : NULL) != 0){
+                status = -1;
+                break;
+            }
+            if (n < 1 || (level = trace_parse_level(buffer)) < 0){
+                printf("Trace level must be off, summary, inst or stage (now %s).\n", trace_level_name(TRACE_LEVEL));
+                status = -1;
+                break;
+            }
+            trace_set_level(level);
+            break;
+        case 'D':
+        case 'd':
+            /*delete <addr>|all*/
+            if (sscanf(args, "%19s", file) == 1 && strcmp(file, "all") == 0){
+                debug_clear();
+            }else if (sscanf(args, "%x", &start) != 1){
+                status = bad_arguments(buffer);
+            }else if (debug_delete(start) != 0){
+                status = -1;
+            }
+            break;
+        case 'W':
+        case 'w':
+            if (buffer[1] == 'a' || buffer[1] == 'A'){
+                /*watch [r|w|rw] <addr> [len]*/
+                kind = WATCH_WRITE;
+                n = 0;
+                if (sscanf(args, "%19s%n", file, &n) == 1 && strspn(file, "rw") == strlen(file)){
+                    kind = (strchr(file, 'r') ? WATCH_READ : 0) | (strchr(file, 'w') ? WATCH_WRITE : 0);
+                }else {
+                    n = 0;
+                }
+                if (sscanf(args + n, "%x", &start) != 1){
+                    status = bad_arguments(buffer);
+                    break;
+                }
+                if (sscanf(args + n, "%*x %u", &stop) != 1){
+                    stop = 4;
+                }
+                if (debug_watch_add(start, stop, kind) != 0){
+                    status = -1;
+                }
+                break;
+            }
+            /*width [n]*/
+            if (sscanf(args, "%d", &kind) == 1 && pipeline_set_width(kind) != 0){
+                status = -1;
+                break;
+            }
+            printf("Pipeline width %d.\n", PIPE_WIDTH);
+            break;
         default:
             printf("Invalid Command.\n");
+            status = -1;
             break;
     }
+    return status;
+}
+
+/***************************************************************/
+/* Run the commands in text, separated by ';' or new lines                               */
+/***************************************************************/
+/* A '#' starts a comment that runs to the end of its line. Stops at the first
+ * command that fails or quits and returns its status. */
+int run_commands(char *text) {
+    char *command = text, *next;
+    size_t n;
+    int status;
+    
+    while (command != NULL){
+        n = strcspn(command, ";#\n");
+        if (command[n] == '#'){
+            next = strchr(command + n, '\n');
+        }else {
+            next = command[n] == '\0' ? NULL : command + n;
+        }
+        if (next != NULL){
+            next++;
+        }
+        command[n] = '\0';
+        if ((status = execute_command(command)) != 0){
+            return status;
+        }
+        command = next;
+    }
+    return 0;
+}
+
+/* Read a line of at most CMD_LINE_MAX - 1 characters, 0 at the end of the
+ * input. A longer one is skipped rather than run in pieces, -1. */
+static int read_line(char *line, FILE *in) {
+    size_t n;
+    int c;
+    
+    if (fgets(line, CMD_LINE_MAX, in) == NULL){
+        return 0;
+    }
+    n = strlen(line);
+    if (n == CMD_LINE_MAX - 1 && line[n - 1] != '\n' && !feof(in)){
+        while ((c = fgetc(in)) != EOF && c != '\n');
+        printf("Error: command line longer than %d characters\n", CMD_LINE_MAX - 2);
+        return -1;
+    }
+    return 1;
+}
+
+/***************************************************************/
+/* Read a command line from standard input.                                                         */
+/***************************************************************/
+/* Returns as run_commands does, and 1 at the end of the input. */
+int handle_command() {
+    char line[CMD_LINE_MAX];
+    int n;
+    
+    trace_flush();
+    printf("MU-MIPS SIM:> ");
+    fflush(stdout);
+    
+    if ((n = read_line(line, stdin)) <= 0){
+        return n == 0 ? 1 : -1;
+    }
+    return run_commands(line);
 }
 
 /***************************************************************/
 /* reset registers/memory and reload program                                                    */
 /***************************************************************/
 void reset() {
+    /*zero only the pages the last run touched*/
+    mem_reset();
+    
+    /*restore program from the cached image*/
+    restore_program();
+    
+    reset_state();
+}
+
+/***************************************************************/
+/* clear registers, pipeline and counters, PC back to the entry point           */
+/***************************************************************/
+void reset_state() {
     int i;
     /*reset registers*/
     for (i = 0; i < MIPS_REGS; i++){
@@ -260,61 +986,68 @@ void reset() {
     }
     CURRENT_STATE.HI = 0;
     CURRENT_STATE.LO = 0;
+    func_clear_link();
     
-    for (i = 0; i < NUM_MEM_REGION; i++) {
-        uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-        memset(MEM_REGIONS[i].mem, 0, region_size);
-    }
-    
-    /*load program*/
-    load_program();
+    /*empty the pipeline*/
+    memset(&IF_ID, 0, sizeof(IF_ID));
+    memset(&ID_EX, 0, sizeof(ID_EX));
+    memset(&EX_MEM, 0, sizeof(EX_MEM));
+    memset(&MEM_WB, 0, sizeof(MEM_WB));
+    ooo_reset();
+    fu_reset();
+    stats_reset();
+    bpred_reset();
+    cache_reset();
     
     /*reset PC*/
     INSTRUCTION_COUNT = 0;
-    CURRENT_STATE.PC =  MEM_TEXT_BEGIN;
+    CYCLE_COUNT = 0;
+    CURRENT_STATE.PC = PROGRAM_IMAGE.entry;
     NEXT_STATE = CURRENT_STATE;
     RUN_FLAG = TRUE;
 }
 
-/***************************************************************/
-/* Allocate and set memory to zero                                                                            */
-/***************************************************************/
-void init_memory() {
-    int i;
-    for (i = 0; i < NUM_MEM_REGION; i++) {
-        uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-        MEM_REGIONS[i].mem = malloc(region_size);
-        memset(MEM_REGIONS[i].mem, 0, region_size);
+/**************************************************************/
+/* load program into memory                                                                                      */
+/**************************************************************/
+void load_program() {
+    if (loader_load(prog_file, LOAD_FORMAT) != 0) {
+        exit(-1);
+    }
+    PROGRAM_SIZE = PROGRAM_IMAGE.text_words;
+    CURRENT_STATE.PC = PROGRAM_IMAGE.entry;
+    NEXT_STATE.PC = PROGRAM_IMAGE.entry;
+    if (!QUIET) {
+        printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_IMAGE.words);
     }
+    decode_loaded_program();
 }
 
 /**************************************************************/
-/* load program into memory                                                                                      */
+/* decode the program once, the pipeline works on the decoded records  */
 /**************************************************************/
-void load_program() {
-    FILE * fp;
-    int i, word;
-    uint32_t address;
+void decode_loaded_program() {
+    int i;
+    const load_segment_t *seg;
     
-    /* Open program file. */
-    fp = fopen(prog_file, "r");
-    if (fp == NULL) {
-        printf("Error: Can't open program file %s\n", prog_file);
+    for (i = 0; i < PROGRAM_IMAGE.num_segs; i++) {
+        seg = &PROGRAM_IMAGE.segs[i];
+        if (seg->exec) {
+            decode_program(seg->addr, seg->len / 4);
+        }
+    }
+}
+
+/**************************************************************/
+/* copy the loaded segments back into memory                                                        */
+/**************************************************************/
+void restore_program() {
+    if (loader_restore() != 0) {
         exit(-1);
     }
-    
-    /* Read in the program. */
-    
-    i = 0;
-    while( fscanf(fp, "%x\n", &word) != EOF ) {
-        address = MEM_TEXT_BEGIN + i;
-        mem_write_32(address, word);
-        printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
-        i += 4;
+    if (!QUIET) {
+        printf("Program restored into memory.\n%d words written into memory.\n\n", PROGRAM_IMAGE.words);
     }
-    PROGRAM_SIZE = i/4;
-    printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
-    fclose(fp);
 }
 
 /************************************************************/
@@ -322,10 +1055,31 @@ void load_program() {
 /************************************************************/
 void handle_pipeline()
 {
-    /*INSTRUCTION_COUNT should be incremented when instruction is done*/
-    /*Since we do not have branch/jump instructions, INSTRUCTION_COUNT should be incremented in WB stage */
+    int i;
+    
+    if (OOO.enabled){
+        ooo_cycle();
+        return;
+    }
+    /*INSTRUCTION_COUNT is incremented in WB, squashed wrong-path instructions never get there*/
     
+    /*stall decisions and forwarding sources come from the latches before any stage updates them*/
+    hazard_detect();
     WB();
+    if (RUN_FLAG == FALSE){
+        /*the halting syscall retired, nothing behind it reaches memory or the registers, as in the other engines*/
+        for (i = 0; i < PIPE_WIDTH; i++){
+            if (MEM_WB[i].inst != NULL && (MEM_WB[i].inst->flags & INST_HALT)){
+                NEXT_STATE.PC = MEM_WB[i].PC;
+            }
+        }
+        memset(&MEM_WB, 0, sizeof(MEM_WB));
+        memset(&EX_MEM, 0, sizeof(EX_MEM));
+        memset(&ID_EX, 0, sizeof(ID_EX));
+        memset(&IF_ID, 0, sizeof(IF_ID));
+        cache_cancel_fetch();
+        return;
+    }
     MEM();
     EX();
     ID();
@@ -337,33 +1091,46 @@ void handle_pipeline()
 /************************************************************/
 void WB()
 {
-uint32_t line = 0, op = 0, rt = 0, rd = 0;
-	line = MEM_WB.IR;
-	rt = (line & 0x001F0000) >> 16;
-	rd = (line & 0x0000F800) >> 11;
-	if ( line == 12){
-		RUN_FLAG = FALSE;
-	}
- 
-    if ((line | 0x03FFFFFF) ==  0x03FFFFFF){
-        //reg-reg instructions
-        NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-    } else {
-        op = line & 0xFC000000;
-        if (op == 0x8C000000 || op == 0x80000000 || op == 0x81000000){
-            //load
-            NEXT_STATE.REGS[rt] = MEM_WB.LMD;
+    const decoded_inst_t *d;
+    int i;
+    
+    /*in slot order, so the younger of two writes to a register lands last*/
+    for (i = 0; i < PIPE_WIDTH; i++) {
+        d = MEM_WB[i].inst;
+        if (d == NULL) {
+            /*bubbles are not instructions*/
+            STATS.bubbles++;
+            continue;
+        }
+        if (d->flags & INST_HALT){
+            RUN_FLAG = FALSE;
+        }
+        if ((d->flags & INST_WRITES_REG) && d->dest != 0){
+            if (REVERSE.logging){
+                reverse_undo_reg(d->dest, NEXT_STATE.REGS[d->dest]);
+            }
+            NEXT_STATE.REGS[d->dest] = (d->flags & INST_LOAD) ? MEM_WB[i].LMD : MEM_WB[i].ALUOutput;
         }
-        else if (op == 0xA0000000 || op == 0xA1000000 || op == 0xAC000000 ){
-            //store
-            
-        } else {
-            //immediate instructions
-            NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;;
+        if (d->flags & INST_WRITES_HI){
+            if (REVERSE.logging){
+                reverse_undo_reg(32, NEXT_STATE.HI);
+            }
+            NEXT_STATE.HI = MEM_WB[i].HI;
         }
+        if (d->flags & INST_WRITES_LO){
+            if (REVERSE.logging){
+                reverse_undo_reg(33, NEXT_STATE.LO);
+            }
+            NEXT_STATE.LO = MEM_WB[i].LO;
+        }
+        INSTRUCTION_COUNT++;
+        STATS.retired++;
+        STATS.ops[d->op]++;
+        TRACE(TRACE_INST, "%u: retire 0x%08x: 0x%08x\n", CYCLE_COUNT, MEM_WB[i].PC - 4, d->raw);
+    }
+    if (TRACE_ON(TRACE_STAGE)){
+        print_pipeline(TRACE_OUT);
     }
-    INSTRUCTION_COUNT++;
-	show_pipeline();
 }
 
 /************************************************************/
@@ -371,42 +1138,36 @@ uint32_t line = 0, op = 0, rt = 0, rd = 0;
 /************************************************************/
 void MEM()
 {
-	MEM_WB = registerpass(EX_MEM);
-	uint32_t line = 0, op = 0;
-	line = MEM_WB.IR;
+	const decoded_inst_t *d;
+	int i;
 	
-	if ((line | 0x03FFFFFF) != 0x03FFFFFF){
-	op = line & 0xFC000000;
-		switch (op){// only cases that matter are store and load
-			   case 0x80000000:
-               		   //LB
-               		   MEM_WB.LMD = mem_read_32(EX_MEM.ALUOutput) & 0x000000FF;
-                	   break;
-            		   case 0x81000000:
-                	   //LH
-                	   MEM_WB.LMD = mem_read_32(EX_MEM.ALUOutput) & 0x0000FFFF;
-                	   break;
-            		   case 0x8C000000:
-                	   //LW
-                	   MEM_WB.LMD = mem_read_32(EX_MEM.ALUOutput);
-                	   break;
-            		   case 0xA0000000:
-                	   //SB
-                	   mem_write_32(EX_MEM.ALUOutput, CURRENT_STATE.REGS[EX_MEM.B] & 0x000000FF);
-                    	   break;
-            		   case 0xA1000000:
-               	  	   //SH
-               		   mem_write_32(EX_MEM.ALUOutput, CURRENT_STATE.REGS[EX_MEM.B] & 0x0000FFFF);
-              		   break;
-           		   case 0xAC000000:
-               		   //SW
-                	   printf("Store word called\n");
-			//	printf("the value of CSR.B is %x",EX_MEM.B);
-                	   mem_write_32(EX_MEM.ALUOutput, CURRENT_STATE.REGS[EX_MEM.B]);
-               		   break;
-                
-        	     	   default:
-                	   break;
+	/*a bundle has at most one load or store, ID saw to that*/
+	for (i = 0; i < PIPE_WIDTH; i++){
+		MEM_WB[i] = registerpass(EX_MEM[i]);
+		d = MEM_WB[i].inst;
+		if (d == NULL || !(d->flags & (INST_LOAD | INST_STORE))){
+			continue;
+		}
+		if (!cache_data_ready(EX_MEM[i].ALUOutput, d->flags & INST_STORE)){
+			/*the whole bundle completes on a later cycle, WB gets bubbles meanwhile*/
+			memset(&MEM_WB, 0, sizeof(MEM_WB));
+			hazard_freeze();
+			TRACE(TRACE_STAGE, "MEM: data cache miss at 0x%08x\n", EX_MEM[i].ALUOutput);
+			return;
+		}
+		TRACE(TRACE_STAGE, "MEM: 0x%08x address 0x%08x\n", d->raw, EX_MEM[i].ALUOutput);
+		if (d->flags & INST_STORE){
+			STATS.stores++;
+		} else {
+			STATS.loads++;
+		}
+		fu_enter(d, CYCLE_COUNT);
+		if (REVERSE.logging && (d->flags & INST_STORE)){
+			reverse_undo_mem(d, EX_MEM[i].ALUOutput);
+		}
+		MEM_WB[i].LMD = func_access(d, EX_MEM[i].ALUOutput, EX_MEM[i].B);
+		if (DEBUG_PAGE(EX_MEM[i].ALUOutput, DEBUG_PAGE_WATCH)){
+			debug_watch_access(d, EX_MEM[i].PC - 4, EX_MEM[i].ALUOutput);
 		}
 	}
 }
@@ -415,179 +1176,57 @@ void MEM()
 /* execution (EX) pipeline stage:                                                                          */
 /************************************************************/
 void EX()
-
 {
-	EX_MEM = registerpass(ID_EX);
-	uint32_t line = 0, funct = 0, op = 0;
-	line = EX_MEM.IR;
-
-	if ((line | 0x03FFFFFF) == 0x03FFFFFF ){// r type instruction
-		funct = line & 0x0000003F;
-		switch(funct){
-			case 0x20 ... 0x21:
-			// ADD and ADDU
-			printf("ADD rd, %d, %d \n", ID_EX.A, ID_EX.B);
-			EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.A] + CURRENT_STATE.REGS[ID_EX.B];
-               		break;
-			 case 0x22 ... 0x23:
-                        //SUB and SUBU
-                        printf("\nSUB rd, %x, %x\n", ID_EX.A, ID_EX.B);
-                	EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.A] - CURRENT_STATE.REGS[ID_EX.B];
-                	break;
-            		case	 0x18 ... 0x19:
-                	//MULT and MULTU
-                	//store the high and low to next register
-			printf("mult rd, %d, %d \n", ID_EX.A, ID_EX.B);
-                	EX_MEM.HI = CURRENT_STATE.REGS[ID_EX.A] * CURRENT_STATE.REGS[ID_EX.B] & 0xFFFF0000;
-                	EX_MEM.LO = CURRENT_STATE.REGS[ID_EX.A] * CURRENT_STATE.REGS[ID_EX.B] & 0x0000FFFF;
-                	break;
-            		
-			case 0x1A ... 0x1B:
-                	//DIV and DIVU
-                	if (CURRENT_STATE.REGS[ID_EX.B] == 0x0){
-                	    EX_MEM.LO = ID_EX.LO;
-                	    EX_MEM.HI = ID_EX.HI;
-                	} else {
-			    printf("DIV rd, %d, %d \n", ID_EX.A, ID_EX.B);
-                	    EX_MEM.LO = CURRENT_STATE.REGS[ID_EX.A] / CURRENT_STATE.REGS[ID_EX.B];
-                	    EX_MEM.HI = CURRENT_STATE.REGS[ID_EX.A] % CURRENT_STATE.REGS[ID_EX.B];
-                	}
-                	break;	
-			 case 0x24:
-              		//AND
-                	EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.A] & CURRENT_STATE.REGS[ID_EX.B];
-			printf("AND operation, %d, %d \n", ID_EX.A, ID_EX.B);
-                	break;
-            		case 0x25:
-            		//OR
-                	EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.A] | CURRENT_STATE.REGS[ID_EX.B];
-			printf("OR Operation, %d, %d \n", ID_EX.A, ID_EX.B);
-                	break;
-            		case 0x26:
-                	//XOR
-                	EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.A] ^ CURRENT_STATE.REGS[ID_EX.B];
-			printf("XOR Operation, %d, %d \n", ID_EX.A, ID_EX.B);
-                	break;
-            		case 0x27:
-                	//NOR
-                	EX_MEM.ALUOutput = !(CURRENT_STATE.REGS[ID_EX.A] | CURRENT_STATE.REGS[ID_EX.B]);
-			printf("NOR Operation, %d, %d \n", ID_EX.A, ID_EX.B);
-                	break;
-            		case 0x2A:
-                	//SLT
-			printf("SLT Operation %d, %d \n", ID_EX.A, ID_EX.B);
-                	if (CURRENT_STATE.REGS[ID_EX.A] < CURRENT_STATE.REGS[ID_EX.B]){
-                	    EX_MEM.ALUOutput = 1;
-                	} else {
-                	    EX_MEM.ALUOutput = 0;
-                	}
-                	break;
-            		case 0x00:
-		//	printf("SLL Operation %d, %d \n", ID_EX.A, ID_EX.B);
-                	//SLL
-                	EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.B] << ID_EX.shampt;
-                	break;
-            		case 0x03:
-                	//SRA
-			printf("SRA Operation, %d, %d \n", ID_EX.A, ID_EX.B);
-                	if ((CURRENT_STATE.REGS[IF_ID.B] & 0x08000000) == 0x08000000){
-                	    for (int i = 0; i < ID_EX.shampt; i++){
-                        	EX_MEM.ALUOutput = (CURRENT_STATE.REGS[ID_EX.B] >> 1) | 0x08000000;
-                    		}
-                	}
-			 else {
-                 		   EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.B] >> ID_EX.shampt;
-               		 }
-                	break;
-            		case 0x02:
-                	//SRL
-                	EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.B] >> ID_EX.shampt;
-                	break;
-            		case 0x10:
-                	//MFHI
-                	EX_MEM.ALUOutput = ID_EX.HI;
-                	break;
-            		case 0x11:
-                	//MTHI
-                	EX_MEM.HI = ID_EX.HI;
-                	break;
-            		case 0x12:
-	                //MFLO
-        	        EX_MEM.ALUOutput = ID_EX.LO;
-        	        break;
-        	    case 0x13:
-        	        //MTLO
-        	        EX_MEM.LO = ID_EX.LO;
-        	        break;
-        	}//switch bracket
-	}//if bracket
-	else {//immediate instruction
-	op = line & 0xFC000000;
-	switch (op){
-		 case 0x20000000 ... 0x24000000:
-                //ADDI and ADDIU
-                printf("ADDI and ADDIU\n");
-                EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.A] + ID_EX.imm;
-                break;
-            case 0x30000000:
-                //ANDI
-                EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.A] & ID_EX.imm;
-                break;
-            case 0x34000000:
-                //ORI
-                EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.A] | ID_EX.imm;
-                break;
-            case 0x38000000:
-                //XORI
-                EX_MEM.ALUOutput = CURRENT_STATE.REGS[ID_EX.A] ^ ID_EX.imm;
-                break;
-            case 0x28000000:
-                //SLTI
-                if (CURRENT_STATE.REGS[EX_MEM.A] < EX_MEM.imm){
-                    EX_MEM.ALUOutput = 1;
-                } else {
-                    EX_MEM.ALUOutput = 0;
-                }
-                break;
-            case 0x8C000000:
-                //LW
-                EX_MEM.ALUOutput = (CURRENT_STATE.REGS[ID_EX.A] + ID_EX.imm);
-                EX_MEM.B = ID_EX.B;
-                break;
-            case 0x80000000:
-                //LB
-                EX_MEM.ALUOutput = (CURRENT_STATE.REGS[ID_EX.A] + ID_EX.imm);
-                EX_MEM.B = ID_EX.B;
-                break;
-            case 0x81000000:
-                //LH
-                EX_MEM.ALUOutput = (CURRENT_STATE.REGS[ID_EX.A] + ID_EX.imm);
-                EX_MEM.B = ID_EX.B;
-                break;
-            case 0x3C000000:
-                //LUI
-                EX_MEM.ALUOutput = ID_EX.imm << 16;
-                EX_MEM.B = ID_EX.B;
-                break;
-            case 0xAC000000:
-                //SW
-                EX_MEM.ALUOutput = (CURRENT_STATE.REGS[ID_EX.A] + ID_EX.imm);
-                EX_MEM.B = ID_EX.B;
-		printf("EX_MEM.B is %x",CURRENT_STATE.REGS[EX_MEM.B]);
-                break;
-            case 0xA0000000:
-                //SB
-                EX_MEM.ALUOutput = (CURRENT_STATE.REGS[ID_EX.A] + ID_EX.imm);
-                EX_MEM.B = ID_EX.B;
-                break;
-            case 0xA1000000:
-                //SH
-                EX_MEM.ALUOutput = (CURRENT_STATE.REGS[ID_EX.A] + ID_EX.imm);
-                EX_MEM.B = ID_EX.B;
-                break;
-        }
-    }
-			
+	const decoded_inst_t *d;
+	int i;
+	
+	if (HAZARD.freeze){
+		/*held in ID/EX, keep up with the register file WB wrote this cycle*/
+		for (i = 0; i < PIPE_WIDTH; i++){
+			if (ID_EX[i].inst != NULL){
+				ID_EX[i].A = NEXT_STATE.REGS[ID_EX[i].inst->rs];
+				ID_EX[i].B = NEXT_STATE.REGS[ID_EX[i].inst->rt];
+			}
+		}
+		return;
+	}
+	for (i = 0; i < PIPE_WIDTH; i++){
+		if (HAZARD.flush){
+			/*fetched after a mispredicted branch earlier in the bundle*/
+			if (ID_EX[i].inst != NULL){
+				STATS.flushed++;
+			}
+			memset(&EX_MEM[i], 0, sizeof(EX_MEM[i]));
+			continue;
+		}
+		EX_MEM[i] = registerpass(ID_EX[i]);
+		d = EX_MEM[i].inst;
+		if (d == NULL){
+			continue;
+		}
+		/*operands read in ID, replaced by younger results from the forwarding paths*/
+		if (d->flags & INST_READS_RS){
+			EX_MEM[i].A = hazard_operand(d->rs, ID_EX[i].A);
+		}
+		if (d->flags & INST_READS_RT){
+			EX_MEM[i].B = hazard_operand(d->rt, ID_EX[i].B);
+		}
+		d->exec(d, &EX_MEM[i], EX_MEM[i].A, EX_MEM[i].B);
+		if (!(d->flags & (INST_LOAD | INST_STORE))){
+			/*loads and stores enter the memory port in MEM*/
+			fu_enter(d, CYCLE_COUNT);
+		}
+		if (d->flags & INST_CTRL){
+			/*resolve against the path IF took, ID and IF run after EX and see the flush*/
+			bpred_update(EX_MEM[i].PC - 4, d, EX_MEM[i].tar, EX_MEM[i].predPC);
+			if (EX_MEM[i].tar != EX_MEM[i].predPC){
+				TRACE(TRACE_STAGE, "EX: mispredict 0x%08x, fetch 0x%08x\n", EX_MEM[i].PC - 4, EX_MEM[i].tar);
+				hazard_flush(EX_MEM[i].tar);
+			}
+		}
+		TRACE(TRACE_STAGE, "EX: 0x%08x A 0x%08x B 0x%08x ALUOutput 0x%08x\n", d->raw,
+		      EX_MEM[i].A, EX_MEM[i].B, EX_MEM[i].ALUOutput);
+	}
 }
 
 /************************************************************/
@@ -595,46 +1234,89 @@ void EX()
 /************************************************************/
 void ID()
 {
-    ID_EX = registerpass(IF_ID);
-    uint32_t line=0 , rs=0, rt=0, shampt=0, immediate=0 , op = 0;
-	line = IF_ID.IR;
-	 rs = (line & 0x03E00000) >> 21;
-         rt = (line & 0x001F0000) >> 16;
-
-    if ((line | 0x03FFFFFF) ==  0x03FFFFFF){
-        shampt = (line & 0x000007C0) >> 6;
-    } 
-	else {
-        immediate = line & 0x0000FFFF;
-        op = line & 0xFC000000;
-        if (op == 0x30000000 || op == 0x34000000 || op == 0x38000000){
-            //ANDI, ORI, XORI are 0 extended
-  
-            ID_EX.imm = immediate;
-        } else {
-            ID_EX.imm = sign_extension_32(immediate);
+    const decoded_inst_t *d;
+    int i, n;
+    
+    if (HAZARD.freeze){
+        STATS.issued[0]++;
+        return;
+    }
+    /*after a flush the instructions in IF/ID were fetched down the wrong path*/
+    n = HAZARD.flush ? 0 : HAZARD.issue;
+    for (i = 0; HAZARD.flush && i < PIPE_WIDTH; i++){
+        if (IF_ID[i].inst != NULL){
+            STATS.flushed++;
         }
     }
-  printf("the value of EX_MEM.ALUOuutput is %x",CURRENT_STATE.REGS[ID_EX.A]);  
-    ID_EX.A = rs;
-    ID_EX.B = rt;
-    ID_EX.shampt = shampt;
-//printf("the value of EX_MEM.ALUOuutput is %x",ID_EX.A);
-// printf("the value of EX_MEM.ALUOuutput is %x",CURRENT_STATE.REGS[ID_EX.A]);
-    
-    
+    STATS.issued[n]++;
+    if (n > 0 && n < PIPE_WIDTH){
+        STATS.limits[HAZARD.limit]++;
+    }
+    if (HAZARD.stall){
+        /*IF/ID holds its instructions, EX gets bubbles*/
+        TRACE(TRACE_STAGE, "ID: stall on 0x%08x\n", IF_ID[0].IR);
+    }
+    for (i = 0; i < n; i++){
+        ID_EX[i] = registerpass(IF_ID[i]);
+        d = ID_EX[i].inst;
+        /* fields were extracted once when the word was decoded */
+        TRACE(TRACE_STAGE, "ID: 0x%08x rs %d rt %d imm 0x%08x\n", d->raw, d->rs, d->rt, d->imm);
+        /* WB has already run this cycle, so reading NEXT_STATE sees its write */
+        ID_EX[i].A = NEXT_STATE.REGS[d->rs];
+        ID_EX[i].B = NEXT_STATE.REGS[d->rt];
+        ID_EX[i].imm = d->imm;
+        ID_EX[i].shampt = d->shamt;
+    }
+    memset(&ID_EX[n], 0, (PIPE_MAX_WIDTH - n) * sizeof(CPU_Pipeline_Reg));
+    if (n > 0){
+        /*the instructions left behind move to the front, IF fills in after them*/
+        memmove(&IF_ID[0], &IF_ID[n], (PIPE_MAX_WIDTH - n) * sizeof(CPU_Pipeline_Reg));
+        memset(&IF_ID[PIPE_MAX_WIDTH - n], 0, n * sizeof(CPU_Pipeline_Reg));
+    }
 }
 
 /************************************************************/
 /* instruction fetch (IF) pipeline stage:                                                              */
 /************************************************************/
+/* Fetches a bundle into the free IF/ID slots. A bundle ends at a branch
+ * predicted taken and at the end of the instruction cache line. */
 void IF()
 {
-    /*IMPLEMENT THIS*/
-    IF_ID.IR = mem_read_32(CURRENT_STATE.PC);
-    IF_ID.PC = CURRENT_STATE.PC+4;
-    NEXT_STATE.PC = CURRENT_STATE.PC+4;
-	
+    uint32_t pc = CURRENT_STATE.PC;
+    int i;
+    
+    if (HAZARD.flush){
+        /*drop this cycle's wrong-path fetch and start over at the resolved target*/
+        memset(&IF_ID, 0, sizeof(IF_ID));
+        NEXT_STATE.PC = HAZARD.redirect;
+        cache_cancel_fetch();
+        return;
+    }
+    NEXT_STATE.PC = pc;
+    if (HAZARD.stall || HAZARD.freeze || FETCH_OFF){
+        return;
+    }
+    for (i = 0; i < PIPE_WIDTH && IF_ID[i].inst != NULL; i++);
+    if (i == PIPE_WIDTH){
+        return;
+    }
+    if (!cache_fetch_ready(pc)){
+        /*ID gets bubbles until the line arrives*/
+        STATS.stalls[STALL_ICACHE]++;
+        PIPELINE_EVENTS |= PIPE_STALL;
+        return;
+    }
+    do {
+        if (DEBUG_PAGE(NEXT_STATE.PC, DEBUG_PAGE_BREAK)){
+            /*the run stops after this cycle, fetch goes on as it would without the breakpoint*/
+            debug_fetch(NEXT_STATE.PC);
+        }
+        IF_ID[i].inst = decode_fetch(NEXT_STATE.PC);
+        IF_ID[i].IR = IF_ID[i].inst->raw;
+        IF_ID[i].PC = NEXT_STATE.PC+4;
+        IF_ID[i].predPC = bpred_predict(NEXT_STATE.PC, IF_ID[i].inst);
+        NEXT_STATE.PC = IF_ID[i].predPC;
+    } while (++i < PIPE_WIDTH && NEXT_STATE.PC == IF_ID[i-1].PC && cache_same_fetch_line(pc, NEXT_STATE.PC));
 }
 
 
@@ -643,6 +1325,12 @@ void IF()
 /************************************************************/
 void initialize() {
     init_memory();
+    decode_init();
+    tc_init();
+    dbt_init();
+    bpred_reset();
+    cache_init();
+    ooo_reset();
     CURRENT_STATE.PC = MEM_TEXT_BEGIN;
     NEXT_STATE = CURRENT_STATE;
     RUN_FLAG = TRUE;
@@ -657,7 +1345,7 @@ void print_program(){
     uint32_t addr;
     
     for(i=0; i<PROGRAM_SIZE; i++){
-        addr = MEM_TEXT_BEGIN + (i*4);
+        addr = PROGRAM_IMAGE.text_start + (i*4);
         printf("[0x%x]\t", addr);
         print_instruction(mem_read_32(addr));
     }
@@ -666,29 +1354,63 @@ void print_program(){
 /* Print the instruction at given memory address (in MIPS assembly format)    */
 /************************************************************/
 void print_instruction(uint32_t line){
-
+    char text[48];
+    printf("%s\n", disasm(line, text, sizeof(text)));
 }
 
 /************************************************************/
 /* Print the current pipeline                                                                                    */
 /************************************************************/
 void show_pipeline(){
-    /*IMPLEMENT THIS*/
-printf("Current PC: 0x%u \n",CURRENT_STATE.PC);
-printf("IF/ID.IR 0x%u \n",IF_ID.IR );
-printf("IF/ID.PC 0x%u \n",IF_ID.PC);
-printf("ID/EX.IR 0x%u \n",ID_EX.IR);
-printf("ID/EX.A 0x%u \n",ID_EX.A);
-printf("ID/EX.B 0x%u \n",ID_EX.B);
-printf("ID/EX.imm 0x%u \n",ID_EX.imm);
-printf("EX/MEM.IR 0x%u \n",EX_MEM.IR);
-printf("EX/MEM.A 0x%u \n",EX_MEM.A);
-printf("EX/MEM.B 0x%u \n",EX_MEM.B);
-printf("EX/MEM.ALU 0x%u \n",EX_MEM.ALUOutput);
-printf("MEM/WB.IR 0x%u \n",MEM_WB.IR);
-printf("MEM/WB.ALUOutput 0x%u \n",MEM_WB.ALUOutput);
-printf("MEM/WB.LMD 0x%u \n",MEM_WB.LMD);
+    if (OOO.enabled){
+        ooo_print_window(stdout);
+        return;
+    }
+    print_pipeline(stdout);
+}
+
+/************************************************************/
+/* Print the pipeline registers to out                                                                     */
+/************************************************************/
+/* with more than one slot each line names its slot, IF/ID[1].IR */
+void print_pipeline(FILE *out){
+    char s[8] = "";
+    int i;
     
+    fprintf(out, "Current PC: 0x%08x \n",CURRENT_STATE.PC);
+    for (i = 0; i < PIPE_WIDTH; i++){
+        if (PIPE_WIDTH > 1){
+            snprintf(s, sizeof(s), "[%d]", i);
+        }
+        fprintf(out, "IF/ID%s.IR 0x%08x \n",s,IF_ID[i].IR );
+        fprintf(out, "IF/ID%s.PC 0x%08x \n",s,IF_ID[i].PC);
+    }
+    for (i = 0; i < PIPE_WIDTH; i++){
+        if (PIPE_WIDTH > 1){
+            snprintf(s, sizeof(s), "[%d]", i);
+        }
+        fprintf(out, "ID/EX%s.IR 0x%08x \n",s,ID_EX[i].IR);
+        fprintf(out, "ID/EX%s.A 0x%08x \n",s,ID_EX[i].A);
+        fprintf(out, "ID/EX%s.B 0x%08x \n",s,ID_EX[i].B);
+        fprintf(out, "ID/EX%s.imm 0x%08x \n",s,ID_EX[i].imm);
+    }
+    for (i = 0; i < PIPE_WIDTH; i++){
+        if (PIPE_WIDTH > 1){
+            snprintf(s, sizeof(s), "[%d]", i);
+        }
+        fprintf(out, "EX/MEM%s.IR 0x%08x \n",s,EX_MEM[i].IR);
+        fprintf(out, "EX/MEM%s.A 0x%08x \n",s,EX_MEM[i].A);
+        fprintf(out, "EX/MEM%s.B 0x%08x \n",s,EX_MEM[i].B);
+        fprintf(out, "EX/MEM%s.ALU 0x%08x \n",s,EX_MEM[i].ALUOutput);
+    }
+    for (i = 0; i < PIPE_WIDTH; i++){
+        if (PIPE_WIDTH > 1){
+            snprintf(s, sizeof(s), "[%d]", i);
+        }
+        fprintf(out, "MEM/WB%s.IR 0x%08x \n",s,MEM_WB[i].IR);
+        fprintf(out, "MEM/WB%s.ALUOutput 0x%08x \n",s,MEM_WB[i].ALUOutput);
+        fprintf(out, "MEM/WB%s.LMD 0x%08x \n",s,MEM_WB[i].LMD);
+    }
 }
 /***************************************************************/
 /* Pass register                                                                                                                                  */
@@ -703,30 +1425,182 @@ CPU_Pipeline_Reg registerpass(CPU_Pipeline_Reg last){
     next.HI = last.HI;
     next.LO = last.LO;
     next.imm = last.imm;
-    next.LMD = last.IR;
+    next.LMD = last.LMD;
     next.PC = last.PC;
     next.shampt = last.shampt;
+    next.tar = last.tar;
+    next.predPC = last.predPC;
+    next.inst = last.inst;
     return next;
 }
+#ifndef MU_MIPS_LIBRARY
+/***************************************************************/
+/* write the counters as JSON when the simulator exits                                      */
+/***************************************************************/
+static const char *stats_file;
+
+static void dump_stats_at_exit() {
+    stats_dump_json(stats_file);
+}
+
+/* output buffer of a batch run, nothing waits on a prompt */
+#define BATCH_BUFFER (1 << 16)
+
+static const struct option LONG_OPTIONS[] = {
+    { "quiet", no_argument, NULL, 'q' },
+    { NULL, 0, NULL, 0 }
+};
+
+/***************************************************************/
+/* Run a command script, - for standard input                                                         */
+/***************************************************************/
+static int run_script(const char *file) {
+    char line[CMD_LINE_MAX];
+    FILE *in = strcmp(file, "-") ? fopen(file, "r") : stdin;
+    int status = 0, n;
+    
+    if (in == NULL) {
+        printf("Error: cannot open command script %s\n", file);
+        return -1;
+    }
+    while (status == 0 && (n = read_line(line, in)) != 0) {
+        status = n < 0 ? -1 : run_commands(line);
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+    return status;
+}
+
 /***************************************************************/
 /* main                                                                                                                                   */
 /***************************************************************/
 int main(int argc, char *argv[]) {
-    printf("\n**************************\n");
-    printf("Welcome to MU-MIPS SIM...\n");
-    printf("**************************\n\n");
+    int opt, kind, status = 0, level = TRACE_SUMMARY, ooo = FALSE;
+    const char *trace_file = NULL, *btrace_file = NULL, *script = NULL;
+    char *commands = NULL;
+    
+    while ((opt = getopt_long(argc, argv, "t:o:b:Fj:p:Cf:w:Ou:c:e:q", LONG_OPTIONS, NULL)) != -1) {
+        switch (opt) {
+            case 't':
+                if ((level = trace_parse_level(optarg)) < 0) {
+                    printf("Error: unknown trace level %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'o':
+                trace_file = optarg;
+                break;
+            case 'b':
+                btrace_file = optarg;
+                break;
+            case 'F':
+                HAZARD.forwarding = FALSE;
+                break;
+            case 'j':
+                stats_file = optarg;
+                break;
+            case 'f':
+                if ((kind = loader_parse_format(optarg)) < 0) {
+                    printf("Error: program format must be auto, hex, bin, bin-le or elf\n");
+                    exit(1);
+                }
+                LOAD_FORMAT = kind;
+                break;
+            case 'C':
+                CACHES.enabled = TRUE;
+                break;
+            case 'p':
+                if ((kind = bpred_parse_kind(optarg)) < 0 || bpred_configure(kind, BPRED_DEFAULT_BITS) != 0) {
+                    printf("Error: unknown branch predictor %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'w':
+                if (pipeline_set_width(atoi(optarg)) != 0) {
+                    exit(1);
+                }
+                break;
+            case 'O':
+                ooo = TRUE;
+                break;
+            case 'u':
+                if (fu_parse(optarg) != 0) {
+                    exit(1);
+                }
+                break;
+            case 'c':
+                script = optarg;
+                break;
+            case 'e':
+                commands = optarg;
+                break;
+            case 'q':
+                QUIET = TRUE;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
     
-    if (argc < 2) {
-        printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
+    if (optind >= argc) {
+        printf("Error: You should provide input file.\nUsage: %s [-t off|summary|inst|stage] [-o trace file] [-b binary trace file] [-F] [-j stats json file] [-p nottaken|bimodal|gshare|btb] [-C] [-w width] [-O] [-u unit:latency[:pipelined|:blocking]] [-f auto|hex|bin|bin-le|elf] [-c script|-] [-e commands] [-q|--quiet] <input program> \n\n",  argv[0]);
         exit(1);
     }
     
-    strcpy(prog_file, argv[1]);
+    if (script != NULL || commands != NULL) {
+        setvbuf(stdout, NULL, _IOFBF, BATCH_BUFFER);
+    }
+    if (!QUIET) {
+        printf("\n**************************\n");
+        printf("Welcome to MU-MIPS SIM...\n");
+        printf("**************************\n\n");
+    }
+    
+    if (trace_file != NULL && trace_open(trace_file) != 0) {
+        exit(1);
+    }
+    trace_set_level(level);
+    atexit(trace_close);
+    if (btrace_file != NULL && btrace_open(btrace_file) != 0) {
+        exit(1);
+    }
+    atexit(btrace_close);
+    /*after the trace is open, so ooo_enable() sees everything it has to refuse*/
+    if (ooo && ooo_enable(TRUE) != 0) {
+        exit(1);
+    }
+    if (stats_file != NULL) {
+        atexit(dump_stats_at_exit);
+    }
+    
+    strncpy(prog_file, argv[optind], sizeof(prog_file) - 1);
     initialize();
     load_program();
-    help();
-    while (1){
-        handle_command();
+    
+    /*a batch run exits 0 once the program has run to its end, 2 if it is
+     *still running when the commands run out and 1 if a command failed*/
+    if (script != NULL || commands != NULL) {
+        if (commands != NULL) {
+            status = run_commands(commands);
+        }
+        if (status == 0 && script != NULL) {
+            status = run_script(script);
+        }
+        trace_flush();
+        exit(status < 0 ? 1 : RUN_FLAG ? 2 : 0);
+    }
+    
+    if (!QUIET) {
+        help();
+    }
+    while (handle_command() <= 0);
+    if (!QUIET) {
+        printf("**************************\n");
+        printf("Exiting MU-MIPS! Good Bye...\n");
+        printf("**************************\n");
     }
     return 0;
 }
+#endif
@@ -1,41 +1,18 @@
+#ifndef MU_MIPS_H
+#define MU_MIPS_H
+
+#include <stdio.h>
 #include <stdint.h>
 
 #define FALSE 0
 #define TRUE  1
 
-/******************************************************************************/
-/* MIPS memory layout                                                                                                                                      */
-/******************************************************************************/
-#define MEM_TEXT_BEGIN  0x00400000
-#define MEM_TEXT_END      0x0FFFFFFF
-/*Memory address 0x10000000 to 0x1000FFFF access by $gp*/
-#define MEM_DATA_BEGIN  0x10010000
-#define MEM_DATA_END   0x7FFFFFFF
-
-#define MEM_KTEXT_BEGIN 0x80000000
-#define MEM_KTEXT_END  0x8FFFFFFF
-
-#define MEM_KDATA_BEGIN 0x90000000
-#define MEM_KDATA_END  0xFFFEFFFF
-
-/*stack and data segments occupy the same memory space. Stack grows backward (from higher address to lower address) */
-#define MEM_STACK_BEGIN 0x7FFFFFFF
-#define MEM_STACK_END  0x10010000
-
-typedef struct {
-	uint32_t begin, end;
-	uint8_t *mem;
-} mem_region_t;
-
-/* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
-	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL },
-	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL },
-	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL },
-	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL }
-};
-
-#define NUM_MEM_REGION 4
+/* Simulator state is per thread, so each thread can run its own program (see sim.h).
+ * Tracing and the binary trace stay process wide. */
+#define SIM_LOCAL __thread
+
+#include "memory.h"
+
 #define MIPS_REGS 32
 
 typedef struct CPU_State_Struct {
@@ -45,6 +22,8 @@ typedef struct CPU_State_Struct {
   uint32_t HI, LO;                          /* special regs for mult/div. */
 } CPU_State;
 
+struct decoded_inst_struct;
+
 typedef struct CPU_Pipeline_Reg_Struct{
 	uint32_t PC;
 	uint32_t IR;
@@ -59,7 +38,9 @@ typedef struct CPU_Pipeline_Reg_Struct{
 	uint32_t rd;
 	uint32_t funct;
 	uint32_t shampt;
-	uint32_t tar;
+	uint32_t tar;       /* resolved next PC of a branch or jump */
+	uint32_t predPC;    /* next PC IF fetched after this instruction */
+	const struct decoded_inst_struct *inst; /* predecoded record, NULL for a bubble */
 
 } CPU_Pipeline_Reg;
 
@@ -67,39 +48,63 @@ typedef struct CPU_Pipeline_Reg_Struct{
 /* CPU State info.                                                                                                               */
 /***************************************************************/
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_FLAG;	/* run flag*/
-uint32_t INSTRUCTION_COUNT;
-uint32_t CYCLE_COUNT;
-uint32_t PROGRAM_SIZE; /*in words*/
+extern SIM_LOCAL CPU_State CURRENT_STATE, NEXT_STATE;
+extern SIM_LOCAL int RUN_FLAG;	/* run flag*/
+extern SIM_LOCAL uint32_t INSTRUCTION_COUNT;
+extern SIM_LOCAL uint32_t CYCLE_COUNT;
+extern SIM_LOCAL uint32_t PROGRAM_SIZE; /*in words*/
+
+/* pipeline events during the current cycle, cleared at the start of cycle() */
+#define PIPE_STALL 0x1
+#define PIPE_FLUSH 0x2
+extern SIM_LOCAL uint32_t PIPELINE_EVENTS;
+
+/* instructions each stage handles per cycle, the in-order superscalar mode */
+#define PIPE_MAX_WIDTH 4
+extern SIM_LOCAL int PIPE_WIDTH;
+
+/* fetch stops while drain_pipeline() empties the machine */
+extern SIM_LOCAL int FETCH_OFF;
 
 
 /***************************************************************/
 /* Pipeline Registers.                                                                                                        */
 /***************************************************************/
-CPU_Pipeline_Reg IF_ID;
-CPU_Pipeline_Reg ID_EX;
-CPU_Pipeline_Reg EX_MEM;
-CPU_Pipeline_Reg MEM_WB;
+/* Each latch has a slot per instruction of a bundle, the oldest in slot 0.
+ * Only the first PIPE_WIDTH slots are used, the others stay empty. */
+extern SIM_LOCAL CPU_Pipeline_Reg IF_ID[PIPE_MAX_WIDTH];
+extern SIM_LOCAL CPU_Pipeline_Reg ID_EX[PIPE_MAX_WIDTH];
+extern SIM_LOCAL CPU_Pipeline_Reg EX_MEM[PIPE_MAX_WIDTH];
+extern SIM_LOCAL CPU_Pipeline_Reg MEM_WB[PIPE_MAX_WIDTH];
+
+extern SIM_LOCAL char prog_file[256];
+
+/* longest command line handle_command() and command scripts take */
+#define CMD_LINE_MAX 256
 
-char prog_file[32];
+/* leave out the banner, help and program load messages, process wide */
+extern int QUIET;
 
 
 /***************************************************************/
 /* Function Declerations.                                                                                                */
 /***************************************************************/
 void help();
-uint32_t mem_read_32(uint32_t address);
-void mem_write_32(uint32_t address, uint32_t value);
+uint32_t sign_extension_32(uint32_t val);
 void cycle();
+uint32_t cycle_skip(uint32_t max);
 void run(int num_cycles);
 void runAll();
 void mdump(uint32_t start, uint32_t stop) ;
 void rdump();
-void handle_command();
+int handle_command();
+int execute_command(const char *command);
+int run_commands(char *text);
 void reset();
-void init_memory();
+void reset_state();
 void load_program();
+void decode_loaded_program();
+void restore_program();
 void handle_pipeline(); /*IMPLEMENT THIS*/
 void WB();/*IMPLEMENT THIS*/
 void MEM();/*IMPLEMENT THIS*/
@@ -107,8 +112,13 @@ void EX();/*IMPLEMENT THIS*/
 void ID();/*IMPLEMENT THIS*/
 void IF();/*IMPLEMENT THIS*/
 void show_pipeline();/*IMPLEMENT THIS*/
+void print_pipeline(FILE *out);
+void drain_pipeline();
+int pipeline_empty();
+int pipeline_set_width(int width);
 void initialize();
 void print_program(); /*IMPLEMENT THIS*/
 CPU_Pipeline_Reg registerpass(CPU_Pipeline_Reg last);
 void print_instruction(uint32_t line);
 
+#endif
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "btrace.h"
+#include "disasm.h"
+
+/***************************************************************/
+/* Offline decoder for binary pipeline traces written by mu-mips            */
+/***************************************************************/
+
+static const char *LATCH_NAMES[BT_LATCHES] = { "IF", "ID", "EX", "MEM" };
+
+static int get_varint(FILE *fp, uint32_t *v)
+{
+    int c, shift = 0;
+    *v = 0;
+    do {
+        if ((c = fgetc(fp)) == EOF || shift > 28) {
+            return -1;
+        }
+        *v |= (uint32_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return 0;
+}
+
+/***************************************************************/
+/* Read the next record, 0 at end of file, -1 if truncated                                      */
+/***************************************************************/
+static int read_record(FILE *fp, const bt_cycle_t *prev, bt_cycle_t *cur)
+{
+    bt_cycle_t pred;
+    uint32_t v;
+    uint8_t b[4];
+    int ctrl, flags, i;
+
+    if ((ctrl = fgetc(fp)) == EOF) {
+        return 0;
+    }
+    if ((flags = fgetc(fp)) == EOF) {
+        return -1;
+    }
+    bt_predict(prev, &pred);
+    *cur = pred;
+    cur->flags = flags;
+    if (flags & BT_GAP) {
+        if (get_varint(fp, &v) != 0) {
+            return -1;
+        }
+        cur->cycle += v;
+    }
+    for (i = 0; i < BT_LATCHES; i++) {
+        if (flags & (1 << i)) {
+            cur->pc[i] = 0;
+            cur->ir[i] = 0;
+        } else if (ctrl & (1 << i)) {
+            if (get_varint(fp, &v) != 0) {
+                return -1;
+            }
+            cur->pc[i] = pred.pc[i] + (uint32_t)bt_unzigzag(v);
+        }
+    }
+    for (i = 0; i < BT_LATCHES; i++) {
+        if (ctrl & (1 << (4 + i))) {
+            if (fread(b, 1, 4, fp) != 4) {
+                return -1;
+            }
+            cur->ir[i] = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+        }
+    }
+    return 1;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [-c] <trace file>\n", prog);
+    printf("  -c\twrite CSV instead of a pipeline diagram\n");
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *fp;
+    char magic[4], text[48];
+    bt_cycle_t prev, cur;
+    uint32_t first;
+    int opt, csv = 0, version, i, r;
+
+    while ((opt = getopt(argc, argv, "c")) != -1) {
+        switch (opt) {
+            case 'c':
+                csv = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fp = fopen(argv[optind], "rb");
+    if (fp == NULL) {
+        printf("Error: Can't open trace file %s\n", argv[optind]);
+        return 1;
+    }
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, BT_MAGIC, 4) != 0) {
+        printf("Error: %s is not a binary pipeline trace\n", argv[optind]);
+        return 1;
+    }
+    version = fgetc(fp);
+    if (version != BT_VERSION || get_varint(fp, &first) != 0) {
+        printf("Error: unsupported trace version %d\n", version);
+        return 1;
+    }
+    memset(&prev, 0, sizeof(prev));
+    prev.cycle = first - 1;
+
+    if (csv) {
+        printf("cycle");
+        for (i = 0; i < BT_LATCHES; i++) {
+            printf(",%s_pc,%s_ir", LATCH_NAMES[i], LATCH_NAMES[i]);
+        }
+        printf(",stall,flush\n");
+    } else {
+        printf("%8s", "cycle");
+        for (i = 0; i < BT_LATCHES; i++) {
+            printf("  %-34s", LATCH_NAMES[i]);
+        }
+        printf("\n");
+    }
+
+    while ((r = read_record(fp, &prev, &cur)) > 0) {
+        if (csv) {
+            printf("%u", cur.cycle);
+            for (i = 0; i < BT_LATCHES; i++) {
+                if (cur.flags & (1 << i)) {
+                    printf(",,");
+                } else {
+                    printf(",0x%08x,0x%08x", cur.pc[i], cur.ir[i]);
+                }
+            }
+            printf(",%d,%d\n", !!(cur.flags & BT_STALL), !!(cur.flags & BT_FLUSH));
+        } else {
+            printf("%8u", cur.cycle);
+            for (i = 0; i < BT_LATCHES; i++) {
+                if (cur.flags & (1 << i)) {
+                    printf("  %-34s", "-");
+                } else {
+                    printf("  %08x %-25s", cur.pc[i], disasm(cur.ir[i], text, sizeof(text)));
+                }
+            }
+            if (cur.flags & BT_STALL) {
+                printf(" stall");
+            }
+            if (cur.flags & BT_FLUSH) {
+                printf(" flush");
+            }
+            printf("\n");
+        }
+        prev = cur;
+    }
+    fclose(fp);
+    if (r < 0) {
+        printf("Error: trace is truncated after cycle %u\n", prev.cycle);
+        return 1;
+    }
+    return 0;
+}
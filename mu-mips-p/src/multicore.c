@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mu-mips.h"
+#include "hazard.h"
+#include "bpred.h"
+#include "cache.h"
+#include "btrace.h"
+#include "ooo.h"
+#include "fu.h"
+#include "multicore.h"
+
+/* shared by the core threads of a run, so not SIM_LOCAL */
+static multicore_t MC;
+
+/***************************************************************/
+/* Wait for every core to finish its quantum, TRUE when the run is over        */
+/***************************************************************/
+/* The last core to arrive decides whether to go on, the others sleep until it
+ * has. The mutex also orders each quantum's memory traffic before the next. */
+static int quantum_end(mc_core_t *core)
+{
+    uint64_t generation;
+    int i, running, done;
+
+    pthread_mutex_lock(&MC.lock);
+    core->running = RUN_FLAG;
+    generation = MC.quanta;
+    if (++MC.arrived == MC.num_cores) {
+        for (i = 0, running = FALSE; i < MC.num_cores; i++) {
+            running |= MC.cores[i].running;
+        }
+        MC.arrived = 0;
+        MC.quanta++;
+        MC.done = !running || (MC.max_cycles != 0 && MC.quanta * MC.quantum >= MC.max_cycles);
+        pthread_cond_broadcast(&MC.wake);
+    } else {
+        while (generation == MC.quanta) {
+            pthread_cond_wait(&MC.wake, &MC.lock);
+        }
+    }
+    done = MC.done;
+    pthread_mutex_unlock(&MC.lock);
+    return done;
+}
+
+/***************************************************************/
+/* Cycle this thread's core a quantum at a time until every core is done    */
+/***************************************************************/
+static void run_core(mc_core_t *core)
+{
+    uint32_t cycles = CYCLE_COUNT, instructions = INSTRUCTION_COUNT;
+    uint64_t n, limit;
+
+    do {
+        limit = MC.quantum;
+        if (MC.max_cycles != 0 && MC.max_cycles - MC.quanta * MC.quantum < limit) {
+            limit = MC.max_cycles - MC.quanta * MC.quantum;
+        }
+        for (n = 0; n < limit && RUN_FLAG; ) {
+            n += cycle_skip((uint32_t)(limit - n));
+        }
+    } while (!quantum_end(core));
+    core->cycles = CYCLE_COUNT - cycles;
+    core->instructions = INSTRUCTION_COUNT - instructions;
+    core->state = CURRENT_STATE;
+}
+
+static void start_core(int id)
+{
+    CURRENT_STATE = MC.start;
+    CURRENT_STATE.REGS[MC_REG_ID] = id;
+    CURRENT_STATE.REGS[MC_REG_CORES] = MC.num_cores;
+    NEXT_STATE = CURRENT_STATE;
+    RUN_FLAG = TRUE;
+}
+
+/***************************************************************/
+/* Host thread of cores 1 and up, a simulator context on core 0's memory     */
+/***************************************************************/
+/* A core whose context can not be set up stays halted, it still has to take
+ * part in every quantum so the others are not left waiting. */
+static void *core_thread(void *arg)
+{
+    mc_core_t *core = arg;
+    sim_t *sim = sim_create(&MC.config);
+
+    if (sim != NULL) {
+        mem_share(MC.store);
+        start_core(core->id);
+    }
+    run_core(core);
+    if (sim != NULL) {
+        mem_share(NULL);
+        sim_destroy(sim);
+    }
+    return NULL;
+}
+
+static void print_cores(double elapsed)
+{
+    const mc_core_t *core;
+    uint64_t cycles = 0;
+    int i;
+
+    printf("-------------------------------------------------------------\n");
+    printf("[Core]\t[Status]\t[Cycles]\t[Instructions]\t[CPI]\t[PC]\t\t[$2]\n");
+    printf("-------------------------------------------------------------\n");
+    for (i = 0; i < MC.num_cores; i++) {
+        core = &MC.cores[i];
+        printf("%d\t%s\t\t%u\t\t%u\t\t%.3f\t0x%08x\t0x%08x\n", i, core->running ? "running" : "halted", core->cycles,
+               core->instructions, core->instructions ? (double)core->cycles / core->instructions : 0.0,
+               core->state.PC, core->state.REGS[2]);
+        cycles += core->cycles;
+    }
+    printf("-------------------------------------------------------------\n");
+    printf("%d cores, %llu quanta of %u cycles, %llu cycles in %.3f s (%.1f M cycles/s)\n\n", MC.num_cores,
+           (unsigned long long)MC.quanta, MC.quantum, (unsigned long long)cycles, elapsed,
+           elapsed > 0 ? cycles / elapsed / 1e6 : 0.0);
+}
+
+/***************************************************************/
+/* Run the loaded program on num_cores cores until all halt                               */
+/***************************************************************/
+/* The calling thread's simulator is core 0 and ends in core 0's final state,
+ * memory holds what all the cores wrote. The other cores use the default cache
+ * geometry. */
+int multicore_run(int num_cores, uint32_t quantum, uint64_t max_cycles)
+{
+    struct timespec t0, t1;
+    int i;
+
+    if (num_cores < 1 || num_cores > MC_MAX_CORES || quantum == 0) {
+        printf("Error: cores must be 1 to %d and the quantum at least 1 cycle\n", MC_MAX_CORES);
+        return -1;
+    }
+    if (BTRACE_ON) {
+        printf("Error: the binary trace records a single core, turn it off first\n");
+        return -1;
+    }
+    if (RUN_FLAG == FALSE) {
+        printf("Simulation Stopped\n\n");
+        return -1;
+    }
+    drain_pipeline();
+    memset(&MC, 0, sizeof(MC));
+    MC.num_cores = num_cores;
+    MC.quantum = quantum;
+    MC.max_cycles = max_cycles;
+    sim_default_config(&MC.config);
+    MC.config.forwarding = HAZARD.forwarding;
+    MC.config.caches = CACHES.enabled;
+    MC.config.bpred_kind = BPRED.kind;
+    MC.config.bpred_bits = BPRED.bits;
+    MC.config.width = PIPE_WIDTH;
+    MC.config.ooo = OOO.enabled;
+    memcpy(MC.config.units, FU.config, sizeof(MC.config.units));
+    MC.start = CURRENT_STATE;
+    MC.store = mem_store();
+    pthread_mutex_init(&MC.lock, NULL);
+    pthread_cond_init(&MC.wake, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    /* core 0 has not arrived at the first barrier yet, so failing cores can be dropped */
+    for (i = 1; i < num_cores; i++) {
+        MC.cores[i].id = i;
+        if (pthread_create(&MC.cores[i].thread, NULL, core_thread, &MC.cores[i]) != 0) {
+            printf("Error: Can't start a host thread for core %d\n", i);
+            pthread_mutex_lock(&MC.lock);
+            MC.num_cores = i;
+            pthread_mutex_unlock(&MC.lock);
+            break;
+        }
+    }
+    start_core(0);
+    run_core(&MC.cores[0]);
+    for (i = 1; i < MC.num_cores; i++) {
+        pthread_join(MC.cores[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    pthread_cond_destroy(&MC.wake);
+    pthread_mutex_destroy(&MC.lock);
+    print_cores((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "mu-mips.h"
+#include "stats.h"
+#include "sim.h"
+
+/***************************************************************/
+/* Several cores sharing one memory                                                                       */
+/***************************************************************/
+/* Each core is a simulator context (see sim.h) on a host thread of its own.
+ * Core 0 is the calling thread's simulator, and the other cores use its pages.
+ * The cores run a quantum of cycles independently, then wait for each other,
+ * so none gets more than a quantum ahead. Smaller quanta keep the cores' timing
+ * closer at the cost of more synchronisation. Every core starts from the
+ * current registers, with its number in $k0 and the number of cores in $k1. */
+#define MC_MAX_CORES        16
+#define MC_DEFAULT_QUANTUM  1000
+#define MC_REG_ID           26          /* $k0 */
+#define MC_REG_CORES        27          /* $k1 */
+
+typedef struct {
+	int id;
+	pthread_t thread;
+	int running;                    /* RUN_FLAG at the end of the last quantum */
+	uint32_t cycles, instructions;  /* during this run */
+	CPU_State state;                /* final */
+} mc_core_t;
+
+typedef struct {
+	mc_core_t cores[MC_MAX_CORES];
+	int num_cores;
+	uint32_t quantum;
+	uint64_t max_cycles;            /* per core, 0 for no limit */
+	sim_config_t config;            /* of the cores after core 0 */
+	CPU_State start;
+	mem_store_t *store;             /* core 0's pages */
+	pthread_mutex_t lock;           /* quantum barrier */
+	pthread_cond_t wake;
+	int arrived;
+	uint64_t quanta;                /* completed, counts the barrier generations */
+	int done;
+} multicore_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int multicore_run(int num_cores, uint32_t quantum, uint64_t max_cycles);
+
+#endif
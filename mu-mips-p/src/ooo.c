@@ -0,0 +1,576 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "trace.h"
+#include "btrace.h"
+#include "disasm.h"
+#include "stats.h"
+#include "bpred.h"
+#include "cache.h"
+#include "funcsim.h"
+#include "fu.h"
+#include "ooo.h"
+#include "debug.h"
+
+SIM_LOCAL ooo_core_t OOO = {
+    .rob_size = OOO_DEFAULT_ROB,
+    .rs_size = OOO_DEFAULT_RS,
+    .width = OOO_DEFAULT_WIDTH,
+    .units = { 2, 1, 1 },
+    .port = -1,
+};
+
+static const char *FU_NAMES[FU_CLASSES] = { "alu", "muldiv", "mem" };
+static const char *DISPATCH_NAMES[DISPATCH_CAUSES] = { "rob_full", "rs_full" };
+static const char *STATE_NAMES[] = { "waiting", "executing", "issued", "done" };
+
+/* reorder buffer index of the n-th oldest entry */
+static int rob_index(int n)
+{
+    return (OOO.head + n) % OOO_MAX_ROB;
+}
+
+static int fu_class(const decoded_inst_t *d)
+{
+    if (d->flags & (INST_LOAD | INST_STORE)) {
+        return FU_MEM;
+    }
+    if (d->flags & (INST_WRITES_HI | INST_WRITES_LO | INST_READS_HI | INST_READS_LO)) {
+        return FU_MULDIV;
+    }
+    return FU_ALU;
+}
+
+/* accesses of up to four bytes at a and b overlap */
+static int overlap(uint32_t a, uint32_t b)
+{
+    return a - b + 3 <= 6;
+}
+
+/***************************************************************/
+/* Empty the window, the configuration is kept                                                       */
+/***************************************************************/
+void ooo_reset()
+{
+    int i;
+
+    OOO.head = 0;
+    OOO.count = 0;
+    OOO.rs_used = 0;
+    OOO.num_fetched = 0;
+    OOO.port = -1;
+    OOO.hilo_written = FALSE;
+    OOO.redirect = FALSE;
+    memset(OOO.unit_free, 0, sizeof(OOO.unit_free));
+    for (i = 0; i < MIPS_REGS; i++) {
+        OOO.rename[i] = -1;
+    }
+}
+
+int ooo_empty()
+{
+    return OOO.count == 0 && OOO.num_fetched == 0;
+}
+
+/***************************************************************/
+/* Set the window sizes and functional units                                                          */
+/***************************************************************/
+int ooo_configure(int rob_size, int rs_size, int width, const int *units)
+{
+    int i;
+
+    if (rob_size < 1 || rob_size > OOO_MAX_ROB || rs_size < 1 || rs_size > rob_size) {
+        printf("Error: the reorder buffer must have 1 to %d entries and at least as many as the reservation stations\n",
+               OOO_MAX_ROB);
+        return -1;
+    }
+    if (width < 1 || width > OOO_MAX_WIDTH) {
+        printf("Error: the out-of-order core's width must be 1 to %d\n", OOO_MAX_WIDTH);
+        return -1;
+    }
+    for (i = 0; i < FU_CLASSES; i++) {
+        if (units[i] < 1 || units[i] > OOO_MAX_UNITS) {
+            printf("Error: there must be 1 to %d units of each kind\n", OOO_MAX_UNITS);
+            return -1;
+        }
+    }
+    drain_pipeline();
+    OOO.rob_size = rob_size;
+    OOO.rs_size = rs_size;
+    OOO.width = width;
+    memcpy(OOO.units, units, sizeof(OOO.units));
+    return 0;
+}
+
+/***************************************************************/
+/* Switch between the out-of-order core and the pipeline                                      */
+/***************************************************************/
+/* Whichever was running is drained first, the other starts empty. */
+int ooo_enable(int on)
+{
+    if (on && BTRACE_ON) {
+        printf("Error: the binary trace records the pipeline, turn it off first\n");
+        return -1;
+    }
+    drain_pipeline();
+    ooo_reset();
+    OOO.enabled = on;
+    return 0;
+}
+
+/* the source operand of reg for a new entry, renamed to its producer if that has not finished */
+static void read_operand(ooo_operand_t *op, uint8_t reg, int used)
+{
+    int producer = used ? OOO.rename[reg] : -1;
+
+    op->tag = -1;
+    if (producer < 0) {
+        /* commit has run this cycle, so NEXT_STATE holds every committed result */
+        op->value = NEXT_STATE.REGS[reg];
+    } else if (OOO.rob[producer].state == ROB_DONE) {
+        op->value = OOO.rob[producer].value;
+    } else {
+        op->tag = producer;
+    }
+}
+
+/* hand a result to the entries waiting on it */
+static void wakeup(int tag, uint32_t value)
+{
+    rob_entry_t *e;
+    int n, k;
+
+    for (n = 0; n < OOO.count; n++) {
+        e = &OOO.rob[rob_index(n)];
+        for (k = 0; k < 2; k++) {
+            if (e->src[k].tag == tag) {
+                e->src[k].tag = -1;
+                e->src[k].value = value;
+            }
+        }
+    }
+}
+
+/***************************************************************/
+/* Drop the entries from the n-th oldest on and everything fetched              */
+/***************************************************************/
+/* Fetch restarts at pc this cycle. The rename table is rebuilt from the
+ * entries that are left, the youngest producer of a register wins. */
+static void squash(int keep, uint32_t pc)
+{
+    const rob_entry_t *e;
+    int n, i;
+
+    for (n = keep; n < OOO.count; n++) {
+        i = rob_index(n);
+        if (OOO.rob[i].state == ROB_WAITING) {
+            OOO.rs_used--;
+        }
+        if (OOO.port == i) {
+            OOO.port = -1;
+        }
+    }
+    STATS.flushed += OOO.count - keep + OOO.num_fetched;
+    OOO.count = keep;
+    OOO.num_fetched = 0;
+    for (i = 0; i < MIPS_REGS; i++) {
+        OOO.rename[i] = -1;
+    }
+    for (n = 0; n < OOO.count; n++) {
+        i = rob_index(n);
+        e = &OOO.rob[i];
+        if ((e->inst.flags & INST_WRITES_REG) && e->inst.dest != 0) {
+            OOO.rename[e->inst.dest] = i;
+        }
+    }
+    OOO.redirect = TRUE;
+    OOO.redirect_pc = pc;
+    PIPELINE_EVENTS |= PIPE_FLUSH;
+}
+
+/***************************************************************/
+/* Claim the data cache port, FALSE until the access can complete             */
+/***************************************************************/
+/* An access that misses keeps the port until its line arrives, the others
+ * wait for it like MEM does in the pipeline. */
+static int data_port(int entry, uint32_t address, int write)
+{
+    if (OOO.port >= 0 && OOO.port != entry) {
+        return FALSE;
+    }
+    if (!cache_data_ready(address, write)) {
+        OOO.port = entry;
+        STATS.stalls[STALL_DCACHE]++;
+        PIPELINE_EVENTS |= PIPE_STALL;
+        return FALSE;
+    }
+    OOO.port = -1;
+    return TRUE;
+}
+
+/***************************************************************/
+/* Retire finished entries from the head of the reorder buffer                       */
+/***************************************************************/
+static void commit()
+{
+    rob_entry_t *e;
+    uint32_t address;
+    int n, m, i;
+
+    for (n = 0; n < OOO.width && OOO.count > 0 && RUN_FLAG; n++) {
+        i = OOO.head;
+        e = &OOO.rob[i];
+        if (e->state == ROB_WAITING || e->state == ROB_EXECUTING) {
+            break;
+        }
+        address = e->out.ALUOutput;
+        if (e->state == ROB_ISSUED) {
+            /* stores, ll and sc reach memory in program order */
+            if (!data_port(i, address, e->inst.flags & INST_STORE)) {
+                break;
+            }
+            if (e->inst.flags & INST_STORE) {
+                STATS.stores++;
+            } else {
+                STATS.loads++;
+            }
+            e->value = func_access(&e->inst, address, e->value);
+            e->state = ROB_DONE;
+            if (e->inst.flags & INST_WRITES_REG) {
+                wakeup(i, e->value);
+            }
+        }
+        /* loads went to memory at issue, maybe down a wrong path, they are reported here */
+        if ((e->inst.flags & (INST_LOAD | INST_STORE)) && DEBUG_PAGE(address, DEBUG_PAGE_WATCH)) {
+            debug_watch_access(&e->inst, e->pc, address);
+        }
+        if ((e->inst.flags & INST_WRITES_REG) && e->inst.dest != 0) {
+            NEXT_STATE.REGS[e->inst.dest] = e->value;
+            if (OOO.rename[e->inst.dest] == i) {
+                OOO.rename[e->inst.dest] = -1;
+            }
+        }
+        if (e->inst.flags & INST_WRITES_HI) {
+            NEXT_STATE.HI = e->out.HI;
+            OOO.hilo_written = TRUE;
+        }
+        if (e->inst.flags & INST_WRITES_LO) {
+            NEXT_STATE.LO = e->out.LO;
+            OOO.hilo_written = TRUE;
+        }
+        if (e->inst.flags & INST_HALT) {
+            RUN_FLAG = FALSE;
+            NEXT_STATE.PC = e->pc + 4;
+        }
+        INSTRUCTION_COUNT++;
+        STATS.retired++;
+        STATS.ops[e->inst.op]++;
+        TRACE(TRACE_INST, "%u: retire 0x%08x: 0x%08x\n", CYCLE_COUNT, e->pc, e->inst.raw);
+        OOO.head = rob_index(1);
+        OOO.count--;
+
+        if (e->inst.flags & INST_STORE) {
+            /* instructions already fetched from the word stored to are stale */
+            for (m = 0; m < OOO.count && !overlap(OOO.rob[rob_index(m)].pc, address); m++);
+            if (m < OOO.count) {
+                squash(m, OOO.rob[rob_index(m)].pc);
+                continue;
+            }
+            for (m = 0; m < OOO.num_fetched && !overlap(OOO.fetched[m].pc, address); m++);
+            if (m < OOO.num_fetched) {
+                squash(OOO.count, OOO.fetched[m].pc);
+            }
+        }
+    }
+    STATS.bubbles += OOO.width - n;
+}
+
+/* a load from address may not pass an older store to the same bytes or one whose address is unknown */
+static int load_may_go(int age, uint32_t address)
+{
+    const rob_entry_t *e;
+    int n;
+
+    for (n = 0; n < age; n++) {
+        e = &OOO.rob[rob_index(n)];
+        if ((e->inst.flags & INST_STORE) && (e->state == ROB_WAITING || overlap(e->out.ALUOutput, address))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* HI and LO are read from CURRENT_STATE, older writers must have committed on an earlier cycle */
+static int hilo_ready(int age)
+{
+    int n;
+
+    if (OOO.hilo_written) {
+        return FALSE;
+    }
+    for (n = 0; n < age; n++) {
+        if (OOO.rob[rob_index(n)].inst.flags & (INST_WRITES_HI | INST_WRITES_LO)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* a unit of class fu free this cycle, -1 if they are all busy */
+static int free_unit(int fu)
+{
+    int u;
+
+    for (u = 0; u < OOO.units[fu]; u++) {
+        if (OOO.unit_free[fu][u] <= CYCLE_COUNT) {
+            return u;
+        }
+    }
+    return -1;
+}
+
+/***************************************************************/
+/* Hand the results that are out of their units to the waiting entries      */
+/***************************************************************/
+/* Runs first in the cycle, so an instruction with a latency of one commits
+ * and wakes its dependents the cycle after it issued. */
+static void complete()
+{
+    rob_entry_t *e;
+    int n, i;
+
+    for (n = 0; n < OOO.count; n++) {
+        i = rob_index(n);
+        e = &OOO.rob[i];
+        if (e->state == ROB_EXECUTING && e->done <= CYCLE_COUNT) {
+            e->state = ROB_DONE;
+            wakeup(i, e->value);
+        }
+    }
+}
+
+/***************************************************************/
+/* Send ready entries to the functional units, oldest first                              */
+/***************************************************************/
+static void issue()
+{
+    int n, i, u;
+    rob_entry_t *e;
+
+    for (n = 0; n < OOO.count; n++) {
+        i = rob_index(n);
+        e = &OOO.rob[i];
+        if (e->state != ROB_WAITING || (u = free_unit(e->fu)) < 0 || e->src[0].tag >= 0 || e->src[1].tag >= 0 ||
+            ((e->inst.flags & (INST_READS_HI | INST_READS_LO)) && !hilo_ready(n))) {
+            continue;
+        }
+        e->out.PC = e->pc + 4;
+        e->out.predPC = e->predPC;
+        e->inst.exec(&e->inst, &e->out, e->src[0].value, e->src[1].value);
+        if ((e->inst.flags & INST_STORE) || e->inst.op == OP_LL) {
+            /* the address is known, memory waits for commit */
+            e->value = e->src[1].value;
+            e->state = ROB_ISSUED;
+        } else if (e->inst.flags & INST_LOAD) {
+            if (!load_may_go(n, e->out.ALUOutput) || !data_port(i, e->out.ALUOutput, FALSE)) {
+                continue;
+            }
+            STATS.loads++;
+            e->value = func_access(&e->inst, e->out.ALUOutput, 0);
+            e->state = ROB_EXECUTING;
+        } else {
+            e->value = e->out.ALUOutput;
+            e->state = ROB_EXECUTING;
+        }
+        e->done = CYCLE_COUNT + fu_latency(&e->inst);
+        OOO.unit_free[e->fu][u] = CYCLE_COUNT + fu_interval(&e->inst);
+        OOO.rs_used--;
+        STATS.fu_issued[e->fu]++;
+        TRACE(TRACE_STAGE, "issue %d: 0x%08x A 0x%08x B 0x%08x ALUOutput 0x%08x\n", i, e->inst.raw,
+              e->src[0].value, e->src[1].value, e->out.ALUOutput);
+        if (e->inst.flags & INST_CTRL) {
+            bpred_update(e->pc, &e->inst, e->out.tar, e->predPC);
+            if (e->out.tar != e->predPC) {
+                TRACE(TRACE_STAGE, "mispredict 0x%08x, fetch 0x%08x\n", e->pc, e->out.tar);
+                squash(n + 1, e->out.tar);
+                break;
+            }
+        }
+    }
+}
+
+/***************************************************************/
+/* Move fetched instructions into the reorder buffer and the stations          */
+/***************************************************************/
+static void dispatch()
+{
+    const ooo_fetched_t *f;
+    rob_entry_t *e;
+    int n, i;
+
+    for (n = 0; n < OOO.width && n < OOO.num_fetched; n++) {
+        if (OOO.count == OOO.rob_size) {
+            STATS.dispatch_stalls[DISPATCH_ROB_FULL]++;
+            break;
+        }
+        if (OOO.rs_used == OOO.rs_size) {
+            STATS.dispatch_stalls[DISPATCH_RS_FULL]++;
+            break;
+        }
+        f = &OOO.fetched[n];
+        i = rob_index(OOO.count);
+        e = &OOO.rob[i];
+        memset(e, 0, sizeof(*e));
+        e->inst = f->inst;
+        e->pc = f->pc;
+        e->predPC = f->predPC;
+        e->fu = fu_class(&e->inst);
+        e->state = ROB_WAITING;
+        read_operand(&e->src[0], e->inst.rs, e->inst.flags & INST_READS_RS);
+        read_operand(&e->src[1], e->inst.rt, e->inst.flags & INST_READS_RT);
+        if ((e->inst.flags & INST_WRITES_REG) && e->inst.dest != 0) {
+            OOO.rename[e->inst.dest] = i;
+        }
+        OOO.count++;
+        OOO.rs_used++;
+        TRACE(TRACE_STAGE, "dispatch %d: 0x%08x at 0x%08x\n", i, e->inst.raw, e->pc);
+    }
+    memmove(OOO.fetched, OOO.fetched + n, (OOO.num_fetched - n) * sizeof(ooo_fetched_t));
+    OOO.num_fetched -= n;
+}
+
+/***************************************************************/
+/* Fetch a bundle into the queue in front of dispatch                                         */
+/***************************************************************/
+/* As in IF, a bundle ends at a branch predicted taken and at the end of the
+ * instruction cache line. The queue holds two bundles. */
+static void fetch()
+{
+    uint32_t pc = CURRENT_STATE.PC;
+    ooo_fetched_t *f;
+    int n = 0;
+
+    if (OOO.redirect) {
+        NEXT_STATE.PC = OOO.redirect_pc;
+        cache_cancel_fetch();
+        return;
+    }
+    NEXT_STATE.PC = pc;
+    if (FETCH_OFF || OOO.num_fetched + OOO.width > 2 * OOO.width) {
+        return;
+    }
+    if (!cache_fetch_ready(pc)) {
+        STATS.stalls[STALL_ICACHE]++;
+        PIPELINE_EVENTS |= PIPE_STALL;
+        return;
+    }
+    do {
+        if (DEBUG_PAGE(NEXT_STATE.PC, DEBUG_PAGE_BREAK)) {
+            debug_fetch(NEXT_STATE.PC);
+        }
+        f = &OOO.fetched[OOO.num_fetched++];
+        f->inst = *decode_fetch(NEXT_STATE.PC);
+        f->pc = NEXT_STATE.PC;
+        f->predPC = bpred_predict(f->pc, &f->inst);
+        NEXT_STATE.PC = f->predPC;
+    } while (++n < OOO.width && NEXT_STATE.PC == f->pc + 4 && cache_same_fetch_line(pc, NEXT_STATE.PC));
+}
+
+/***************************************************************/
+/* One cycle of the out-of-order core, in place of handle_pipeline()             */
+/***************************************************************/
+/* The phases run from the back of the machine to the front, so each sees
+ * what the one after it left at the end of the previous cycle. */
+void ooo_cycle()
+{
+    OOO.redirect = FALSE;
+    OOO.hilo_written = FALSE;
+    complete();
+    commit();
+    if (RUN_FLAG) {
+        /* nothing younger than a halting syscall goes on, as in the other engines */
+        issue();
+        dispatch();
+        fetch();
+    }
+    STATS.ooo_cycles++;
+    STATS.rob_occupancy += OOO.count;
+    STATS.rs_occupancy += OOO.rs_used;
+    if (TRACE_ON(TRACE_STAGE)) {
+        ooo_print_window(TRACE_OUT);
+    }
+}
+
+/***************************************************************/
+/* Print the reorder buffer, oldest first                                                                 */
+/***************************************************************/
+void ooo_print_window(FILE *out)
+{
+    const rob_entry_t *e;
+    char text[48];
+    int n, k, i;
+
+    fprintf(out, "Current PC: 0x%08x, %d fetched, ROB %d/%d, RS %d/%d\n", CURRENT_STATE.PC, OOO.num_fetched,
+            OOO.count, OOO.rob_size, OOO.rs_used, OOO.rs_size);
+    for (n = 0; n < OOO.count; n++) {
+        i = rob_index(n);
+        e = &OOO.rob[i];
+        fprintf(out, "  [%3d] 0x%08x %-24s %s", i, e->pc, disasm(e->inst.raw, text, sizeof(text)),
+                STATE_NAMES[e->state]);
+        for (k = 0; k < 2; k++) {
+            if (e->src[k].tag >= 0) {
+                fprintf(out, " waits [%d]", e->src[k].tag);
+            }
+        }
+        fprintf(out, "\n");
+    }
+}
+
+/***************************************************************/
+/* Print the configuration and counters                                                                  */
+/***************************************************************/
+void ooo_print(FILE *out)
+{
+    uint64_t cycles = STATS.ooo_cycles;
+    int i;
+
+    fprintf(out, "Out-of-order core\t: %s (ROB %d, RS %d, width %d, %d alu, %d muldiv, %d mem)\n",
+            OOO.enabled ? "on" : "off", OOO.rob_size, OOO.rs_size, OOO.width,
+            OOO.units[FU_ALU], OOO.units[FU_MULDIV], OOO.units[FU_MEM]);
+    if (cycles == 0) {
+        return;
+    }
+    fprintf(out, "  %-20s: %.2f of %d\n", "ROB occupancy", (double)STATS.rob_occupancy / cycles, OOO.rob_size);
+    fprintf(out, "  %-20s: %.2f of %d\n", "RS occupancy", (double)STATS.rs_occupancy / cycles, OOO.rs_size);
+    for (i = 0; i < DISPATCH_CAUSES; i++) {
+        fprintf(out, "  %-20s: %llu\n", DISPATCH_NAMES[i], (unsigned long long)STATS.dispatch_stalls[i]);
+    }
+    for (i = 0; i < FU_CLASSES; i++) {
+        fprintf(out, "  %-6s %-13s: %llu\n", FU_NAMES[i], "issued", (unsigned long long)STATS.fu_issued[i]);
+    }
+}
+
+void ooo_print_json(FILE *out)
+{
+    uint64_t cycles = STATS.ooo_cycles;
+    int i;
+
+    fprintf(out, "{ \"enabled\": %s, \"rob\": %d, \"rs\": %d, \"width\": %d, \"cycles\": %llu",
+            OOO.enabled ? "true" : "false", OOO.rob_size, OOO.rs_size, OOO.width, (unsigned long long)cycles);
+    fprintf(out, ", \"rob_occupancy\": %.4f, \"rs_occupancy\": %.4f",
+            cycles ? (double)STATS.rob_occupancy / cycles : 0.0, cycles ? (double)STATS.rs_occupancy / cycles : 0.0);
+    fprintf(out, ", \"dispatch_stalls\": {");
+    for (i = 0; i < DISPATCH_CAUSES; i++) {
+        fprintf(out, "%s \"%s\": %llu", i ? "," : "", DISPATCH_NAMES[i], (unsigned long long)STATS.dispatch_stalls[i]);
+    }
+    fprintf(out, " }, \"units\": {");
+    for (i = 0; i < FU_CLASSES; i++) {
+        fprintf(out, "%s \"%s\": { \"count\": %d, \"issued\": %llu }", i ? "," : "", FU_NAMES[i], OOO.units[i],
+                (unsigned long long)STATS.fu_issued[i]);
+    }
+    fprintf(out, " } }");
+}
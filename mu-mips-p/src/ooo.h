@@ -0,0 +1,108 @@
+#ifndef OOO_H
+#define OOO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+
+/***************************************************************/
+/* Out-of-order core                                                                                                */
+/***************************************************************/
+/* An alternative to the five-stage pipeline, Tomasulo scheduling over a
+ * reorder buffer. Each cycle commits finished instructions from the head of
+ * the reorder buffer in program order, issues ready instructions from the
+ * reservation stations to the functional units oldest first, dispatches the
+ * fetched instructions into the reorder buffer and a reservation station, and
+ * fetches more. Registers are renamed to the reorder buffer entry that will
+ * produce them, and a finished instruction hands its result to every waiting
+ * station on the next cycle. A mispredicted branch squashes everything after
+ * it as soon as it executes.
+ *
+ * Loads read memory when they execute, once no older store has an unknown or
+ * overlapping address. Stores, ll and sc reach memory when they commit.
+ * Instructions that read HI or LO wait until the older writers of HI and LO
+ * have committed, HI and LO are not renamed. Results take the latency of
+ * their unit from fu.h to come out, and a unit that is not pipelined is busy
+ * until they do. */
+#define OOO_MAX_ROB         256
+#define OOO_MAX_RS          OOO_MAX_ROB
+#define OOO_MAX_WIDTH       8
+#define OOO_MAX_UNITS       8
+#define OOO_DEFAULT_ROB     32
+#define OOO_DEFAULT_RS      16
+#define OOO_DEFAULT_WIDTH   4
+#define OOO_FETCH_QUEUE     (2 * OOO_MAX_WIDTH)   /* two fetch bundles of the widest core */
+
+/* functional unit classes, branches and jumps use an ALU */
+typedef enum {
+	FU_ALU = 0,
+	FU_MULDIV,
+	FU_MEM,                 /* address generation and the data cache port */
+	FU_CLASSES
+} fu_class_t;
+
+typedef enum {
+	ROB_WAITING = 0,        /* in a reservation station */
+	ROB_EXECUTING,          /* in a functional unit until cycle done */
+	ROB_ISSUED,             /* stores, ll and sc with their operands, memory is left to commit */
+	ROB_DONE
+} rob_state_t;
+
+/* a source operand, either its value or the entry that will produce it */
+typedef struct {
+	int tag;                /* reorder buffer index, -1 when value holds it */
+	uint32_t value;
+} ooo_operand_t;
+
+typedef struct {
+	decoded_inst_t inst;    /* a copy, the decode cache record changes if the word is rewritten */
+	uint32_t pc, predPC;
+	rob_state_t state;
+	int fu;                 /* fu_class_t */
+	ooo_operand_t src[2];   /* rs, rt */
+	CPU_Pipeline_Reg out;   /* ALUOutput (the address of a load or store), HI, LO, tar */
+	uint32_t value;         /* written to dest on commit */
+	uint32_t done;          /* cycle the result is out of the unit */
+} rob_entry_t;
+
+typedef struct {
+	decoded_inst_t inst;
+	uint32_t pc, predPC;
+} ooo_fetched_t;
+
+typedef struct {
+	int enabled;
+	/* configuration */
+	int rob_size, rs_size, width;
+	int units[FU_CLASSES];
+	uint32_t unit_free[FU_CLASSES][OOO_MAX_UNITS];  /* first cycle each unit takes another instruction */
+	/* window */
+	rob_entry_t rob[OOO_MAX_ROB];
+	int head, count;
+	int rs_used;
+	int rename[MIPS_REGS];          /* producing entry of each register, -1 for the register file */
+	ooo_fetched_t fetched[OOO_FETCH_QUEUE];
+	int num_fetched;
+	int port;                       /* entry waiting on a data cache miss, -1 if none */
+	int hilo_written;               /* HI or LO committed this cycle */
+	int redirect;                   /* fetch restarts at redirect_pc this cycle */
+	uint32_t redirect_pc;
+} ooo_core_t;
+
+extern SIM_LOCAL ooo_core_t OOO;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int ooo_configure(int rob_size, int rs_size, int width, const int *units);
+int ooo_enable(int on);
+void ooo_reset();
+int ooo_empty();
+void ooo_cycle();
+void ooo_print_window(FILE *out);
+void ooo_print(FILE *out);
+void ooo_print_json(FILE *out);
+
+#endif
@@ -0,0 +1,560 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "trace.h"
+#include "btrace.h"
+#include "hazard.h"
+#include "bpred.h"
+#include "cache.h"
+#include "fu.h"
+#include "ooo.h"
+#include "funcsim.h"
+#include "snapshot.h"
+#include "debug.h"
+#include "reverse.h"
+
+SIM_LOCAL reverse_t REVERSE = { .interval = REV_DEFAULT_INTERVAL, .next = UINT32_MAX };
+
+/* interval asked for, REVERSE.interval doubles from it as the ring thins out */
+static SIM_LOCAL uint32_t BASE_INTERVAL = REV_DEFAULT_INTERVAL;
+
+static void current_settings(rev_settings_t *s)
+{
+    const cache_t *c;
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    s->cache_enabled = CACHES.enabled;
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        c = &CACHES.level[i];
+        s->cache_size[i] = c->size;
+        s->cache_line[i] = c->line;
+        s->cache_ways[i] = c->ways;
+        s->cache_replace[i] = c->replace;
+        s->cache_write_back[i] = c->write_back;
+        s->cache_latency[i] = c->latency;
+    }
+    s->mem_latency = CACHES.mem_latency;
+    s->bpred_kind = BPRED.kind;
+    s->bpred_bits = BPRED.bits;
+    s->width = PIPE_WIDTH;
+    s->forwarding = HAZARD.forwarding;
+    memcpy(s->units, FU.config, sizeof(s->units));
+}
+
+static size_t lines_size(int level)
+{
+    const cache_t *c = &CACHES.level[level];
+
+    return c->lines == NULL ? 0 : (size_t)(c->size / c->line) * sizeof(cache_line_t);
+}
+
+static void checkpoint_free(rev_checkpoint_t *c)
+{
+    int i;
+
+    snapshot_free(&c->snap);
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        free(c->lines[i]);
+    }
+    free(c->counters);
+    free(c->btb);
+    memset(c, 0, sizeof(*c));
+}
+
+/* drop every checkpoint after the first keep */
+static void forget(int keep)
+{
+    while (REVERSE.count > keep) {
+        checkpoint_free(&REVERSE.ring[--REVERSE.count]);
+    }
+}
+
+/* the latches are thread-local, so their addresses are looked up at run time */
+static CPU_Pipeline_Reg *latch(int i)
+{
+    switch (i) {
+        case 0: return IF_ID;
+        case 1: return ID_EX;
+        case 2: return EX_MEM;
+        default: return MEM_WB;
+    }
+}
+
+static rev_frame_t *frame(uint64_t seq)
+{
+    return &REVERSE.frames[seq % REV_UNDO_CYCLES];
+}
+
+static void undo_clear()
+{
+    REVERSE.oldest = REVERSE.next_frame = REVERSE.next_undo = 0;
+}
+
+/* the oldest cycles give up their frames to make room */
+static rev_undo_t *undo_append()
+{
+    while (REVERSE.oldest < REVERSE.next_frame && REVERSE.next_undo - frame(REVERSE.oldest)->first >= REV_UNDO_ENTRIES) {
+        REVERSE.oldest++;
+    }
+    return &REVERSE.undo[REVERSE.next_undo++ % REV_UNDO_ENTRIES];
+}
+
+static void schedule_next()
+{
+    uint32_t last = REVERSE.ring[REVERSE.count - 1].snap.cycle_count;
+
+    REVERSE.next = last > UINT32_MAX - REVERSE.interval ? UINT32_MAX : last + REVERSE.interval;
+}
+
+/***************************************************************/
+/* Start or stop recording, interval 0 keeps the current one                          */
+/***************************************************************/
+int reverse_record(int on, uint32_t interval)
+{
+    if (on && OOO.enabled) {
+        printf("Error: the out-of-order core can not be recorded, its window is drained by a checkpoint\n");
+        return -1;
+    }
+    if (interval > REV_MAX_INTERVAL) {
+        printf("Error: the checkpoint interval can be at most %u cycles\n", REV_MAX_INTERVAL);
+        return -1;
+    }
+    if (on && REVERSE.frames == NULL) {
+        REVERSE.frames = malloc(REV_UNDO_CYCLES * sizeof(rev_frame_t));
+        REVERSE.undo = malloc(REV_UNDO_ENTRIES * sizeof(rev_undo_t));
+    }
+    if (!on || REVERSE.frames == NULL || REVERSE.undo == NULL) {
+        free(REVERSE.frames);
+        free(REVERSE.undo);
+        REVERSE.frames = NULL;
+        REVERSE.undo = NULL;
+    }
+    if (on && REVERSE.frames == NULL) {
+        printf("Error: out of memory for the undo log\n");
+        return -1;
+    }
+    forget(0);
+    undo_clear();
+    REVERSE.recording = on;
+    REVERSE.end_valid = FALSE;
+    REVERSE.next = UINT32_MAX;
+    if (interval > 0) {
+        BASE_INTERVAL = interval;
+    }
+    REVERSE.interval = BASE_INTERVAL;
+    return 0;
+}
+
+/***************************************************************/
+/* Take a checkpoint of the current cycle                                                             */
+/***************************************************************/
+void reverse_checkpoint()
+{
+    rev_checkpoint_t *c;
+    size_t n;
+    int i;
+
+    if (REVERSE.count == REV_MAX_CHECKPOINTS && REVERSE.interval <= REV_MAX_INTERVAL / 2) {
+        /* keep every other checkpoint, they are twice as far apart from now on */
+        for (i = 1; i < REVERSE.count; i += 2) {
+            checkpoint_free(&REVERSE.ring[i]);
+        }
+        for (i = 1; i < REV_MAX_CHECKPOINTS / 2; i++) {
+            REVERSE.ring[i] = REVERSE.ring[2 * i];
+        }
+        REVERSE.count = REV_MAX_CHECKPOINTS / 2;
+        memset(&REVERSE.ring[REVERSE.count], 0, (REV_MAX_CHECKPOINTS - REVERSE.count) * sizeof(rev_checkpoint_t));
+        REVERSE.interval *= 2;
+    } else if (REVERSE.count == REV_MAX_CHECKPOINTS) {
+        /* the interval is as long as it gets, the history now starts later */
+        checkpoint_free(&REVERSE.ring[0]);
+        memmove(&REVERSE.ring[0], &REVERSE.ring[1], (REV_MAX_CHECKPOINTS - 1) * sizeof(rev_checkpoint_t));
+        REVERSE.count--;
+        memset(&REVERSE.ring[REVERSE.count], 0, sizeof(rev_checkpoint_t));
+    }
+    c = &REVERSE.ring[REVERSE.count];
+    if (snapshot_capture(&c->snap) != 0) {
+        REVERSE.next = UINT32_MAX;
+        return;
+    }
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        if ((n = lines_size(i)) > 0 && (c->lines[i] = malloc(n)) != NULL) {
+            memcpy(c->lines[i], CACHES.level[i].lines, n);
+        }
+        c->stamps[i] = CACHES.level[i].stamp;
+    }
+    c->random = CACHES.random;
+    if (BPRED.counters != NULL && (c->counters = malloc((size_t)1 << BPRED.bits)) != NULL) {
+        memcpy(c->counters, BPRED.counters, (size_t)1 << BPRED.bits);
+    }
+    if (BPRED.btb != NULL && (c->btb = malloc(sizeof(btb_entry_t) << BPRED.bits)) != NULL) {
+        memcpy(c->btb, BPRED.btb, sizeof(btb_entry_t) << BPRED.bits);
+    }
+    c->history = BPRED.history;
+    func_get_link(&c->link);
+    for (i = 0; i < CACHE_LEVELS && (lines_size(i) == 0 || c->lines[i] != NULL); i++);
+    if (i < CACHE_LEVELS || (BPRED.counters != NULL && c->counters == NULL) || (BPRED.btb != NULL && c->btb == NULL)) {
+        printf("Error: out of memory taking a checkpoint, recording stopped\n");
+        checkpoint_free(c);
+        REVERSE.next = UINT32_MAX;
+        return;
+    }
+    REVERSE.count++;
+    schedule_next();
+}
+
+/* the undo log leads up to the state left behind, so it goes too */
+static void checkpoint_apply(const rev_checkpoint_t *c)
+{
+    int i;
+
+    undo_clear();
+    snapshot_apply(&c->snap);
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        if (c->lines[i] != NULL) {
+            memcpy(CACHES.level[i].lines, c->lines[i], lines_size(i));
+        }
+        CACHES.level[i].stamp = c->stamps[i];
+    }
+    CACHES.random = c->random;
+    if (c->counters != NULL) {
+        memcpy(BPRED.counters, c->counters, (size_t)1 << BPRED.bits);
+    }
+    if (c->btb != NULL) {
+        memcpy(BPRED.btb, c->btb, sizeof(btb_entry_t) << BPRED.bits);
+    }
+    BPRED.history = c->history;
+    func_set_link(&c->link);
+}
+
+/* TRUE if the simulator is where the history left off, under the same settings */
+static int at_end()
+{
+    rev_settings_t s;
+
+    current_settings(&s);
+    return REVERSE.end_valid && REVERSE.count > 0 && CYCLE_COUNT == REVERSE.end_cycle &&
+           INSTRUCTION_COUNT == REVERSE.end_count && memcmp(&CURRENT_STATE, &REVERSE.end_state, sizeof(CPU_State)) == 0 &&
+           memcmp(&s, &REVERSE.settings, sizeof(s)) == 0;
+}
+
+/***************************************************************/
+/* Before a run: go on with the history, or start a new one here                  */
+/***************************************************************/
+void reverse_begin()
+{
+    if (!REVERSE.recording) {
+        return;
+    }
+    if (OOO.enabled) {
+        forget(0);
+        REVERSE.next = UINT32_MAX;
+        return;
+    }
+    if (!at_end()) {
+        forget(0);
+        undo_clear();
+        REVERSE.interval = BASE_INTERVAL;
+        current_settings(&REVERSE.settings);
+        reverse_checkpoint();
+    }
+    REVERSE.logging = REVERSE.count > 0;
+}
+
+/***************************************************************/
+/* After a run: remember where the history ends                                                */
+/***************************************************************/
+void reverse_end()
+{
+    REVERSE.logging = FALSE;
+    REVERSE.end_state = CURRENT_STATE;
+    REVERSE.end_cycle = CYCLE_COUNT;
+    REVERSE.end_count = INSTRUCTION_COUNT;
+    REVERSE.end_valid = REVERSE.recording && REVERSE.count > 0;
+}
+
+/***************************************************************/
+/* Start the undo log of the cycle about to run                                                  */
+/***************************************************************/
+void reverse_frame()
+{
+    rev_frame_t *f;
+    int i;
+
+    if (REVERSE.next_frame - REVERSE.oldest == REV_UNDO_CYCLES) {
+        REVERSE.oldest++;
+    }
+    f = frame(REVERSE.next_frame++);
+    f->first = REVERSE.next_undo;
+    f->cycle_count = CYCLE_COUNT;
+    f->instruction_count = INSTRUCTION_COUNT;
+    f->run_flag = RUN_FLAG;
+    f->pc = CURRENT_STATE.PC;
+    for (i = 0; i < SNAP_LATCHES; i++) {
+        memcpy(f->latches[i], latch(i), PIPE_WIDTH * sizeof(CPU_Pipeline_Reg));
+    }
+    f->units = FU.board;
+    f->stats = STATS;
+    memcpy(f->bpred, BPRED.stats, sizeof(f->bpred));
+    f->history = BPRED.history;
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        f->caches[i] = CACHES.level[i].stats;
+        f->stamps[i] = CACHES.level[i].stamp;
+    }
+    f->mem_reads = CACHES.mem_reads;
+    f->mem_writes = CACHES.mem_writes;
+    f->fetch = CACHES.fetch;
+    f->data = CACHES.data;
+    f->random = CACHES.random;
+    func_get_link(&f->link);
+}
+
+/***************************************************************/
+/* Log the values WB, MEM, the caches and the predictor overwrite                */
+/***************************************************************/
+void reverse_undo_reg(int reg, uint32_t old)
+{
+    rev_undo_t *u = undo_append();
+
+    u->kind = UNDO_REG;
+    u->size = sizeof(old);
+    u->where = reg;
+    memcpy(u->old, &old, sizeof(old));
+}
+
+/* the words the store by d to addr touches */
+void reverse_undo_mem(const decoded_inst_t *d, uint32_t addr)
+{
+    rev_undo_t *u = undo_append();
+    uint32_t bytes = d->op == OP_SB ? 1 : d->op == OP_SH ? 2 : 4, i, word;
+
+    u->kind = UNDO_MEM;
+    u->where = addr & ~3u;
+    u->size = ((addr & 3) + bytes + 3) / 4 * 4;
+    for (i = 0; i < u->size; i += 4) {
+        word = mem_read_32(u->where + i);
+        memcpy(u->old + i, &word, 4);
+    }
+}
+
+void reverse_undo_bytes(void *ptr, size_t size)
+{
+    rev_undo_t *u = undo_append();
+
+    u->kind = UNDO_BYTES;
+    u->size = size;
+    u->ptr = ptr;
+    memcpy(u->old, ptr, size);
+}
+
+static void undo_apply(const rev_undo_t *u)
+{
+    uint32_t i, word;
+
+    switch (u->kind) {
+        case UNDO_REG:
+            memcpy(u->where == 32 ? &CURRENT_STATE.HI : u->where == 33 ? &CURRENT_STATE.LO : &CURRENT_STATE.REGS[u->where],
+                   u->old, sizeof(uint32_t));
+            break;
+        case UNDO_MEM:
+            for (i = 0; i < u->size; i += 4) {
+                memcpy(&word, u->old + i, 4);
+                mem_write_32(u->where + i, word);
+            }
+            break;
+        default:
+            memcpy(u->ptr, u->old, u->size);
+            break;
+    }
+}
+
+/***************************************************************/
+/* Unwind the undo log to the start of the cycle in frame seq                         */
+/***************************************************************/
+/* Records the restored latches point at, rebuilt like a snapshot's are. */
+static SIM_LOCAL decoded_inst_t LATCH_INSTS[SNAP_LATCHES][PIPE_MAX_WIDTH];
+
+static void unwind(uint64_t seq)
+{
+    const rev_frame_t *f = frame(seq);
+    CPU_Pipeline_Reg *l;
+    uint64_t e;
+    int i, j;
+
+    for (e = REVERSE.next_undo; e-- > f->first; ) {
+        undo_apply(&REVERSE.undo[e % REV_UNDO_ENTRIES]);
+    }
+    CYCLE_COUNT = f->cycle_count;
+    INSTRUCTION_COUNT = f->instruction_count;
+    RUN_FLAG = f->run_flag;
+    CURRENT_STATE.PC = f->pc;
+    NEXT_STATE = CURRENT_STATE;
+    for (i = 0; i < SNAP_LATCHES; i++) {
+        l = latch(i);
+        memcpy(l, f->latches[i], PIPE_WIDTH * sizeof(CPU_Pipeline_Reg));
+        for (j = 0; j < PIPE_WIDTH; j++) {
+            if (l[j].inst != NULL) {
+                decode_word(l[j].IR, &LATCH_INSTS[i][j]);
+                l[j].inst = &LATCH_INSTS[i][j];
+            }
+        }
+    }
+    FU.board = f->units;
+    STATS = f->stats;
+    memcpy(BPRED.stats, f->bpred, sizeof(f->bpred));
+    BPRED.history = f->history;
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        CACHES.level[i].stats = f->caches[i];
+        CACHES.level[i].stamp = f->stamps[i];
+    }
+    CACHES.mem_reads = f->mem_reads;
+    CACHES.mem_writes = f->mem_writes;
+    CACHES.fetch = f->fetch;
+    CACHES.data = f->data;
+    CACHES.random = f->random;
+    func_set_link(&f->link);
+    REVERSE.next_frame = seq;
+    REVERSE.next_undo = f->first;
+}
+
+/* -1 unless the history leads up to the current state */
+static int can_go_back()
+{
+    if (!REVERSE.recording) {
+        printf("Error: nothing is recorded, turn recording on with record on\n");
+        return -1;
+    }
+    if (!at_end()) {
+        printf("Error: the state or settings changed since the last recorded run, there is no history to go back through\n");
+        return -1;
+    }
+    if (BTRACE_ON) {
+        printf("Error: the binary trace can not be rewound, turn it off first\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* run forward to target without tracing or stopping, logging if asked to */
+static void replay(uint32_t target)
+{
+    int level = TRACE_LEVEL;
+
+    TRACE_LEVEL = TRACE_OFF;
+    while (RUN_FLAG && CYCLE_COUNT < target) {
+        if (REVERSE.logging) {
+            reverse_frame();
+        }
+        cycle_skip(target - CYCLE_COUNT);
+    }
+    TRACE_LEVEL = level;
+}
+
+/* replay to target from wherever the state was put back, and end the history there */
+static void arrive(uint32_t target)
+{
+    int keep;
+
+    REVERSE.logging = TRUE;
+    replay(target);
+    for (keep = REVERSE.count; keep > 1 && REVERSE.ring[keep - 1].snap.cycle_count > CYCLE_COUNT; keep--);
+    forget(keep);
+    schedule_next();
+    reverse_end();
+    printf("Back at cycle %u, PC 0x%08x.\n", CYCLE_COUNT, CURRENT_STATE.PC);
+}
+
+/* restore checkpoint k and replay to target */
+static void go_to(int k, uint32_t target)
+{
+    checkpoint_apply(&REVERSE.ring[k]);
+    arrive(target);
+}
+
+/***************************************************************/
+/* Go back the given number of cycles, no further than the recording start  */
+/***************************************************************/
+int reverse_step(uint32_t cycles)
+{
+    uint32_t target;
+    uint64_t seq;
+    int k;
+
+    if (can_go_back() != 0) {
+        return -1;
+    }
+    target = cycles > CYCLE_COUNT ? 0 : CYCLE_COUNT - cycles;
+    if (target < REVERSE.ring[0].snap.cycle_count) {
+        target = REVERSE.ring[0].snap.cycle_count;
+    }
+    if (REVERSE.oldest < REVERSE.next_frame && frame(REVERSE.oldest)->cycle_count <= target) {
+        for (seq = REVERSE.next_frame - 1; frame(seq)->cycle_count > target; seq--);
+        unwind(seq);
+        arrive(target);
+        return 0;
+    }
+    for (k = REVERSE.count - 1; k > 0 && REVERSE.ring[k].snap.cycle_count > target; k--);
+    go_to(k, target);
+    return 0;
+}
+
+/***************************************************************/
+/* Go back to the last breakpoint or watch hit                                                       */
+/***************************************************************/
+/* Each interval is replayed, newest first, noting the hits in it, until one has
+ * any. The run stops at the start of the last cycle with a hit: before a
+ * breakpoint instruction is fetched or a watched access reaches memory. */
+int reverse_continue()
+{
+    uint32_t end = CYCLE_COUNT, upto;
+    int k;
+
+    if (can_go_back() != 0) {
+        return -1;
+    }
+    if (DEBUG.num_breaks == 0 && DEBUG.num_watches == 0) {
+        printf("Error: there are no breakpoints or watches to go back to\n");
+        return -1;
+    }
+    for (k = REVERSE.count - 1; k >= 0; k--) {
+        if (REVERSE.ring[k].snap.cycle_count >= end) {
+            continue;
+        }
+        /* the intervals after this one had no hits */
+        upto = k + 1 < REVERSE.count && REVERSE.ring[k + 1].snap.cycle_count < end ? REVERSE.ring[k + 1].snap.cycle_count : end;
+        checkpoint_apply(&REVERSE.ring[k]);
+        debug_record(TRUE);
+        replay(upto);
+        debug_record(FALSE);
+        if (DEBUG.found) {
+            go_to(k, DEBUG.event);
+            return 0;
+        }
+    }
+    printf("No breakpoint or watch hit since the recording began.\n");
+    go_to(0, REVERSE.ring[0].snap.cycle_count);
+    return 0;
+}
+
+/***************************************************************/
+/* Print the recording state                                                                                   */
+/***************************************************************/
+void reverse_print(FILE *out)
+{
+    if (!REVERSE.recording) {
+        fprintf(out, "Recording\t: off, every %u cycles when on\n", BASE_INTERVAL);
+        return;
+    }
+    fprintf(out, "Recording\t: on, every %u cycles\n", REVERSE.interval);
+    if (REVERSE.count > 0) {
+        fprintf(out, "Checkpoints\t: %d, cycles %u to %u\n", REVERSE.count, REVERSE.ring[0].snap.cycle_count,
+                REVERSE.ring[REVERSE.count - 1].snap.cycle_count);
+    }
+    if (REVERSE.oldest < REVERSE.next_frame) {
+        fprintf(out, "Undo log\t: cycles %u to %u\n", frame(REVERSE.oldest)->cycle_count, REVERSE.end_cycle);
+    }
+}
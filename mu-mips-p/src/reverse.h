@@ -0,0 +1,135 @@
+#ifndef REVERSE_H
+#define REVERSE_H
+
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "stats.h"
+#include "bpred.h"
+#include "cache.h"
+#include "fu.h"
+#include "funcsim.h"
+#include "snapshot.h"
+
+/***************************************************************/
+/* Reverse execution                                                                                               */
+/***************************************************************/
+/* While recording, run and sim keep an undo log of the last REV_UNDO_CYCLES
+ * cycles. Each cycle starts with a frame of the latches, the PC and the
+ * counters, and WB, MEM, the caches and the predictor append the old value of
+ * every register, memory word and table entry they overwrite. Going back
+ * within the log unwinds it, newest entry first, to the frame at or before the
+ * target; a cycle that idle cycle skipping jumped over is replayed from there.
+ *
+ * Further back, a checkpoint taken every interval cycles is restored and
+ * replayed forward: a snapshot, whose memory pages are shared with the
+ * previous one unless they were written in between, plus the cache tags and
+ * predictor tables a snapshot leaves alone. When the ring fills every other
+ * checkpoint is dropped and the interval doubles, up to REV_MAX_INTERVAL; past
+ * that the oldest checkpoint goes and the history starts later.
+ *
+ * The history belongs to one line of execution. A run that starts anywhere but
+ * where the last recorded one ended, or under other settings, starts a new one.
+ * Breakpoints leave the timing alone, so a replay goes through the same cycles
+ * as the run it was recorded from. The out-of-order core is not
+ * recorded, a snapshot drains its window. */
+#define REV_DEFAULT_INTERVAL    10000
+#define REV_MAX_INTERVAL        1000000         /* cycles replayed at most going back past the undo log */
+#define REV_MAX_CHECKPOINTS     32
+#define REV_UNDO_CYCLES         256             /* a frame each, kept small enough to stay in cache */
+#define REV_UNDO_ENTRIES        4096
+
+typedef enum {
+	UNDO_REG = 0,           /* where is the register, 32 for HI and 33 for LO */
+	UNDO_MEM,               /* where is the first memory word */
+	UNDO_BYTES              /* ptr is a cache line or predictor table entry */
+} undo_kind_t;
+
+/* a value about to be overwritten */
+typedef struct {
+	uint8_t kind;                           /* undo_kind_t */
+	uint8_t size;                           /* bytes of old */
+	uint32_t where;
+	void *ptr;
+	uint8_t old[16];
+} rev_undo_t;
+
+/* what a cycle changes besides the logged values, as it was before the cycle */
+typedef struct {
+	uint64_t first;                         /* first undo entry of the cycle */
+	uint32_t cycle_count, instruction_count;
+	int32_t run_flag;
+	uint32_t pc;
+	CPU_Pipeline_Reg latches[SNAP_LATCHES][PIPE_MAX_WIDTH];  /* the PIPE_WIDTH slots in use */
+	fu_scoreboard_t units;
+	sim_stats_t stats;
+	bpred_counters_t bpred[BPRED_KINDS];
+	uint32_t history;
+	cache_counters_t caches[CACHE_LEVELS];
+	uint64_t stamps[CACHE_LEVELS];
+	uint64_t mem_reads, mem_writes;
+	cache_port_t fetch, data;
+	uint32_t random;
+	func_link_t link;
+} rev_frame_t;
+
+/* what has to be the same for a replay to retrace the recorded run */
+typedef struct {
+	int cache_enabled;
+	uint32_t cache_size[CACHE_LEVELS], cache_line[CACHE_LEVELS], cache_ways[CACHE_LEVELS];
+	int cache_replace[CACHE_LEVELS], cache_write_back[CACHE_LEVELS];
+	uint32_t cache_latency[CACHE_LEVELS], mem_latency;
+	int bpred_kind, bpred_bits;
+	int width, forwarding;
+	unit_config_t units[UNIT_KINDS];
+} rev_settings_t;
+
+typedef struct {
+	snapshot_t snap;
+	cache_line_t *lines[CACHE_LEVELS];
+	uint64_t stamps[CACHE_LEVELS];
+	uint32_t random;
+	uint8_t *counters;
+	btb_entry_t *btb;
+	uint32_t history;
+	func_link_t link;                       /* a snapshot drops it, a replay needs it */
+} rev_checkpoint_t;
+
+typedef struct {
+	int recording;
+	uint32_t interval;
+	uint32_t next;                          /* cycle of the next checkpoint, UINT32_MAX when off */
+	rev_checkpoint_t ring[REV_MAX_CHECKPOINTS];   /* oldest first */
+	int count;
+	rev_settings_t settings;
+	/* where the last recorded run or replay left off */
+	CPU_State end_state;
+	uint32_t end_cycle, end_count;
+	int end_valid;
+	/* undo log, rings indexed by sequence number, allocated while recording */
+	int logging;                            /* a recorded run or replay appends to it */
+	rev_frame_t *frames;                    /* REV_UNDO_CYCLES */
+	rev_undo_t *undo;                       /* REV_UNDO_ENTRIES */
+	uint64_t oldest, next_frame;            /* frames held */
+	uint64_t next_undo;
+} reverse_t;
+
+extern SIM_LOCAL reverse_t REVERSE;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int reverse_record(int on, uint32_t interval);
+void reverse_begin();
+void reverse_checkpoint();
+void reverse_end();
+void reverse_frame();
+void reverse_undo_reg(int reg, uint32_t old);
+void reverse_undo_mem(const decoded_inst_t *d, uint32_t addr);
+void reverse_undo_bytes(void *ptr, size_t size);
+int reverse_step(uint32_t cycles);
+int reverse_continue();
+void reverse_print(FILE *out);
+
+#endif
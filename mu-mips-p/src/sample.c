@@ -0,0 +1,495 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "funcsim.h"
+#include "dbt.h"
+#include "snapshot.h"
+#include "sample.h"
+
+static SIM_LOCAL sampler_t SAMPLER;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* fixed seed, so the same program always gets the same clusters */
+static uint32_t rnd()
+{
+    SAMPLER.seed ^= SAMPLER.seed << 13;
+    SAMPLER.seed ^= SAMPLER.seed >> 17;
+    SAMPLER.seed ^= SAMPLER.seed << 5;
+    return SAMPLER.seed;
+}
+
+static double uniform()
+{
+    return (rnd() >> 8) / 16777216.0;
+}
+
+/* entry of the random projection matrix for block pc, in [-1, 1) */
+static float project(uint32_t pc, int dim)
+{
+    uint32_t x = pc * 0x9E3779B1u ^ (dim + 1) * 0x85EBCA77u;
+
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return (x >> 8) / 8388608.0f - 1.0f;
+}
+
+static double distance(const float *a, const float *b)
+{
+    double sum = 0, d;
+    int i;
+
+    for (i = 0; i < SAMPLE_DIMS; i++) {
+        d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+/***************************************************************/
+/* Length and projection of the block starting at pc                                         */
+/***************************************************************/
+/* The length runs up to and including the next control instruction. Text
+ * written while profiling can leave a stale length behind, which only moves
+ * where a block is counted as ending. */
+static const sample_block_t *block_at(uint32_t pc)
+{
+    sample_block_t *b = &SAMPLER.blocks[(pc >> 2) & (SAMPLE_BLOCK_CACHE - 1)];
+    uint32_t next = pc;
+    int i;
+
+    if (b->pc == pc && b->length != 0) {
+        return b;
+    }
+    b->pc = pc;
+    b->length = 1;
+    while (!(decode_fetch(next)->flags & (INST_CTRL | INST_HALT)) && b->length < SAMPLE_MAX_BLOCK) {
+        next += 4;
+        b->length++;
+    }
+    for (i = 0; i < SAMPLE_DIMS; i++) {
+        b->proj[i] = project(pc, i);
+    }
+    return b;
+}
+
+/***************************************************************/
+/* Run functionally to the end, one projected block vector per interval      */
+/***************************************************************/
+/* A block cut by the end of an interval is finished in the next one and
+ * counted under its own start there too, so where the boundaries fall in a
+ * loop body does not change the vectors. */
+static int profile(uint64_t max)
+{
+    sample_interval_t *iv;
+    const sample_block_t *b = NULL;
+    uint32_t left, n, done = 0;
+    int i;
+
+    while (RUN_FLAG && SAMPLER.total < max) {
+        if (SAMPLER.num_intervals == SAMPLER.max_intervals) {
+            SAMPLER.max_intervals = SAMPLER.max_intervals ? SAMPLER.max_intervals * 2 : 256;
+            iv = realloc(SAMPLER.intervals, SAMPLER.max_intervals * sizeof(sample_interval_t));
+            if (iv == NULL) {
+                printf("Error: out of memory recording intervals\n");
+                return -1;
+            }
+            SAMPLER.intervals = iv;
+        }
+        iv = &SAMPLER.intervals[SAMPLER.num_intervals++];
+        memset(iv, 0, sizeof(*iv));
+        for (left = SAMPLER.interval; left > 0 && RUN_FLAG; left -= n) {
+            if (done == 0) {
+                b = block_at(CURRENT_STATE.PC);
+            }
+            n = func_run(b->length - done < left ? b->length - done : left);
+            for (i = 0; i < SAMPLE_DIMS; i++) {
+                iv->bbv[i] += n * b->proj[i];
+            }
+            done = done + n < b->length ? done + n : 0;
+        }
+        iv->instructions = SAMPLER.interval - left;
+        SAMPLER.total += iv->instructions;
+        /* vectors are compared as fractions of their interval */
+        for (i = 0; i < SAMPLE_DIMS && iv->instructions != 0; i++) {
+            iv->bbv[i] /= iv->instructions;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* One k-means clustering from a k-means++ start, returns the squared error */
+/***************************************************************/
+static double kmeans(int k, float (*centroids)[SAMPLE_DIMS], int *assign)
+{
+    sample_interval_t *iv = SAMPLER.intervals;
+    uint32_t n = SAMPLER.num_intervals, i, count[SAMPLE_MAX_K];
+    double *dist = malloc(n * sizeof(double));
+    double sum[SAMPLE_MAX_K][SAMPLE_DIMS], total, r, d, best, sse = 0;
+    int c, j, changed, iter;
+
+    if (dist == NULL) {
+        return -1;
+    }
+    memcpy(centroids[0], iv[rnd() % n].bbv, sizeof(centroids[0]));
+    for (i = 0; i < n; i++) {
+        dist[i] = distance(iv[i].bbv, centroids[0]);
+    }
+    /* later centres are picked with probability proportional to their squared distance */
+    for (c = 1; c < k; c++) {
+        for (i = 0, total = 0; i < n; i++) {
+            total += dist[i];
+        }
+        r = uniform() * total;
+        for (i = 0; i + 1 < n && (r -= dist[i]) > 0; i++);
+        if (total == 0) {
+            i = rnd() % n;
+        }
+        memcpy(centroids[c], iv[i].bbv, sizeof(centroids[c]));
+        for (i = 0; i < n; i++) {
+            d = distance(iv[i].bbv, centroids[c]);
+            if (d < dist[i]) {
+                dist[i] = d;
+            }
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        assign[i] = -1;
+    }
+    for (iter = 0, changed = TRUE; changed && iter < SAMPLE_ITERATIONS; iter++) {
+        changed = FALSE;
+        sse = 0;
+        memset(sum, 0, sizeof(sum));
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; i++) {
+            for (c = 0, j = 0, best = -1; c < k; c++) {
+                d = distance(iv[i].bbv, centroids[c]);
+                if (best < 0 || d < best) {
+                    best = d;
+                    j = c;
+                }
+            }
+            if (assign[i] != j) {
+                assign[i] = j;
+                changed = TRUE;
+            }
+            sse += best;
+            count[j]++;
+            for (c = 0; c < SAMPLE_DIMS; c++) {
+                sum[j][c] += iv[i].bbv[c];
+            }
+        }
+        /* an empty cluster keeps its centre */
+        for (j = 0; j < k; j++) {
+            for (c = 0; c < SAMPLE_DIMS && count[j] != 0; c++) {
+                centroids[j][c] = sum[j][c] / count[j];
+            }
+        }
+    }
+    free(dist);
+    return sse;
+}
+
+/***************************************************************/
+/* Bayesian information criterion of a clustering, as in X-means/SimPoint */
+/***************************************************************/
+/* floor is the variance of noise (see noise_floor()). Without it clusters that
+ * only tell noise apart shrink the variance towards zero, and the likelihood
+ * gained that way outgrows the penalty of k * (SAMPLE_DIMS + 1) parameters at
+ * any k. */
+static double bic(int k, double sse, const int *assign, double floor)
+{
+    double r = SAMPLER.num_intervals, variance, l = 0, rc;
+    uint32_t i, count[SAMPLE_MAX_K] = { 0 };
+    int c;
+
+    for (i = 0; i < SAMPLER.num_intervals; i++) {
+        count[assign[i]]++;
+    }
+    /* per dimension, as the likelihood below counts it */
+    variance = (r > k) ? sse / (r - k) / SAMPLE_DIMS : 0;
+    if (variance < floor) {
+        variance = floor;
+    }
+    for (c = 0; c < k; c++) {
+        rc = count[c];
+        if (rc == 0) {
+            continue;
+        }
+        l += rc * log(rc) - rc * log(r) - rc / 2 * log(2 * M_PI) - rc * SAMPLE_DIMS / 2 * log(variance) - (rc - k) / 2;
+    }
+    return l - k * (SAMPLE_DIMS + 1) / 2.0 * log(r);
+}
+
+/* Per dimension variance of a spread SAMPLE_NOISE times the mean vector size */
+static double noise_floor()
+{
+    double sum = 0;
+    uint32_t i;
+    int c;
+
+    for (i = 0; i < SAMPLER.num_intervals; i++) {
+        for (c = 0; c < SAMPLE_DIMS; c++) {
+            sum += SAMPLER.intervals[i].bbv[c] * SAMPLER.intervals[i].bbv[c];
+        }
+    }
+    sum = sum / SAMPLER.num_intervals / SAMPLE_DIMS * SAMPLE_NOISE * SAMPLE_NOISE;
+    return sum > 1e-12 ? sum : 1e-12;
+}
+
+/***************************************************************/
+/* Cluster the intervals, the smallest k within 90% of the best BIC wins     */
+/***************************************************************/
+static int cluster(int max_k)
+{
+    static const int picks_none[SAMPLE_PICKS] = { -1, -1 };
+    float centroids[SAMPLE_MAX_K][SAMPLE_DIMS], kept[SAMPLE_MAX_K][SAMPLE_MAX_K][SAMPLE_DIMS];
+    double score[SAMPLE_MAX_K + 1], sse, best, lo = 0, hi = 0, d, nearest, floor = noise_floor();
+    uint32_t n = SAMPLER.num_intervals, i, members;
+    int *assign[SAMPLE_MAX_K + 1] = { NULL }, *trial = malloc(n * sizeof(int));
+    int k, run, c, chosen, ok = 0;
+
+    if (max_k > (int)n) {
+        max_k = n;
+    }
+    for (k = 1; k <= max_k && trial != NULL; k++) {
+        if ((assign[k] = malloc(n * sizeof(int))) == NULL) {
+            break;
+        }
+        for (run = 0, best = -1; run < SAMPLE_RESTARTS; run++) {
+            sse = kmeans(k, centroids, trial);
+            if (sse >= 0 && (best < 0 || sse < best)) {
+                best = sse;
+                memcpy(assign[k], trial, n * sizeof(int));
+                memcpy(kept[k - 1], centroids, sizeof(centroids));
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        score[k] = bic(k, best, assign[k], floor);
+        if (k == 1 || score[k] < lo) lo = score[k];
+        if (k == 1 || score[k] > hi) hi = score[k];
+    }
+    if (k <= max_k) {
+        printf("Error: out of memory clustering intervals\n");
+        ok = -1;
+        max_k = k - 1;
+    }
+    for (chosen = 1; chosen < max_k && score[chosen] < lo + 0.9 * (hi - lo); chosen++);
+
+    SAMPLER.k = chosen;
+    for (c = 0; c < chosen && ok == 0; c++) {
+        sample_cluster_t *cl = &SAMPLER.clusters[c];
+
+        memset(cl, 0, sizeof(*cl));
+        memcpy(cl->centroid, kept[chosen - 1][c], sizeof(cl->centroid));
+        memcpy(cl->picks, picks_none, sizeof(cl->picks));
+        /* the interval nearest the centre, then one drawn from the rest */
+        for (i = 0, nearest = -1; i < n; i++) {
+            if (assign[chosen][i] != c) {
+                continue;
+            }
+            cl->size++;
+            cl->instructions += SAMPLER.intervals[i].instructions;
+            d = distance(SAMPLER.intervals[i].bbv, cl->centroid);
+            if (nearest < 0 || d < nearest) {
+                nearest = d;
+                cl->picks[0] = i;
+            }
+        }
+        if (cl->size > 1) {
+            members = rnd() % (cl->size - 1);
+            for (i = 0; i < n; i++) {
+                if (assign[chosen][i] == c && (int)i != cl->picks[0] && members-- == 0) {
+                    cl->picks[1] = i;
+                    break;
+                }
+            }
+        }
+    }
+    for (i = 0; i < n && ok == 0; i++) {
+        SAMPLER.intervals[i].cluster = assign[chosen][i];
+    }
+    for (k = 1; k <= SAMPLE_MAX_K; k++) {
+        free(assign[k]);
+    }
+    free(trial);
+    return trial == NULL ? -1 : ok;
+}
+
+static int compare_picks(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/***************************************************************/
+/* Fast-forward to each picked interval, warm up, then time it in the pipeline */
+/***************************************************************/
+/* The pipeline is empty on entry. Picks are visited in program order, so the
+ * program is run through once; the warm-up is cut short when the previous
+ * interval ended too close. */
+static void measure(uint32_t base_count)
+{
+    int order[SAMPLE_MAX_K * SAMPLE_PICKS];
+    int num = 0, i, c, p, idx;
+    uint64_t start, warm, pos;
+    uint32_t i0, i1, c0;
+    sample_cluster_t *cl;
+
+    for (c = 0; c < SAMPLER.k; c++) {
+        for (p = 0; p < SAMPLE_PICKS; p++) {
+            if (SAMPLER.clusters[c].picks[p] >= 0) {
+                order[num++] = SAMPLER.clusters[c].picks[p];
+            }
+        }
+    }
+    qsort(order, num, sizeof(int), compare_picks);
+
+    for (i = 0; i < num && RUN_FLAG; i++) {
+        idx = order[i];
+        start = (uint64_t)idx * SAMPLER.interval;
+        pos = (uint32_t)(INSTRUCTION_COUNT - base_count);
+        warm = start > SAMPLER.warmup ? start - SAMPLER.warmup : 0;
+        if (warm < pos) {
+            warm = pos;
+        }
+        if (warm > pos) {
+            dbt_run(warm - pos);
+        }
+        i0 = INSTRUCTION_COUNT;
+        while (RUN_FLAG && start > warm && INSTRUCTION_COUNT - i0 < start - warm) {
+            cycle_skip(UINT32_MAX);
+        }
+        c0 = CYCLE_COUNT;
+        i1 = INSTRUCTION_COUNT;
+        while (RUN_FLAG && INSTRUCTION_COUNT - i1 < SAMPLER.intervals[idx].instructions) {
+            cycle_skip(UINT32_MAX);
+        }
+        cl = &SAMPLER.clusters[SAMPLER.intervals[idx].cluster];
+        if (INSTRUCTION_COUNT != i1) {
+            cl->cpi[cl->measured++] = (double)(CYCLE_COUNT - c0) / (INSTRUCTION_COUNT - i1);
+        }
+        drain_pipeline();
+        SAMPLER.detailed += INSTRUCTION_COUNT - i0;
+    }
+}
+
+static void print_report(double estimate, double error, double t_profile, double t_detail)
+{
+    const sample_cluster_t *cl;
+    int c, p;
+
+    printf("-------------------------------------------------------------\n");
+    printf("[Cluster]\t[Intervals]\t[Weight]\t[Intervals picked]\t[CPI]\n");
+    printf("-------------------------------------------------------------\n");
+    for (c = 0; c < SAMPLER.k; c++) {
+        cl = &SAMPLER.clusters[c];
+        printf("%d\t\t%u\t\t%.3f\t\t", c, cl->size, (double)cl->instructions / SAMPLER.total);
+        for (p = 0; p < SAMPLE_PICKS; p++) {
+            if (p < cl->measured) {
+                printf("%s%d", p ? "," : "", cl->picks[p]);
+            }
+        }
+        printf("\t\t\t");
+        for (p = 0; p < cl->measured; p++) {
+            printf("%s%.3f", p ? "," : "", cl->cpi[p]);
+        }
+        printf("\n");
+    }
+    printf("-------------------------------------------------------------\n");
+    printf("%u intervals of %u instructions (%llu in all), %d clusters\n", SAMPLER.num_intervals, SAMPLER.interval,
+           (unsigned long long)SAMPLER.total, SAMPLER.k);
+    printf("%llu instructions in the pipeline with warm-up (%.2f%% of the program)\n",
+           (unsigned long long)SAMPLER.detailed, SAMPLER.total ? 100.0 * SAMPLER.detailed / SAMPLER.total : 0.0);
+    printf("Estimated CPI %.4f +/- %.4f (95%%), %.0f cycles\n", estimate, error, estimate * SAMPLER.total);
+    printf("Profile %.3f s, detailed %.3f s\n\n", t_profile, t_detail);
+}
+
+/***************************************************************/
+/* Estimate the CPI of the rest of the program from sampled intervals        */
+/***************************************************************/
+/* The simulator is put back as it was afterwards. Each cluster weighs in with
+ * its share of the instructions, the error comes from the spread of the two
+ * intervals measured in it (stratified sampling). */
+int sample_run(uint32_t interval, uint32_t warmup, int max_k)
+{
+    snapshot_t base;
+    uint32_t base_count;
+    double t0, t1, t2, w, mean, var, estimate = 0, variance = 0;
+    const sample_cluster_t *cl;
+    int c, p, ok;
+
+    if (interval == 0 || max_k < 1 || max_k > SAMPLE_MAX_K) {
+        printf("Error: the interval must be at least 1 instruction and k 1 to %d\n", SAMPLE_MAX_K);
+        return -1;
+    }
+    if (RUN_FLAG == FALSE) {
+        printf("Simulation Stopped\n\n");
+        return -1;
+    }
+    drain_pipeline();
+    if (snapshot_capture(&base) != 0) {
+        return -1;
+    }
+    memset(&SAMPLER, 0, sizeof(SAMPLER));
+    SAMPLER.interval = interval;
+    SAMPLER.warmup = warmup;
+    SAMPLER.seed = 0x2545F491;
+    base_count = INSTRUCTION_COUNT;
+
+    t0 = now();
+    SAMPLER.blocks = calloc(SAMPLE_BLOCK_CACHE, sizeof(sample_block_t));
+    ok = SAMPLER.blocks != NULL ? profile(SAMPLE_DEFAULT_MAX) : -1;
+    free(SAMPLER.blocks);
+    SAMPLER.blocks = NULL;
+    snapshot_apply(&base);
+    if (ok == 0 && SAMPLER.num_intervals != 0) {
+        ok = cluster(max_k);
+    }
+    t1 = now();
+    if (ok == 0 && SAMPLER.num_intervals != 0) {
+        measure(base_count);
+    }
+    t2 = now();
+    snapshot_apply(&base);
+    snapshot_free(&base);
+
+    if (ok == 0 && SAMPLER.num_intervals != 0) {
+        for (c = 0; c < SAMPLER.k; c++) {
+            cl = &SAMPLER.clusters[c];
+            if (cl->measured == 0) {
+                continue;
+            }
+            w = (double)cl->instructions / SAMPLER.total;
+            for (p = 0, mean = 0; p < cl->measured; p++) {
+                mean += cl->cpi[p] / cl->measured;
+            }
+            for (p = 0, var = 0; p < cl->measured && cl->measured > 1; p++) {
+                var += (cl->cpi[p] - mean) * (cl->cpi[p] - mean) / (cl->measured - 1);
+            }
+            estimate += w * mean;
+            variance += w * w * var / cl->measured;
+        }
+        print_report(estimate, 1.96 * sqrt(variance), t1 - t0, t2 - t1);
+    }
+    free(SAMPLER.intervals);
+    SAMPLER.intervals = NULL;
+    return ok;
+}
@@ -0,0 +1,65 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdint.h>
+
+/***************************************************************/
+/* Sampled simulation                                                                                             */
+/***************************************************************/
+/* A functional pass splits the run into fixed intervals and records a basic
+ * block vector for each, randomly projected down to SAMPLE_DIMS as SimPoint
+ * does. The vectors are clustered with k-means, k chosen by the BIC, and a
+ * second pass fast-forwards to the intervals picked from each cluster, warms
+ * the pipeline up and measures them. Two intervals are measured per cluster
+ * where there are two, which gives the spread the error estimate is built on. */
+#define SAMPLE_DEFAULT_INTERVAL 10000           /* instructions */
+#define SAMPLE_DEFAULT_WARMUP   2000
+#define SAMPLE_DEFAULT_MAX      100000000       /* instructions profiled */
+#define SAMPLE_MAX_K            10
+#define SAMPLE_DIMS             15
+#define SAMPLE_PICKS            2               /* intervals measured per cluster */
+#define SAMPLE_RESTARTS         5               /* k-means runs per k, the best is kept */
+#define SAMPLE_ITERATIONS       100
+#define SAMPLE_MAX_BLOCK        1024            /* longest basic block counted as one */
+#define SAMPLE_BLOCK_CACHE      4096            /* blocks whose length and projection are kept */
+#define SAMPLE_NOISE            0.01            /* spread below this fraction of a vector's size is noise */
+
+typedef struct {
+	uint32_t pc;                    /* 0 when empty, there is no text there */
+	uint32_t length;
+	float proj[SAMPLE_DIMS];
+} sample_block_t;
+
+typedef struct {
+	float bbv[SAMPLE_DIMS];
+	uint32_t instructions;
+	int cluster;
+} sample_interval_t;
+
+typedef struct {
+	float centroid[SAMPLE_DIMS];
+	uint32_t size;                  /* intervals */
+	uint64_t instructions;
+	int picks[SAMPLE_PICKS];        /* intervals measured, -1 if none */
+	double cpi[SAMPLE_PICKS];
+	int measured;
+} sample_cluster_t;
+
+typedef struct {
+	sample_interval_t *intervals;
+	uint32_t num_intervals, max_intervals;
+	sample_block_t *blocks;         /* direct mapped on pc */
+	uint32_t interval, warmup;
+	uint64_t total;                 /* instructions profiled */
+	sample_cluster_t clusters[SAMPLE_MAX_K];
+	int k;
+	uint64_t detailed;              /* instructions run in the pipeline, warm-up included */
+	uint32_t seed;
+} sampler_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int sample_run(uint32_t interval, uint32_t warmup, int max_k);
+
+#endif
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "hazard.h"
+#include "stats.h"
+#include "bpred.h"
+#include "cache.h"
+#include "loader.h"
+#include "threaded.h"
+#include "dbt.h"
+#include "snapshot.h"
+#include "ooo.h"
+#include "sim.h"
+
+/* the context set up on this thread, NULL if none */
+static SIM_LOCAL sim_t *THREAD_SIM;
+
+static int owned(const sim_t *sim)
+{
+    if (sim == NULL || sim != THREAD_SIM) {
+        printf("Error: simulator context used from a thread that did not create it\n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/***************************************************************/
+/* Settings of a freshly started mu-mips                                                                 */
+/***************************************************************/
+void sim_default_config(sim_config_t *config)
+{
+    config->forwarding = TRUE;
+    config->caches = FALSE;
+    config->bpred_kind = BPRED_NOT_TAKEN;
+    config->bpred_bits = BPRED_DEFAULT_BITS;
+    config->width = 1;
+    config->ooo = FALSE;
+    memcpy(config->units, FU.config, sizeof(config->units));
+    config->format = LOAD_AUTO;
+}
+
+/***************************************************************/
+/* Set up the calling thread's simulator, NULL if it already has one            */
+/***************************************************************/
+sim_t *sim_create(const sim_config_t *config)
+{
+    sim_t *sim;
+
+    if (THREAD_SIM != NULL) {
+        printf("Error: this thread already has a simulator context\n");
+        return NULL;
+    }
+    sim = calloc(1, sizeof(sim_t));
+    if (sim == NULL) {
+        printf("Error: out of memory allocating simulator context\n");
+        return NULL;
+    }
+    if (config != NULL) {
+        sim->config = *config;
+    } else {
+        sim_default_config(&sim->config);
+    }
+    initialize();
+    HAZARD.forwarding = sim->config.forwarding;
+    memcpy(FU.config, sim->config.units, sizeof(FU.config));
+    CACHES.enabled = sim->config.caches;
+    if (bpred_configure(sim->config.bpred_kind, sim->config.bpred_bits) != 0 ||
+        pipeline_set_width(sim->config.width) != 0 || ooo_enable(sim->config.ooo) != 0) {
+        /* initialize() has allocated already, tear down the way sim_destroy does */
+        THREAD_SIM = sim;
+        sim_destroy(sim);
+        return NULL;
+    }
+    sim->status = SIM_ERROR;
+    THREAD_SIM = sim;
+    return sim;
+}
+
+/***************************************************************/
+/* Replace the program, memory and every counter start from scratch          */
+/***************************************************************/
+int sim_load(sim_t *sim, const char *file)
+{
+    if (!owned(sim)) {
+        return -1;
+    }
+    /* the old text is gone, so is everything decoded or translated from it */
+    mem_reset();
+    decode_flush();
+    tc_flush();
+    dbt_flush();
+    /* nothing of the last program survives a load that fails */
+    reset_state();
+    sim->status = SIM_ERROR;
+    if (loader_load(file, sim->config.format) != 0) {
+        return -1;
+    }
+    strncpy(prog_file, file, sizeof(prog_file) - 1);
+    PROGRAM_SIZE = PROGRAM_IMAGE.text_words;
+    decode_loaded_program();
+    reset_state();
+    sim->status = SIM_LIMIT;
+    return 0;
+}
+
+/***************************************************************/
+/* Cycle the pipeline until the program halts, 0 cycles means no limit       */
+/***************************************************************/
+sim_status_t sim_run(sim_t *sim, uint64_t max_cycles)
+{
+    uint64_t n;
+
+    if (!owned(sim) || sim->status == SIM_ERROR) {
+        return SIM_ERROR;
+    }
+    for (n = 0; RUN_FLAG && (max_cycles == 0 || n < max_cycles); ) {
+        n += cycle_skip((max_cycles == 0 || max_cycles - n > UINT32_MAX) ? UINT32_MAX : (uint32_t)(max_cycles - n));
+    }
+    sim->status = RUN_FLAG ? SIM_LIMIT : SIM_HALTED;
+    return sim->status;
+}
+
+void sim_result(sim_t *sim, sim_result_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    result->status = SIM_ERROR;
+    if (!owned(sim)) {
+        return;
+    }
+    result->status = sim->status;
+    if (sim->status == SIM_ERROR) {
+        /* no program ran, the counters belong to none */
+        return;
+    }
+    result->cycles = CYCLE_COUNT;
+    result->instructions = INSTRUCTION_COUNT;
+    result->state = CURRENT_STATE;
+    result->stats = STATS;
+}
+
+/***************************************************************/
+/* Free everything the calling thread's simulator holds                                     */
+/***************************************************************/
+void sim_destroy(sim_t *sim)
+{
+    if (!owned(sim)) {
+        return;
+    }
+    snapshot_release();
+    loader_release();
+    dbt_release();
+    tc_release();
+    decode_release();
+    cache_release();
+    bpred_release();
+    mem_release();
+    free(sim);
+    THREAD_SIM = NULL;
+}
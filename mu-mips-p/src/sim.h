@@ -0,0 +1,57 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "stats.h"
+#include "loader.h"
+#include "fu.h"
+
+/***************************************************************/
+/* Library interface                                                                                                 */
+/***************************************************************/
+/* Every module keeps its state in SIM_LOCAL storage, so the simulator context
+ * of a thread is the set of those globals. sim_create() sets it up for the
+ * calling thread and returns a handle that is only valid on that thread; run
+ * one context per thread to simulate several programs at once. */
+typedef enum {
+	SIM_HALTED = 0,         /* reached a halting syscall */
+	SIM_LIMIT,              /* still running after the cycle limit */
+	SIM_ERROR               /* the program could not be loaded */
+} sim_status_t;
+
+typedef struct {
+	int forwarding;
+	int caches;             /* cache timing model on */
+	int bpred_kind;         /* bpred_kind_t */
+	int bpred_bits;
+	int width;              /* instructions issued per cycle */
+	int ooo;                /* run on the out-of-order core instead of the pipeline */
+	unit_config_t units[UNIT_KINDS];        /* multiplier, divider and memory port latencies */
+	load_format_t format;
+} sim_config_t;
+
+typedef struct {
+	sim_config_t config;
+	sim_status_t status;    /* of the last sim_load() or sim_run() */
+} sim_t;
+
+typedef struct {
+	sim_status_t status;
+	uint32_t cycles, instructions;
+	CPU_State state;
+	sim_stats_t stats;
+} sim_result_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void sim_default_config(sim_config_t *config);
+sim_t *sim_create(const sim_config_t *config);
+int sim_load(sim_t *sim, const char *file);
+sim_status_t sim_run(sim_t *sim, uint64_t max_cycles);
+void sim_result(sim_t *sim, sim_result_t *result);
+void sim_destroy(sim_t *sim);
+
+#endif
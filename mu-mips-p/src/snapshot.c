@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "stats.h"
+#include "bpred.h"
+#include "cache.h"
+#include "funcsim.h"
+#include "btrace.h"
+#include "ooo.h"
+#include "snapshot.h"
+
+SIM_LOCAL snapshot_t SNAPSHOTS[SNAP_SLOTS];
+
+/* records the restored latches point at, their decode cache words may have changed since */
+static SIM_LOCAL decoded_inst_t LATCH_INSTS[SNAP_LATCHES][PIPE_MAX_WIDTH];
+
+/* the latches are thread-local, so their addresses are looked up at run time */
+static CPU_Pipeline_Reg *latch(int i)
+{
+    switch (i) {
+        case 0: return IF_ID;
+        case 1: return ID_EX;
+        case 2: return EX_MEM;
+        default: return MEM_WB;
+    }
+}
+
+/* file header, the sizes of every struct written whole reject snapshots from an incompatible build */
+typedef struct {
+	char magic[8];
+	uint32_t state_size, latch_size, stats_size;
+	uint32_t units_size, bpred_size, caches_size, port_size;
+	uint32_t num_pages;
+} snap_header_t;
+
+static void header_sizes(snap_header_t *h)
+{
+    h->state_size = sizeof(CPU_State);
+    h->latch_size = sizeof(((snapshot_t *)0)->latches);
+    h->stats_size = sizeof(sim_stats_t);
+    h->units_size = sizeof(fu_scoreboard_t);
+    h->bpred_size = sizeof(((snapshot_t *)0)->bpred);
+    h->caches_size = sizeof(((snapshot_t *)0)->caches);
+    h->port_size = sizeof(cache_port_t);
+}
+
+/***************************************************************/
+/* Copy the simulator state into s                                                                      */
+/***************************************************************/
+int snapshot_capture(snapshot_t *s)
+{
+    int i, j;
+
+    if (!ooo_empty()) {
+        drain_pipeline();
+    }
+    s->current = CURRENT_STATE;
+    s->next = NEXT_STATE;
+    s->occupied = 0;
+    for (i = 0; i < SNAP_LATCHES; i++) {
+        for (j = 0; j < PIPE_MAX_WIDTH; j++) {
+            s->latches[i][j] = latch(i)[j];
+            s->latches[i][j].inst = NULL;
+            if (latch(i)[j].inst != NULL) {
+                s->occupied |= 1 << (i * PIPE_MAX_WIDTH + j);
+            }
+        }
+    }
+    s->width = PIPE_WIDTH;
+    s->units = FU.board;
+    s->instruction_count = INSTRUCTION_COUNT;
+    s->cycle_count = CYCLE_COUNT;
+    s->run_flag = RUN_FLAG;
+    s->stats = STATS;
+    memcpy(s->bpred, BPRED.stats, sizeof(s->bpred));
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        s->caches[i] = CACHES.level[i].stats;
+    }
+    s->mem_reads = CACHES.mem_reads;
+    s->mem_writes = CACHES.mem_writes;
+    s->fetch = CACHES.fetch;
+    s->data = CACHES.data;
+    if (mem_snapshot(&s->mem) != 0) {
+        printf("Error: out of memory taking a snapshot\n");
+        return -1;
+    }
+    s->valid = TRUE;
+    return 0;
+}
+
+/***************************************************************/
+/* Put the simulator back in the state held by s                                                  */
+/***************************************************************/
+void snapshot_apply(const snapshot_t *s)
+{
+    int i, j;
+
+    ooo_reset();
+    mem_restore(&s->mem);
+    CURRENT_STATE = s->current;
+    NEXT_STATE = s->next;
+    for (i = 0; i < SNAP_LATCHES; i++) {
+        for (j = 0; j < PIPE_MAX_WIDTH; j++) {
+            latch(i)[j] = s->latches[i][j];
+            if (s->occupied & (1 << (i * PIPE_MAX_WIDTH + j))) {
+                decode_word(s->latches[i][j].IR, &LATCH_INSTS[i][j]);
+                latch(i)[j].inst = &LATCH_INSTS[i][j];
+            }
+        }
+    }
+    PIPE_WIDTH = s->width;
+    FU.board = s->units;
+    INSTRUCTION_COUNT = s->instruction_count;
+    CYCLE_COUNT = s->cycle_count;
+    RUN_FLAG = s->run_flag;
+    STATS = s->stats;
+    memcpy(BPRED.stats, s->bpred, sizeof(s->bpred));
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        CACHES.level[i].stats = s->caches[i];
+    }
+    CACHES.mem_reads = s->mem_reads;
+    CACHES.mem_writes = s->mem_writes;
+    CACHES.fetch = s->fetch;
+    CACHES.data = s->data;
+    /* a reservation taken after the snapshot must not let an sc through */
+    func_clear_link();
+}
+
+/***************************************************************/
+/* Let go of the memory pages held by s                                                                */
+/***************************************************************/
+void snapshot_free(snapshot_t *s)
+{
+    mem_snapshot_free(&s->mem);
+    s->valid = FALSE;
+}
+
+/***************************************************************/
+/* Take an in-memory snapshot, slot -1 picks the first free one                      */
+/***************************************************************/
+/* returns the slot used, or -1 */
+int snapshot_take(int slot)
+{
+    if (slot < 0) {
+        for (slot = 0; slot < SNAP_SLOTS && SNAPSHOTS[slot].valid; slot++);
+        if (slot == SNAP_SLOTS) {
+            printf("Error: all %d snapshot slots are in use\n", SNAP_SLOTS);
+            return -1;
+        }
+    } else if (slot >= SNAP_SLOTS) {
+        printf("Error: snapshot slot must be below %d\n", SNAP_SLOTS);
+        return -1;
+    }
+    if (SNAPSHOTS[slot].valid) {
+        snapshot_free(&SNAPSHOTS[slot]);
+    }
+    return snapshot_capture(&SNAPSHOTS[slot]) == 0 ? slot : -1;
+}
+
+/***************************************************************/
+/* Drop every in-memory snapshot                                                                           */
+/***************************************************************/
+void snapshot_release()
+{
+    int i;
+
+    for (i = 0; i < SNAP_SLOTS; i++) {
+        if (SNAPSHOTS[i].valid) {
+            snapshot_free(&SNAPSHOTS[i]);
+        }
+    }
+}
+
+/***************************************************************/
+/* Return to an in-memory snapshot, which stays available                            */
+/***************************************************************/
+int snapshot_restore(int slot)
+{
+    if (slot < 0 || slot >= SNAP_SLOTS || !SNAPSHOTS[slot].valid) {
+        printf("Error: no snapshot in slot %d\n", slot);
+        return -1;
+    }
+    if (OOO.enabled && SNAPSHOTS[slot].occupied != 0) {
+        printf("Error: snapshot %d holds instructions in the pipeline, turn the out-of-order core off first\n", slot);
+        return -1;
+    }
+    snapshot_apply(&SNAPSHOTS[slot]);
+    return 0;
+}
+
+static int page_is_zero(const uint8_t *data)
+{
+    uint32_t i;
+
+    for (i = 0; i < MEM_PAGE_SIZE; i++) {
+        if (data[i] != 0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/***************************************************************/
+/* Write the simulator state to file, only non-zero pages are stored          */
+/***************************************************************/
+int snapshot_save(const char *file)
+{
+    snapshot_t s;
+    snap_header_t h;
+    FILE *fp;
+    uint32_t i;
+    int ok;
+
+    if (snapshot_capture(&s) != 0) {
+        return -1;
+    }
+    fp = fopen(file, "wb");
+    if (fp == NULL) {
+        printf("Error: Can't open snapshot file %s\n", file);
+        snapshot_free(&s);
+        return -1;
+    }
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAP_MAGIC, sizeof(h.magic));
+    header_sizes(&h);
+    for (i = 0; i < s.mem.num_pages; i++) {
+        h.num_pages += !page_is_zero(s.mem.pages[i].frame->data);
+    }
+
+    ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+         fwrite(&s.current, sizeof(CPU_State), 1, fp) == 1 &&
+         fwrite(&s.next, sizeof(CPU_State), 1, fp) == 1 &&
+         fwrite(s.latches, sizeof(s.latches), 1, fp) == 1 &&
+         fwrite(&s.occupied, sizeof(uint32_t), 1, fp) == 1 &&
+         fwrite(&s.width, sizeof(int32_t), 1, fp) == 1 &&
+         fwrite(&s.units, sizeof(fu_scoreboard_t), 1, fp) == 1 &&
+         fwrite(&s.instruction_count, sizeof(uint32_t), 1, fp) == 1 &&
+         fwrite(&s.cycle_count, sizeof(uint32_t), 1, fp) == 1 &&
+         fwrite(&s.run_flag, sizeof(int32_t), 1, fp) == 1 &&
+         fwrite(&s.stats, sizeof(sim_stats_t), 1, fp) == 1 &&
+         fwrite(s.bpred, sizeof(s.bpred), 1, fp) == 1 &&
+         fwrite(s.caches, sizeof(s.caches), 1, fp) == 1 &&
+         fwrite(&s.mem_reads, sizeof(uint64_t), 1, fp) == 1 &&
+         fwrite(&s.mem_writes, sizeof(uint64_t), 1, fp) == 1 &&
+         fwrite(&s.fetch, sizeof(cache_port_t), 1, fp) == 1 &&
+         fwrite(&s.data, sizeof(cache_port_t), 1, fp) == 1;
+    for (i = 0; ok && i < s.mem.num_pages; i++) {
+        if (page_is_zero(s.mem.pages[i].frame->data)) {
+            continue;
+        }
+        ok = fwrite(&s.mem.pages[i].vpn, sizeof(uint32_t), 1, fp) == 1 &&
+             fwrite(s.mem.pages[i].frame->data, MEM_PAGE_SIZE, 1, fp) == 1;
+    }
+    if (fclose(fp) != 0 || !ok) {
+        printf("Error: Can't write snapshot file %s\n", file);
+        ok = FALSE;
+    }
+    snapshot_free(&s);
+    return ok ? (int)h.num_pages : -1;
+}
+
+/***************************************************************/
+/* Read a snapshot written by snapshot_save() and restore it                                */
+/***************************************************************/
+int snapshot_load(const char *file)
+{
+    uint8_t data[MEM_PAGE_SIZE];
+    snapshot_t s;
+    snap_header_t h, want;
+    FILE *fp;
+    uint32_t i, vpn;
+    int ok;
+
+    fp = fopen(file, "rb");
+    if (fp == NULL) {
+        printf("Error: Can't open snapshot file %s\n", file);
+        return -1;
+    }
+    if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, SNAP_MAGIC, sizeof(h.magic)) != 0) {
+        printf("Error: %s is not a snapshot file\n", file);
+        fclose(fp);
+        return -1;
+    }
+    header_sizes(&want);
+    if (h.state_size != want.state_size || h.latch_size != want.latch_size || h.stats_size != want.stats_size ||
+        h.units_size != want.units_size || h.bpred_size != want.bpred_size || h.caches_size != want.caches_size ||
+        h.port_size != want.port_size) {
+        printf("Error: %s was written by an incompatible build\n", file);
+        fclose(fp);
+        return -1;
+    }
+
+    memset(&s, 0, sizeof(s));
+    ok = fread(&s.current, sizeof(CPU_State), 1, fp) == 1 &&
+         fread(&s.next, sizeof(CPU_State), 1, fp) == 1 &&
+         fread(s.latches, sizeof(s.latches), 1, fp) == 1 &&
+         fread(&s.occupied, sizeof(uint32_t), 1, fp) == 1 &&
+         fread(&s.width, sizeof(int32_t), 1, fp) == 1 &&
+         fread(&s.units, sizeof(fu_scoreboard_t), 1, fp) == 1 &&
+         fread(&s.instruction_count, sizeof(uint32_t), 1, fp) == 1 &&
+         fread(&s.cycle_count, sizeof(uint32_t), 1, fp) == 1 &&
+         fread(&s.run_flag, sizeof(int32_t), 1, fp) == 1 &&
+         fread(&s.stats, sizeof(sim_stats_t), 1, fp) == 1 &&
+         fread(s.bpred, sizeof(s.bpred), 1, fp) == 1 &&
+         fread(s.caches, sizeof(s.caches), 1, fp) == 1 &&
+         fread(&s.mem_reads, sizeof(uint64_t), 1, fp) == 1 &&
+         fread(&s.mem_writes, sizeof(uint64_t), 1, fp) == 1 &&
+         fread(&s.fetch, sizeof(cache_port_t), 1, fp) == 1 &&
+         fread(&s.data, sizeof(cache_port_t), 1, fp) == 1;
+    if (ok && (s.width < 1 || s.width > PIPE_MAX_WIDTH || (s.width > 1 && BTRACE_ON))) {
+        printf("Error: %s holds a pipeline of width %d, which can not be restored here\n", file, (int)s.width);
+        fclose(fp);
+        return -1;
+    }
+    if (ok && OOO.enabled && s.occupied != 0) {
+        printf("Error: %s holds instructions in the pipeline, turn the out-of-order core off first\n", file);
+        fclose(fp);
+        return -1;
+    }
+    for (i = 0; ok && i < h.num_pages; i++) {
+        ok = fread(&vpn, sizeof(uint32_t), 1, fp) == 1 && fread(data, MEM_PAGE_SIZE, 1, fp) == 1;
+        if (ok && mem_snapshot_add(&s.mem, vpn, data) != 0) {
+            printf("Error: out of memory reading %s\n", file);
+            fclose(fp);
+            snapshot_free(&s);
+            return -1;
+        }
+    }
+    fclose(fp);
+    if (!ok) {
+        printf("Error: %s is truncated\n", file);
+        snapshot_free(&s);
+        return -1;
+    }
+    snapshot_apply(&s);
+    snapshot_free(&s);
+    return (int)h.num_pages;
+}
@@ -0,0 +1,57 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "stats.h"
+#include "bpred.h"
+#include "cache.h"
+#include "fu.h"
+
+/***************************************************************/
+/* Simulator checkpoints                                                                                          */
+/***************************************************************/
+/* A snapshot holds the architectural state, the pipeline latches and their
+ * width, the functional unit scoreboard, every counter and the written memory pages. The out-of-order core's
+ * window is not saved, it is drained before a snapshot is taken, and a
+ * snapshot with instructions in the latches can not be restored onto it. Predictor tables and
+ * cache contents are model state and are left as they are, so a restored run
+ * can be repeated under different settings; the miss in progress on each
+ * cache port is kept. */
+#define SNAP_SLOTS      16
+#define SNAP_MAGIC      "MUSNAP02"
+#define SNAP_LATCHES    4               /* IF/ID, ID/EX, EX/MEM, MEM/WB */
+
+typedef struct {
+	int valid;
+	CPU_State current, next;
+	CPU_Pipeline_Reg latches[SNAP_LATCHES][PIPE_MAX_WIDTH];  /* inst is rebuilt from IR on restore */
+	uint32_t occupied;                      /* bit per latch slot holding an instruction */
+	int32_t width;                          /* slots in use */
+	fu_scoreboard_t units;
+	uint32_t instruction_count, cycle_count;
+	int32_t run_flag;
+	sim_stats_t stats;
+	bpred_counters_t bpred[BPRED_KINDS];
+	cache_counters_t caches[CACHE_LEVELS];
+	uint64_t mem_reads, mem_writes;
+	cache_port_t fetch, data;
+	mem_snapshot_t mem;
+} snapshot_t;
+
+extern SIM_LOCAL snapshot_t SNAPSHOTS[SNAP_SLOTS];
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int snapshot_capture(snapshot_t *s);
+void snapshot_apply(const snapshot_t *s);
+void snapshot_free(snapshot_t *s);
+int snapshot_take(int slot);
+void snapshot_release();
+int snapshot_restore(int slot);
+int snapshot_save(const char *file);
+int snapshot_load(const char *file);
+
+#endif
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "hazard.h"
+#include "stats.h"
+#include "fu.h"
+#include "bpred.h"
+#include "cache.h"
+#include "dbt.h"
+
+SIM_LOCAL sim_stats_t STATS;
+
+static const char *STALL_NAMES[STALL_CAUSES] = { "load_use", "raw", "icache", "dcache", "hilo", "unit" };
+static const char *LIMIT_NAMES[ISSUE_LIMITS] = { "hazard", "dependence", "mem_port", "muldiv", "serial", "fetch" };
+
+void stats_reset()
+{
+    memset(&STATS, 0, sizeof(STATS));
+    bpred_reset_stats();
+    cache_reset_stats();
+}
+
+uint64_t stats_total_stalls()
+{
+    uint64_t total = 0;
+    int i;
+    for (i = 0; i < STALL_CAUSES; i++) {
+        total += STATS.stalls[i];
+    }
+    return total;
+}
+
+void stats_print_json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (; *str; str++) {
+        if ((unsigned char)*str < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char)*str);
+            continue;
+        }
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', out);
+        }
+        fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+static double cpi()
+{
+    return STATS.retired ? (double)CYCLE_COUNT / STATS.retired : 0.0;
+}
+
+/* cycles ID ran and the instructions it issued in them */
+static uint64_t issue_cycles(uint64_t *issued)
+{
+    uint64_t cycles = 0;
+    int i;
+
+    *issued = 0;
+    for (i = 0; i <= PIPE_MAX_WIDTH; i++) {
+        cycles += STATS.issued[i];
+        *issued += i * STATS.issued[i];
+    }
+    return cycles;
+}
+
+static void print_issue(FILE *out)
+{
+    uint64_t issued, partial = 0, cycles = issue_cycles(&issued);
+    int i;
+
+    for (i = 0; i < ISSUE_LIMITS; i++) {
+        partial += STATS.limits[i];
+    }
+    fprintf(out, "Issue width\t\t: %d\n", PIPE_WIDTH);
+    fprintf(out, "Issue utilization\t: %.1f%% (%.3f per cycle)\n",
+            cycles ? 100.0 * issued / (cycles * PIPE_WIDTH) : 0.0, cycles ? (double)issued / cycles : 0.0);
+    for (i = 0; i <= PIPE_WIDTH; i++) {
+        fprintf(out, "  %d %-18s: %llu\n", i, "issued", (unsigned long long)STATS.issued[i]);
+    }
+    fprintf(out, "Partial bundles\t\t: %llu\n", (unsigned long long)partial);
+    for (i = 0; i < ISSUE_LIMITS; i++) {
+        fprintf(out, "  %-20s: %llu\n", LIMIT_NAMES[i], (unsigned long long)STATS.limits[i]);
+    }
+}
+
+/***************************************************************/
+/* Print the counters for people                                                                           */
+/***************************************************************/
+void stats_print(FILE *out)
+{
+    int i;
+
+    fprintf(out, "-------------------------------------\n");
+    fprintf(out, "Performance Counters\n");
+    fprintf(out, "-------------------------------------\n");
+    fprintf(out, "Cycles\t\t\t: %u\n", CYCLE_COUNT);
+    fprintf(out, "Retired instructions\t: %llu\n", (unsigned long long)STATS.retired);
+    fprintf(out, "CPI\t\t\t: %.3f\n", cpi());
+    if (STATS.fastforwarded != 0) {
+        fprintf(out, "Fast-forwarded\t\t: %llu (not in CPI)\n", (unsigned long long)STATS.fastforwarded);
+        dbt_print(out);
+    }
+    fprintf(out, "Bubbles\t\t\t: %llu\n", (unsigned long long)STATS.bubbles);
+    fprintf(out, "Stall cycles\t\t: %llu\n", (unsigned long long)stats_total_stalls());
+    for (i = 0; i < STALL_CAUSES; i++) {
+        fprintf(out, "  %-20s: %llu\n", STALL_NAMES[i], (unsigned long long)STATS.stalls[i]);
+    }
+    fprintf(out, "Forwarded operands\t: %llu (EX/MEM %llu, MEM/WB %llu)\n",
+            (unsigned long long)(STATS.fwd_ex_mem + STATS.fwd_mem_wb),
+            (unsigned long long)STATS.fwd_ex_mem, (unsigned long long)STATS.fwd_mem_wb);
+    if (STATS.skipped != 0) {
+        fprintf(out, "Skipped stall cycles\t: %llu\n", (unsigned long long)STATS.skipped);
+    }
+    fprintf(out, "Flushed instructions\t: %llu\n", (unsigned long long)STATS.flushed);
+    if (PIPE_WIDTH > 1) {
+        print_issue(out);
+    }
+    if (OOO.enabled || STATS.ooo_cycles != 0) {
+        ooo_print(out);
+    }
+    fu_print(out);
+    bpred_print(out);
+    cache_print(out);
+    fprintf(out, "Loads\t\t\t: %llu\n", (unsigned long long)STATS.loads);
+    fprintf(out, "Stores\t\t\t: %llu\n", (unsigned long long)STATS.stores);
+    fprintf(out, "-------------------------------------\n");
+    fprintf(out, "[Operation]\t[Retired]\n");
+    fprintf(out, "-------------------------------------\n");
+    for (i = 0; i < OP_COUNT; i++) {
+        if (STATS.ops[i] != 0) {
+            fprintf(out, "%s\t\t: %llu\n", decode_op_name(i), (unsigned long long)STATS.ops[i]);
+        }
+    }
+    fprintf(out, "-------------------------------------\n");
+}
+
+/***************************************************************/
+/* Print the counters as one JSON object                                                                */
+/***************************************************************/
+void stats_print_json(FILE *out)
+{
+    uint64_t issued;
+    int i, first;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"program\": ");
+    stats_print_json_string(out, prog_file);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"forwarding\": %s,\n", HAZARD.forwarding ? "true" : "false");
+    fprintf(out, "  \"width\": %d,\n", PIPE_WIDTH);
+    fprintf(out, "  \"cycles\": %u,\n", CYCLE_COUNT);
+    fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long)STATS.retired);
+    fprintf(out, "  \"cpi\": %.6f,\n", cpi());
+    fprintf(out, "  \"fastforwarded\": %llu,\n", (unsigned long long)STATS.fastforwarded);
+    fprintf(out, "  \"bubbles\": %llu,\n", (unsigned long long)STATS.bubbles);
+    fprintf(out, "  \"stalls\": { \"total\": %llu", (unsigned long long)stats_total_stalls());
+    for (i = 0; i < STALL_CAUSES; i++) {
+        fprintf(out, ", \"%s\": %llu", STALL_NAMES[i], (unsigned long long)STATS.stalls[i]);
+    }
+    fprintf(out, ", \"skipped\": %llu },\n", (unsigned long long)STATS.skipped);
+    fprintf(out, "  \"forwarded\": { \"ex_mem\": %llu, \"mem_wb\": %llu },\n",
+            (unsigned long long)STATS.fwd_ex_mem, (unsigned long long)STATS.fwd_mem_wb);
+    fprintf(out, "  \"flushed\": %llu,\n", (unsigned long long)STATS.flushed);
+    fprintf(out, "  \"issue\": { \"cycles\": %llu", (unsigned long long)issue_cycles(&issued));
+    fprintf(out, ", \"instructions\": %llu, \"issued\": [", (unsigned long long)issued);
+    for (i = 0; i <= PIPE_WIDTH; i++) {
+        fprintf(out, "%s%llu", i ? ", " : "", (unsigned long long)STATS.issued[i]);
+    }
+    fprintf(out, "], \"limits\": {");
+    for (i = 0; i < ISSUE_LIMITS; i++) {
+        fprintf(out, "%s \"%s\": %llu", i ? "," : "", LIMIT_NAMES[i], (unsigned long long)STATS.limits[i]);
+    }
+    fprintf(out, " } },\n");
+    fprintf(out, "  \"ooo\": ");
+    ooo_print_json(out);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"units\": ");
+    fu_print_json(out);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"bpred\": ");
+    bpred_print_json(out);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"caches\": ");
+    cache_print_json(out);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"loads\": %llu,\n", (unsigned long long)STATS.loads);
+    fprintf(out, "  \"stores\": %llu,\n", (unsigned long long)STATS.stores);
+    fprintf(out, "  \"ops\": {");
+    for (i = 0, first = 1; i < OP_COUNT; i++) {
+        if (STATS.ops[i] != 0) {
+            fprintf(out, "%s \"%s\": %llu", first ? "" : ",", decode_op_name(i), (unsigned long long)STATS.ops[i]);
+            first = 0;
+        }
+    }
+    fprintf(out, " }\n");
+    fprintf(out, "}\n");
+}
+
+/***************************************************************/
+/* Write the JSON counters to file, - for stdout                                                     */
+/***************************************************************/
+int stats_dump_json(const char *file)
+{
+    FILE *out = stdout;
+
+    if (strcmp(file, "-") != 0) {
+        out = fopen(file, "w");
+        if (out == NULL) {
+            printf("Error: Can't open stats file %s\n", file);
+            return -1;
+        }
+    }
+    stats_print_json(out);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
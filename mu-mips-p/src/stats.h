@@ -0,0 +1,74 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "decode.h"
+#include "ooo.h"
+
+/***************************************************************/
+/* Performance counters                                                                                         */
+/***************************************************************/
+typedef enum {
+	STALL_LOAD_USE = 0,     /* load followed by a user, forwarding on */
+	STALL_RAW,              /* waiting for writeback, forwarding off */
+	STALL_ICACHE,           /* IF waiting on an instruction cache miss */
+	STALL_DCACHE,           /* MEM waiting on a data cache miss */
+	STALL_HILO,             /* mfhi, mflo or div waiting for an older HI/LO write to reach WB */
+	STALL_UNIT,             /* waiting for a busy unit or a multi-cycle result */
+	STALL_CAUSES
+} stall_cause_t;
+
+/* what kept ID from issuing a full bundle, the first slot left behind decides */
+typedef enum {
+	ISSUE_HAZARD = 0,       /* waits on an older instruction, as a stall would */
+	ISSUE_DEPENDENCE,       /* reads a register written earlier in the bundle */
+	ISSUE_MEM_PORT,         /* second load or store, there is one memory port */
+	ISSUE_MULDIV,           /* second HI/LO instruction, there is one multiplier */
+	ISSUE_SERIAL,           /* follows a syscall, which issues last */
+	ISSUE_FETCH,            /* IF/ID was not full */
+	ISSUE_LIMITS
+} issue_limit_t;
+
+/* what stopped the out-of-order core dispatching a fetched instruction */
+typedef enum {
+	DISPATCH_ROB_FULL = 0,
+	DISPATCH_RS_FULL,
+	DISPATCH_CAUSES
+} dispatch_stall_t;
+
+typedef struct {
+	uint64_t retired;               /* instructions through WB */
+	uint64_t fastforwarded;         /* instructions run by the functional engine */
+	uint64_t bubbles;               /* WB slots with nothing to retire */
+	uint64_t stalls[STALL_CAUSES];  /* cycles ID was held, by cause */
+	uint64_t skipped;               /* stalled cycles jumped over rather than simulated one by one */
+	uint64_t fwd_ex_mem;            /* operands forwarded from EX/MEM */
+	uint64_t fwd_mem_wb;            /* operands forwarded from MEM/WB */
+	uint64_t flushed;               /* wrong-path instructions squashed */
+	uint64_t loads;
+	uint64_t stores;
+	uint64_t ops[OP_COUNT];         /* retired instructions by operation */
+	uint64_t issued[PIPE_MAX_WIDTH + 1];    /* cycles by instructions ID passed to EX */
+	uint64_t limits[ISSUE_LIMITS];  /* cycles ID passed part of a bundle, by cause */
+	uint64_t ooo_cycles;            /* cycles run by the out-of-order core */
+	uint64_t rob_occupancy;         /* reorder buffer entries in use, summed over those cycles */
+	uint64_t rs_occupancy;          /* reservation stations in use, likewise */
+	uint64_t dispatch_stalls[DISPATCH_CAUSES];  /* cycles dispatch stopped early, by cause */
+	uint64_t fu_issued[FU_CLASSES]; /* instructions issued to each kind of functional unit */
+} sim_stats_t;
+
+extern SIM_LOCAL sim_stats_t STATS;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void stats_reset();
+uint64_t stats_total_stalls();
+void stats_print(FILE *out);
+void stats_print_json(FILE *out);
+void stats_print_json_string(FILE *out, const char *str);
+int stats_dump_json(const char *file);
+
+#endif
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+#include "decode.h"
+#include "stats.h"
+#include "funcsim.h"
+#include "threaded.h"
+
+static SIM_LOCAL tc_cache_t TC;
+
+/* handlers, the order of the label table in tc_run() */
+enum {
+    H_TRANSLATE, H_PAGE_END, H_GENERIC, H_NOP, H_HALT,
+    H_SLL, H_SRL, H_SRA,
+    H_ADDU, H_SUBU, H_AND, H_OR, H_XOR, H_NOR, H_SLT,
+    H_ADDIU, H_SLTI, H_ANDI, H_ORI, H_XORI, H_LUI,
+    H_LB, H_LW, H_SB, H_SW,
+    H_BEQ, H_BNE, H_BLEZ, H_BGTZ, H_BLTZ, H_BGEZ,
+    H_J, H_JAL, H_JR,
+    /* superinstructions */
+    H_LUI_ORI, H_ADDIU_BNE, H_ADDIU_BEQ,
+    H_COUNT
+};
+
+/***************************************************************/
+/* Write hook: retranslate overwritten words and pairs ending in them            */
+/***************************************************************/
+static void tc_invalidate(uint32_t address, uint32_t size)
+{
+    uint32_t a, index;
+    tc_slot_t *page;
+
+    for (a = (address & ~3u) - 4; a < address + size; a += 4) {
+        if (a < MEM_TEXT_BEGIN || a > MEM_TEXT_END) {
+            continue;
+        }
+        page = TC.pages[(a - MEM_TEXT_BEGIN) >> MEM_PAGE_BITS];
+        index = (a & MEM_PAGE_MASK) >> 2;
+        if (page != NULL && page[index].handler != TC.translate) {
+            page[index].handler = TC.translate;
+        }
+    }
+}
+
+void tc_init()
+{
+    TC.pages = calloc(DECODE_TEXT_PAGES, sizeof(tc_slot_t *));
+    if (TC.pages == NULL) {
+        printf("Error: out of memory allocating threaded code cache\n");
+        exit(-1);
+    }
+    mem_add_write_hook(tc_invalidate);
+}
+
+/***************************************************************/
+/* Drop every translation                                                                                       */
+/***************************************************************/
+void tc_flush()
+{
+    uint32_t i;
+
+    for (i = 0; i < DECODE_TEXT_PAGES; i++) {
+        free(TC.pages[i]);
+        TC.pages[i] = NULL;
+    }
+}
+
+void tc_release()
+{
+    if (TC.pages != NULL) {
+        tc_flush();
+        free(TC.pages);
+        TC.pages = NULL;
+    }
+}
+
+/* slot for pc, allocating its page with every slot untranslated */
+static tc_slot_t *lookup(uint32_t pc, const void *const *labels)
+{
+    tc_slot_t **page;
+    int i;
+
+    if (pc < MEM_TEXT_BEGIN || pc > MEM_TEXT_END || (pc & 3) != 0) {
+        TC.outside.handler = labels[H_TRANSLATE];
+        return &TC.outside;
+    }
+    page = &TC.pages[(pc - MEM_TEXT_BEGIN) >> MEM_PAGE_BITS];
+    if (*page == NULL) {
+        *page = malloc(TC_PAGE_SLOTS * sizeof(tc_slot_t));
+        if (*page == NULL) {
+            printf("Error: out of memory allocating threaded code page\n");
+            exit(-1);
+        }
+        for (i = 0; i < DECODE_PAGE_WORDS; i++) {
+            (*page)[i].handler = labels[H_TRANSLATE];
+        }
+        (*page)[DECODE_PAGE_WORDS].handler = labels[H_PAGE_END];
+    }
+    return &(*page)[(pc & MEM_PAGE_MASK) >> 2];
+}
+
+static int handler_of(const decoded_inst_t *d)
+{
+    /* writes to $0 that do nothing else */
+    if ((d->flags & INST_WRITES_REG) && d->dest == 0 &&
+        !(d->flags & (INST_CTRL | INST_STORE | INST_WRITES_HI | INST_WRITES_LO))) {
+        return H_NOP;
+    }
+    switch (d->op) {
+        case OP_SYSCALL: return H_HALT;
+        case OP_INVALID: return H_NOP;
+        case OP_SLL: return H_SLL;
+        case OP_SRL: return H_SRL;
+        case OP_SRA: return H_SRA;
+        case OP_ADD: case OP_ADDU: return H_ADDU;
+        case OP_SUB: case OP_SUBU: return H_SUBU;
+        case OP_AND: return H_AND;
+        case OP_OR: return H_OR;
+        case OP_XOR: return H_XOR;
+        case OP_NOR: return H_NOR;
+        case OP_SLT: return H_SLT;
+        case OP_ADDI: case OP_ADDIU: return H_ADDIU;
+        case OP_SLTI: return H_SLTI;
+        case OP_ANDI: return H_ANDI;
+        case OP_ORI: return H_ORI;
+        case OP_XORI: return H_XORI;
+        case OP_LUI: return H_LUI;
+        case OP_LB: return H_LB;
+        case OP_LW: return H_LW;
+        case OP_SB: return H_SB;
+        case OP_SW: return H_SW;
+        case OP_BEQ: return H_BEQ;
+        case OP_BNE: return H_BNE;
+        case OP_BLEZ: return H_BLEZ;
+        case OP_BGTZ: return H_BGTZ;
+        case OP_BLTZ: return H_BLTZ;
+        case OP_BGEZ: return H_BGEZ;
+        case OP_J: return H_J;
+        case OP_JAL: return H_JAL;
+        case OP_JR: return H_JR;
+        default: return H_GENERIC;
+    }
+}
+
+/***************************************************************/
+/* Fill in slot s for the word at pc, fusing it with the next word if possible */
+/***************************************************************/
+static void translate(tc_slot_t *s, uint32_t pc, const void *const *labels)
+{
+    const decoded_inst_t *d = decode_fetch(pc);
+    const decoded_inst_t *n;
+    int h = handler_of(d);
+
+    s->d = d;
+    s->rs = d->rs;
+    s->rt = d->rt;
+    s->dest = d->dest;
+    s->shamt = d->shamt;
+    s->imm = d->imm;
+    if (d->flags & INST_BRANCH) {
+        s->imm = pc + 4 + d->imm;
+    } else if (d->op == OP_J || d->op == OP_JAL) {
+        s->imm = ((pc + 4) & 0xF0000000) | d->imm;
+    } else if (d->op == OP_LUI) {
+        s->imm = d->imm << 16;
+    }
+
+    /* pairs must sit in one page so the second slot is invalidated with the first */
+    if (s != &TC.outside && (pc & MEM_PAGE_MASK) != MEM_PAGE_SIZE - 4) {
+        n = decode_fetch(pc + 4);
+        if (h == H_LUI && n->op == OP_ORI && n->rs == d->dest && n->dest != 0) {
+            /* lui rX, hi ; ori rY, rX, lo */
+            h = H_LUI_ORI;
+            s->dest2 = n->dest;
+            s->imm2 = s->imm | n->imm;
+        } else if (h == H_ADDIU && (n->op == OP_BNE || n->op == OP_BEQ) &&
+                   (n->rs == d->dest || n->rt == d->dest)) {
+            /* addiu rX, rX, k ; bne rX, rY, loop */
+            h = n->op == OP_BNE ? H_ADDIU_BNE : H_ADDIU_BEQ;
+            s->rs2 = n->rs;
+            s->rt2 = n->rt;
+            s->imm2 = pc + 8 + n->imm;
+        }
+        if (h >= H_LUI_ORI) {
+            TC.fused++;
+        }
+    }
+    if (s == &TC.outside && h != H_HALT) {
+        /* the shared slot has no neighbour to fall through to */
+        h = H_GENERIC;
+    }
+    s->handler = labels[h];
+    TC.translated++;
+}
+
+/***************************************************************/
+/* Execute up to count instructions, returns how many completed                      */
+/***************************************************************/
+uint64_t tc_run(uint64_t count)
+{
+    static const void *const labels[H_COUNT] = {
+        [H_TRANSLATE] = &&translate, [H_PAGE_END] = &&page_end, [H_GENERIC] = &&generic,
+        [H_NOP] = &&nop, [H_HALT] = &&halt,
+        [H_SLL] = &&sll, [H_SRL] = &&srl, [H_SRA] = &&sra,
+        [H_ADDU] = &&addu, [H_SUBU] = &&subu, [H_AND] = &&and, [H_OR] = &&or,
+        [H_XOR] = &&xor, [H_NOR] = &&nor, [H_SLT] = &&slt,
+        [H_ADDIU] = &&addiu, [H_SLTI] = &&slti, [H_ANDI] = &&andi, [H_ORI] = &&ori,
+        [H_XORI] = &&xori, [H_LUI] = &&lui,
+        [H_LB] = &&lb, [H_LW] = &&lw, [H_SB] = &&sb, [H_SW] = &&sw,
+        [H_BEQ] = &&beq, [H_BNE] = &&bne, [H_BLEZ] = &&blez, [H_BGTZ] = &&bgtz,
+        [H_BLTZ] = &&bltz, [H_BGEZ] = &&bgez,
+        [H_J] = &&j, [H_JAL] = &&jal, [H_JR] = &&jr,
+        [H_LUI_ORI] = &&lui_ori, [H_ADDIU_BNE] = &&addiu_bne, [H_ADDIU_BEQ] = &&addiu_beq,
+    };
+    uint32_t *R = CURRENT_STATE.REGS;
+    uint32_t pc = CURRENT_STATE.PC;
+    uint64_t n = 0;
+    CPU_Pipeline_Reg r;
+    tc_slot_t *s;
+
+    TC.translate = labels[H_TRANSLATE];
+    if (!RUN_FLAG) {
+        return 0;
+    }
+
+/* s always points at the slot for pc */
+#define DISPATCH()      do { if (n >= count) goto out; goto *s->handler; } while (0)
+#define NEXT()          do { pc += 4; s++; n++; DISPATCH(); } while (0)
+#define JUMP(target)    do { pc = (target); n++; s = lookup(pc, labels); DISPATCH(); } while (0)
+#define BRANCH(cond)    do { if (cond) { JUMP(s->imm); } NEXT(); } while (0)
+
+    s = lookup(pc, labels);
+    DISPATCH();
+
+translate:
+    translate(s, pc, labels);
+    goto *s->handler;
+page_end:
+    s = lookup(pc, labels);
+    DISPATCH();
+generic:
+    /* everything without a handler of its own goes through the exec function */
+    r.PC = pc + 4;
+    s->d->exec(s->d, &r, R[s->rs], R[s->rt]);
+    if (s->d->flags & (INST_LOAD | INST_STORE)) {
+        r.ALUOutput = func_access(s->d, r.ALUOutput, R[s->rt]);
+    }
+    if ((s->d->flags & INST_WRITES_REG) && s->dest != 0) {
+        R[s->dest] = r.ALUOutput;
+    }
+    if (s->d->flags & INST_WRITES_HI) {
+        CURRENT_STATE.HI = r.HI;
+    }
+    if (s->d->flags & INST_WRITES_LO) {
+        CURRENT_STATE.LO = r.LO;
+    }
+    if (s->d->flags & INST_CTRL) {
+        JUMP(r.tar);
+    }
+    /* the slot outside the text segment is reused, so look up again */
+    if (s == &TC.outside) {
+        JUMP(pc + 4);
+    }
+    NEXT();
+nop:
+    if (s == &TC.outside) {
+        JUMP(pc + 4);
+    }
+    NEXT();
+halt:
+    RUN_FLAG = FALSE;
+    pc += 4;
+    n++;
+    goto out;
+
+sll:    R[s->dest] = R[s->rt] << s->shamt; NEXT();
+srl:    R[s->dest] = R[s->rt] >> s->shamt; NEXT();
+sra:    R[s->dest] = (uint32_t)((int32_t)R[s->rt] >> s->shamt); NEXT();
+addu:   R[s->dest] = R[s->rs] + R[s->rt]; NEXT();
+subu:   R[s->dest] = R[s->rs] - R[s->rt]; NEXT();
+and:    R[s->dest] = R[s->rs] & R[s->rt]; NEXT();
+or:     R[s->dest] = R[s->rs] | R[s->rt]; NEXT();
+xor:    R[s->dest] = R[s->rs] ^ R[s->rt]; NEXT();
+nor:    R[s->dest] = ~(R[s->rs] | R[s->rt]); NEXT();
+slt:    R[s->dest] = (int32_t)R[s->rs] < (int32_t)R[s->rt]; NEXT();
+addiu:  R[s->dest] = R[s->rs] + s->imm; NEXT();
+slti:   R[s->dest] = (int32_t)R[s->rs] < (int32_t)s->imm; NEXT();
+andi:   R[s->dest] = R[s->rs] & s->imm; NEXT();
+ori:    R[s->dest] = R[s->rs] | s->imm; NEXT();
+xori:   R[s->dest] = R[s->rs] ^ s->imm; NEXT();
+lui:    R[s->dest] = s->imm; NEXT();
+lb:     R[s->dest] = (uint32_t)(int32_t)(int8_t)mem_read_8(R[s->rs] + s->imm); NEXT();
+lw:     R[s->dest] = mem_read_32(R[s->rs] + s->imm); NEXT();
+sb:     mem_write_8(R[s->rs] + s->imm, R[s->rt]); NEXT();
+sw:     mem_write_32(R[s->rs] + s->imm, R[s->rt]); NEXT();
+beq:    BRANCH(R[s->rs] == R[s->rt]);
+bne:    BRANCH(R[s->rs] != R[s->rt]);
+blez:   BRANCH((int32_t)R[s->rs] <= 0);
+bgtz:   BRANCH((int32_t)R[s->rs] > 0);
+bltz:   BRANCH((int32_t)R[s->rs] < 0);
+bgez:   BRANCH((int32_t)R[s->rs] >= 0);
+j:      JUMP(s->imm);
+jal:    R[31] = pc + 4; JUMP(s->imm);
+jr:     JUMP(R[s->rs]);
+
+lui_ori:
+    R[s->dest] = s->imm;
+    if (count - n < 2) {
+        NEXT();
+    }
+    R[s->dest2] = s->imm2;
+    pc += 8;
+    s += 2;
+    n += 2;
+    DISPATCH();
+addiu_bne:
+    R[s->dest] = R[s->rs] + s->imm;
+    if (count - n < 2) {
+        NEXT();
+    }
+    n++;
+    pc += 4;
+    s++;
+    if (R[s[-1].rs2] != R[s[-1].rt2]) {
+        JUMP(s[-1].imm2);
+    }
+    NEXT();
+addiu_beq:
+    R[s->dest] = R[s->rs] + s->imm;
+    if (count - n < 2) {
+        NEXT();
+    }
+    n++;
+    pc += 4;
+    s++;
+    if (R[s[-1].rs2] == R[s[-1].rt2]) {
+        JUMP(s[-1].imm2);
+    }
+    NEXT();
+
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef BRANCH
+
+out:
+    CURRENT_STATE.PC = pc;
+    NEXT_STATE = CURRENT_STATE;
+    INSTRUCTION_COUNT += n;
+    STATS.fastforwarded += n;
+    return n;
+}
@@ -0,0 +1,42 @@
+#ifndef THREADED_H
+#define THREADED_H
+
+#include <stdint.h>
+
+#include "decode.h"
+
+/***************************************************************/
+/* Threaded-code functional engine                                                                        */
+/***************************************************************/
+/* Text words are translated on first execution into slots holding the address of
+ * their handler inside tc_run(), which dispatches with computed goto. Some common
+ * pairs are fused into one superinstruction. Semantics match func_run(). */
+typedef struct {
+	const void *handler;            /* label in tc_run() */
+	const decoded_inst_t *d;        /* for the generic handler */
+	uint32_t imm;                   /* operand or absolute branch target */
+	uint32_t imm2;                  /* second half of a superinstruction */
+	uint8_t rs, rt, dest, shamt;
+	uint8_t rs2, rt2, dest2;
+} tc_slot_t;
+
+/* one slot per word plus an end-of-page slot that looks up the next page */
+#define TC_PAGE_SLOTS  (DECODE_PAGE_WORDS + 1)
+
+typedef struct {
+	tc_slot_t **pages;              /* DECODE_TEXT_PAGES entries, NULL until executed */
+	tc_slot_t outside;              /* for PCs outside the text segment */
+	const void *translate;          /* handler of an untranslated slot */
+	uint64_t translated;
+	uint64_t fused;                 /* superinstructions formed */
+} tc_cache_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void tc_init();
+void tc_flush();
+void tc_release();
+uint64_t tc_run(uint64_t count);
+
+#endif
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define TRACE_BUFFER_SIZE (1 << 16)
+
+int TRACE_LEVEL = TRACE_OFF;
+FILE *TRACE_OUT;
+
+static const char *LEVEL_NAMES[] = { "off", "summary", "inst", "stage" };
+
+/***************************************************************/
+/* Parse a level given by name or number, -1 if unknown                                  */
+/***************************************************************/
+int trace_parse_level(const char *name)
+{
+    int i;
+    for (i = TRACE_OFF; i <= TRACE_STAGE; i++) {
+        if (strcmp(name, LEVEL_NAMES[i]) == 0) {
+            return i;
+        }
+    }
+    if (name[0] >= '0' && name[0] <= '3' && name[1] == '\0') {
+        return name[0] - '0';
+    }
+    return -1;
+}
+
+const char *trace_level_name(int level)
+{
+    if (level < TRACE_OFF || level > TRACE_STAGE) {
+        return "?";
+    }
+    return LEVEL_NAMES[level];
+}
+
+/***************************************************************/
+/* Send trace output to file, or to a buffered copy of stdout if NULL           */
+/***************************************************************/
+int trace_open(const char *file)
+{
+    FILE *out;
+
+    if (file != NULL) {
+        out = fopen(file, "w");
+    } else {
+        /* a private stream on the stdout descriptor, fully buffered unlike a terminal stdout */
+        int fd = dup(STDOUT_FILENO);
+        out = fd < 0 ? NULL : fdopen(fd, "w");
+    }
+    if (out == NULL) {
+        printf("Error: Can't open trace file %s\n", file ? file : "<stdout>");
+        return -1;
+    }
+    setvbuf(out, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+    trace_close();
+    TRACE_OUT = out;
+    return 0;
+}
+
+void trace_set_level(int level)
+{
+    if (level > TRACE_MAX_LEVEL) {
+        printf("Trace level %s was compiled out, using %s\n", trace_level_name(level), trace_level_name(TRACE_MAX_LEVEL));
+        level = TRACE_MAX_LEVEL;
+    }
+    if (level > TRACE_OFF && TRACE_OUT == NULL && trace_open(NULL) != 0) {
+        return;
+    }
+    TRACE_LEVEL = level;
+}
+
+/***************************************************************/
+/* Push buffered trace output out, called before the prompt and at exit          */
+/***************************************************************/
+void trace_flush()
+{
+    if (TRACE_OUT != NULL) {
+        /* anything printed to stdout before the buffered events goes out first */
+        fflush(stdout);
+        fflush(TRACE_OUT);
+    }
+}
+
+void trace_close()
+{
+    if (TRACE_OUT != NULL) {
+        fclose(TRACE_OUT);
+        TRACE_OUT = NULL;
+    }
+}
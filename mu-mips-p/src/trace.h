@@ -0,0 +1,41 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+/***************************************************************/
+/* Trace levels                                                                                                        */
+/***************************************************************/
+#define TRACE_OFF      0   /* nothing */
+#define TRACE_SUMMARY  1   /* one line per run */
+#define TRACE_INST     2   /* one line per retired instruction */
+#define TRACE_STAGE    3   /* pipeline stage events and latch dumps every cycle */
+
+/* levels above this are compiled out entirely, e.g. -DTRACE_MAX_LEVEL=TRACE_SUMMARY */
+#ifndef TRACE_MAX_LEVEL
+#define TRACE_MAX_LEVEL TRACE_STAGE
+#endif
+
+extern int TRACE_LEVEL;
+extern FILE *TRACE_OUT;
+
+/* a disabled level costs one well predicted compare, or nothing if compiled out */
+#define TRACE_ON(level) ((level) <= TRACE_MAX_LEVEL && __builtin_expect(TRACE_LEVEL >= (level), 0))
+
+#define TRACE(level, ...) do { \
+	if (TRACE_ON(level)) { \
+		fprintf(TRACE_OUT, __VA_ARGS__); \
+	} \
+} while (0)
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int trace_parse_level(const char *name);
+const char *trace_level_name(int level);
+int trace_open(const char *file);
+void trace_set_level(int level);
+void trace_flush();
+void trace_close();
+
+#endif